@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "enums.h"
+
+ES3Node* astNew(ES3Arena* arena, int type, ES3Token token) {
+	ES3Node* node = arenaAlloc(arena, sizeof(ES3Node));
+	memset(node, 0, sizeof(ES3Node));
+	node->type = type;
+	node->token = token;
+	node->valueType = TYPE_UNKNOWN;
+	return node;
+}
+
+void astPush(ES3Arena* arena, ES3Node* node, ES3Node* child) {
+	if (node->childCount == node->childCapacity) {
+		int capacity = node->childCapacity ? node->childCapacity * 2 : 4;
+		ES3Node** children = arenaAlloc(arena, sizeof(ES3Node*) * capacity);
+		if (node->childCount) memcpy(children, node->children, sizeof(ES3Node*) * node->childCount);
+		node->children = children;
+		node->childCapacity = capacity;
+	}
+	node->children[node->childCount++] = child;
+}
+
+int astMakesArrays(ES3Node* node) {
+	if (node == NULL) return 0;
+	// 1 for no, 2 for yes
+	if (node->makesArrays) return node->makesArrays - 1;
+
+	int makes = node->type == NODE_ARRAY || (node->type == NODE_CALL && node->decl != NULL);
+	for (int i = 0; i < node->childCount && !makes; i++) {
+		makes = astMakesArrays(node->children[i]);
+	}
+	makes = makes || astMakesArrays(node->left) || astMakesArrays(node->right);
+
+	node->makesArrays = makes + 1;
+	return makes;
+}
+
+/**
+ * A node astTooDeep still has to look at
+ *  - depth: number of nodes on the path from the root to it, itself included
+ */
+typedef struct ES3Pending_ {
+    ES3Node* node;
+    int depth;
+} ES3Pending;
+
+ES3Node* astTooDeep(ES3Node* node, int limit, ES3Arena* arena) {
+	// Nodes still to look at
+	int capacity = 64;
+	int count = 1;
+	ES3Pending* pending = arenaAlloc(arena, sizeof(ES3Pending) * capacity);
+	pending[0] = (ES3Pending) { node, 1 };
+
+	while (count > 0) {
+		ES3Pending next = pending[--count];
+		if (next.depth > limit) return next.node;
+
+		// Room for every child, the left and the right
+		int needed = count + next.node->childCount + 2;
+		if (needed > capacity) {
+			int grown = capacity;
+			while (grown < needed) grown *= 2;
+			pending = arenaGrow(arena, pending, sizeof(ES3Pending) * capacity, sizeof(ES3Pending) * grown);
+			capacity = grown;
+		}
+
+		for (int i = 0; i < next.node->childCount; i++) {
+			pending[count++] = (ES3Pending) { next.node->children[i], next.depth + 1 };
+		}
+		if (next.node->left != NULL) pending[count++] = (ES3Pending) { next.node->left, next.depth + 1 };
+		if (next.node->right != NULL) pending[count++] = (ES3Pending) { next.node->right, next.depth + 1 };
+	}
+	return NULL;
+}
+
+int astTokenIs(ES3Token token, const char* text) {
+	return (size_t) token.length == strlen(text) && !memcmp(token.start, text, token.length);
+}
+
+double astTokenNumber(ES3Token token) {
+	// Token text is a slice of the source and isn't NUL terminated
+	char text[64];
+	if ((size_t) token.length >= sizeof(text)) {
+		char* longText = smalloc(token.length + 1);
+		memcpy(longText, token.start, token.length);
+		longText[token.length] = '\0';
+		double num = strtod(longText, NULL);
+		free(longText);
+		return num;
+	}
+
+	memcpy(text, token.start, token.length);
+	text[token.length] = '\0';
+	return strtod(text, NULL);
+}
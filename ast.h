@@ -0,0 +1,89 @@
+#pragma once
+
+#include "esvutil.h"
+#include "lexer.h"
+
+/**
+ * A node of the syntax tree, what each field holds depends on type (a NODE_... enum)
+ *  - token: the name of a var, function or param, the text of a literal, otherwise the first token of the node
+ *  - left, right: operands of binary nodes, target and value of assignments, condition and block of if / while
+ *  - children: statements of programs and blocks, params of functions, args of calls, items of arrays
+ *  - num: value of number literals, a number literal with an empty token was made by an optimization pass
+ *  - valueType: a TYPE_... enum of what an expression is known to evaluate to, for lets and params the type of the var
+ *  - length: when valueType is TYPE_ARR, the least number of items the array can have
+ *  - decl: the NODE_LET or param a NODE_VAR refers to, the NODE_FUNC a NODE_CALL calls, NULL for std names
+ *  - slot: set by bytecodeProgram, the register of lets, params, literals and std constants, the index of functions
+ *    and which std function a std call calls
+ *  - makesArrays: what astMakesArrays found for the node, 0 until it has looked
+ *  - temp: set by codegen, the C temporary an operand is evaluated into before the operands after it, 0 for none
+ */
+typedef struct ES3Node_ {
+    int type;
+    int op;
+
+    ES3Token token;
+    double num;
+    int valueType;
+    int length;
+    struct ES3Node_* decl;
+    int slot;
+    int makesArrays;
+    int temp;
+
+    struct ES3Node_* left;
+    struct ES3Node_* right;
+
+    struct ES3Node_** children;
+    int childCount;
+    int childCapacity;
+} ES3Node;
+
+/**
+ * Allocates a node with no children from an arena
+ * @param arena - arena the tree is allocated from
+ * @param type - a NODE_... enum
+ * @param token - the token the node comes from
+ * @return The node, valid until the arena is freed
+ */
+ES3Node* astNew(ES3Arena* arena, int type, ES3Token token);
+
+/**
+ * Adds a child to the end of the children of a node
+ * @param arena - arena the tree is allocated from
+ * @param node - the parent node
+ * @param child - the node to add
+ */
+void astPush(ES3Arena* arena, ES3Node* node, ES3Node* child);
+
+/**
+ * Checks if running a statement or expression can make arrays in the current region
+ * The answer is kept on the node so nested loops don't each walk everything inside them, the tree can't change
+ * after the first call
+ * @param node - any node, can be NULL
+ * @return 1 if it has an array literal or calls an ES3 function, which can return one, otherwise 0
+ */
+int astMakesArrays(ES3Node* node);
+
+/**
+ * Finds a node deeper in a tree than a limit, without recursing so it works on trees too deep to recurse down
+ * @param node - root of the tree
+ * @param limit - the most nodes a path from the root can have
+ * @param arena - arena scratch memory is allocated from
+ * @return The first node found past the limit, NULL if there is none
+ */
+ES3Node* astTooDeep(ES3Node* node, int limit, ES3Arena* arena);
+
+/**
+ * Parses the text of a TOKEN_NUM token
+ * @param token - the number token
+ * @return The value of the number
+ */
+double astTokenNumber(ES3Token token);
+
+/**
+ * Checks if a token slice is equal to a string
+ * @param token - the token
+ * @param text - NUL terminated string to compare against
+ * @return 1 if they are equal, otherwise 0
+ */
+int astTokenIs(ES3Token token, const char* text);
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+// cmd only takes backslashes in the program it runs
+#define BENCH_ES3 "es3.exe"
+#define BENCH_PROGRAM "bench\\out.exe > NUL"
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+// sh only runs programs in the current directory given a path
+#define BENCH_ES3 "./es3.exe"
+#define BENCH_PROGRAM "./bench/out.exe > /dev/null"
+#endif
+
+/*
+ * Times each phase of building and running .es3 programs: es3 transpiling to C, gcc compiling it and the program running
+ * Run from the root of the repo after make, options other than these are passed on to es3
+ *   bench [--runs N] [--json results.json] [es3 options] file.es3...
+ */
+
+// Where each run writes what it builds
+#define BENCH_OUT "bench/out"
+#define BENCH_COMMAND_SIZE 8192
+
+enum { PHASE_TRANSPILE, PHASE_GCC, PHASE_RUN, PHASE_COUNT };
+
+static const char* phaseNames[PHASE_COUNT] = { "transpile", "gcc", "run" };
+
+/**
+ * Timings of one program over every run
+ *  - seconds: wall time of each phase in each run
+ *  - peakKb: most memory any process of each phase had resident, over all runs
+ */
+typedef struct BenchResult_ {
+    const char* name;
+    double* seconds[PHASE_COUNT];
+    long peakKb[PHASE_COUNT];
+    int failed;
+} BenchResult;
+
+/**
+ * Gets a wall clock time
+ * @return Seconds since an arbitrary point
+ */
+static double benchSeconds(void) {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * Runs a shell command and measures it along with everything it starts
+ * @param command - the command
+ * @param OUT seconds - wall time it took
+ * @param OUT peakKb - most memory one of its processes had resident, in KB
+ * @return Its exit status, nonzero if it failed or couldn't be started
+ */
+static int benchCommand(const char* command, double* seconds, long* peakKb) {
+	double start = benchSeconds();
+	int status = -1;
+	*peakKb = 0;
+
+#ifdef _WIN32
+	// Processes the command starts are in the job too, so its peak covers gcc's cc1 and ld
+	char line[BENCH_COMMAND_SIZE + 16];
+	snprintf(line, sizeof(line), "cmd /c %s", command);
+	HANDLE job = CreateJobObjectA(NULL, NULL);
+	STARTUPINFOA startup = { sizeof(startup) };
+	PROCESS_INFORMATION process;
+	if (job != NULL && CreateProcessA(NULL, line, NULL, NULL, TRUE, CREATE_SUSPENDED, NULL, NULL, &startup, &process)) {
+		AssignProcessToJobObject(job, process.hProcess);
+		ResumeThread(process.hThread);
+		WaitForSingleObject(process.hProcess, INFINITE);
+
+		DWORD code;
+		GetExitCodeProcess(process.hProcess, &code);
+		status = (int) code;
+
+		JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+		if (QueryInformationJobObject(job, JobObjectExtendedLimitInformation, &limits, sizeof(limits), NULL)) {
+			*peakKb = (long) (limits.PeakProcessMemoryUsed / 1024);
+		}
+		CloseHandle(process.hThread);
+		CloseHandle(process.hProcess);
+	}
+	if (job != NULL) CloseHandle(job);
+#else
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0) {
+		execl("/bin/sh", "sh", "-c", command, (char*) NULL);
+		_exit(127);
+	}
+	struct rusage usage;
+	// The usage of a child covers the children it waited for, which is everything sh -c starts
+	if (child > 0 && wait4(child, &status, 0, &usage) == child) {
+		status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#ifdef __APPLE__
+		*peakKb = usage.ru_maxrss / 1024;
+#else
+		*peakKb = usage.ru_maxrss;
+#endif
+	}
+#endif
+
+	*seconds = benchSeconds() - start;
+	return status;
+}
+
+/**
+ * Runs a program through every phase once
+ * @param path - the .es3 file
+ * @param options - es3 options, each with a space in front
+ * @param result - where the timings go
+ * @param run - which run this is
+ * @return 0 on success, nonzero if a phase failed
+ */
+static int benchRun(const char* path, const char* options, BenchResult* result, int run) {
+	char command[BENCH_COMMAND_SIZE];
+	long peakKb;
+
+	// es3 prints the gcc command it would run, which is timed on its own
+	snprintf(command, sizeof(command), BENCH_ES3 " --nocache --emit-c%s %s " BENCH_OUT " > " BENCH_OUT ".log", options, path);
+	if (benchCommand(command, &result->seconds[PHASE_TRANSPILE][run], &peakKb) != 0) return 1;
+	if (peakKb > result->peakKb[PHASE_TRANSPILE]) result->peakKb[PHASE_TRANSPILE] = peakKb;
+
+	FILE* log = fopen(BENCH_OUT ".log", "r");
+	if (log == NULL) return 1;
+	char* line = fgets(command, sizeof(command), log);
+	fclose(log);
+	if (line == NULL || strncmp(line, "gcc ", 4) != 0) return 1;
+	line[strcspn(line, "\r\n")] = '\0';
+
+	if (benchCommand(command, &result->seconds[PHASE_GCC][run], &peakKb) != 0) return 1;
+	if (peakKb > result->peakKb[PHASE_GCC]) result->peakKb[PHASE_GCC] = peakKb;
+
+	if (benchCommand(BENCH_PROGRAM, &result->seconds[PHASE_RUN][run], &peakKb) != 0) return 1;
+	if (peakKb > result->peakKb[PHASE_RUN]) result->peakKb[PHASE_RUN] = peakKb;
+
+	return 0;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Gets the median and 95th percentile of some timings
+ * @param seconds - the timings, gets sorted
+ * @param count - number of timings
+ * @param OUT median - the median
+ * @param OUT p95 - the 95th percentile by nearest rank
+ */
+static void benchStats(double* seconds, int count, double* median, double* p95) {
+	qsort(seconds, count, sizeof(double), compareDoubles);
+	*median = count % 2 ? seconds[count / 2] : (seconds[count / 2 - 1] + seconds[count / 2]) / 2;
+	int rank = (count * 95 + 99) / 100;
+	*p95 = seconds[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * Writes a string as a JSON string
+ * @param file - file to write to
+ * @param text - the string
+ */
+static void jsonString(FILE* file, const char* text) {
+	fputc('"', file);
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\') fputc('\\', file);
+		fputc(*text, file);
+	}
+	fputc('"', file);
+}
+
+int main(int argc, char** argv) {
+	int runs = 5;
+	const char* jsonPath = NULL;
+	char options[BENCH_COMMAND_SIZE / 2] = "";
+	const char** files = malloc(sizeof(const char*) * argc);
+	int fileCount = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			jsonPath = argv[++i];
+		} else if (argv[i][0] == '-') {
+			strncat(options, " ", sizeof(options) - strlen(options) - 1);
+			strncat(options, argv[i], sizeof(options) - strlen(options) - 1);
+		} else {
+			files[fileCount++] = argv[i];
+		}
+	}
+	if (fileCount == 0 || runs < 1) {
+		printf("Usage: bench [--runs N] [--json results.json] [es3 options] file.es3...\n");
+		return 100;
+	}
+
+	BenchResult* results = calloc(fileCount, sizeof(BenchResult));
+	printf("%-20s %21s %21s %21s %23s\n", "", "transpile ms", "gcc ms", "run ms", "peak RSS KB");
+	printf("%-20s %10s %10s %10s %10s %10s %10s %7s %7s %7s\n", "program", "median", "p95", "median", "p95", "median", "p95", "es3", "gcc", "run");
+
+	int failures = 0;
+	for (int i = 0; i < fileCount; i++) {
+		BenchResult* result = &results[i];
+		result->name = files[i];
+		for (int phase = 0; phase < PHASE_COUNT; phase++) result->seconds[phase] = calloc(runs, sizeof(double));
+
+		for (int run = 0; run < runs && !result->failed; run++) {
+			result->failed = benchRun(files[i], options, result, run);
+		}
+		if (result->failed) {
+			printf("%-20s failed, see " BENCH_OUT ".log\n", files[i]);
+			failures++;
+			continue;
+		}
+
+		printf("%-20s", files[i]);
+		for (int phase = 0; phase < PHASE_COUNT; phase++) {
+			double median, p95;
+			benchStats(result->seconds[phase], runs, &median, &p95);
+			printf(" %10.1f %10.1f", median * 1000, p95 * 1000);
+		}
+		printf(" %7ld %7ld %7ld\n", result->peakKb[PHASE_TRANSPILE], result->peakKb[PHASE_GCC], result->peakKb[PHASE_RUN]);
+	}
+
+	if (jsonPath != NULL) {
+		FILE* json = fopen(jsonPath, "w");
+		if (json == NULL) {
+			printf("Can't write %s\n", jsonPath);
+			return 101;
+		}
+		fprintf(json, "{\n  \"time\": %lld,\n  \"runs\": %i,\n  \"options\": ", (long long) time(NULL), runs);
+		jsonString(json, options);
+		fprintf(json, ",\n  \"programs\": [");
+		for (int i = 0; i < fileCount; i++) {
+			BenchResult* result = &results[i];
+			fprintf(json, "%s\n    { \"name\": ", i ? "," : "");
+			jsonString(json, result->name);
+			fprintf(json, ", \"failed\": %s", result->failed ? "true" : "false");
+			for (int phase = 0; phase < PHASE_COUNT && !result->failed; phase++) {
+				double median, p95;
+				// Already sorted, sorting again doesn't change them
+				benchStats(result->seconds[phase], runs, &median, &p95);
+				fprintf(json, ", \"%s\": { \"median_ms\": %.3f, \"p95_ms\": %.3f, \"peak_rss_kb\": %ld }", phaseNames[phase], median * 1000, p95 * 1000, result->peakKb[phase]);
+			}
+			fprintf(json, " }");
+		}
+		fprintf(json, "\n  ]\n}\n");
+		fclose(json);
+	}
+
+	remove(BENCH_OUT ".c");
+	remove(BENCH_OUT ".exe");
+	remove(BENCH_OUT ".log");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define SCALE_ES3 "es3.exe"
+#else
+#define SCALE_ES3 "./es3.exe"
+#endif
+
+/*
+ * Generates .es3 programs that grow along one axis, and checks how transpile time grows with them
+ * Run from the root of the repo after make
+ *   scale AXIS SIZE          prints a program of that size
+ *   scale --check [--bound B] fails if transpile time grows faster than SIZE^B along any axis, or if es3 doesn't
+ *                             give a syntax error for a program nested far deeper than it allows. Most axes time
+ *                             --emit-c, the ones for the bytecode compiler time --disasm
+ */
+
+// Where --check writes the programs it times
+#define SCALE_SOURCE "bench/scale.es3"
+#define SCALE_OUT "bench/scale_out"
+// Each size is this many times the one before, the last is SCALE_FACTOR^(SCALE_STEPS - 1) times the first
+#define SCALE_FACTOR 2
+#define SCALE_STEPS 4
+// Runs of each size, the fastest counts as it has the least noise
+#define SCALE_RUNS 3
+
+/**
+ * Writes a program of a size to a file
+ * @param file - file to write to
+ * @param size - how far along the axis it goes
+ */
+typedef void (*ScaleWriter)(FILE* file, int size);
+
+/**
+ * An axis programs can grow along
+ *  - base: the smallest size --check times, big enough that transpiling takes a few ms
+ *  - tooDeep: a size nested far deeper than es3 allows, --check expects a syntax error for it instead of a crash.
+ *    0 if the axis doesn't nest
+ *  - options: what es3 is run with, besides --nocache
+ */
+typedef struct ScaleAxis_ {
+    const char* name;
+    ScaleWriter write;
+    int base;
+    int tooDeep;
+    const char* options;
+} ScaleAxis;
+
+// size statements, alternating lets and assignments
+static void writeStatements(FILE* file, int size) {
+	fprintf(file, "let total = 0;\n");
+	for (int i = 0; i < size; i++) {
+		if (i % 2 == 0) fprintf(file, "let v%i = %i;\n", i, i);
+		else fprintf(file, "total = total + v%i * 2;\n", i - 1);
+	}
+	fprintf(file, "println[total];\n");
+}
+
+static const char* operators[] = { " + ", " * ", " - ", " / " };
+
+// One expression with size operands. They are in brackets of 64, a chain of thousands of operators makes the syntax
+// tree taller than es3 allows
+static void writeExpression(FILE* file, int size) {
+	fprintf(file, "let x = 3;\nlet y = (1");
+	for (int i = 1; i < size; i++) fprintf(file, i % 64 ? "%sx" : ")%s(x", operators[i % 4]);
+	fprintf(file, ");\nprintln[y];\n");
+}
+
+// One expression in brackets nested size deep
+static void writeParens(FILE* file, int size) {
+	fprintf(file, "let x = 3;\nlet y = ");
+	for (int i = 0; i < size; i++) fprintf(file, "(");
+	fprintf(file, "x");
+	for (int i = 0; i < size; i++) fprintf(file, ")%sx", operators[i % 4]);
+	fprintf(file, ";\nprintln[y];\n");
+}
+
+// Blocks nested size deep
+static void writeNesting(FILE* file, int size) {
+	fprintf(file, "let n = 0;\n");
+	for (int i = 0; i < size; i++) fprintf(file, "%s {\n", i % 2 ? "if (n < 1)" : "while (n < 1)");
+	fprintf(file, "n = n + 1;\n");
+	for (int i = 0; i < size; i++) fprintf(file, "};\n");
+	fprintf(file, "println[n];\n");
+}
+
+// An array literal with size items
+static void writeArray(FILE* file, int size) {
+	fprintf(file, "let a = [");
+	for (int i = 0; i < size; i++) fprintf(file, i % 3 ? "%s%i" : "%s\"s%i\"", i ? ", " : "", i);
+	fprintf(file, "];\nprintln[a{0}];\n");
+}
+
+// size functions, each calling the one before
+static void writeFunctions(FILE* file, int size) {
+	fprintf(file, "let f0[x] = { return x; };\n");
+	for (int i = 1; i < size; i++) fprintf(file, "let f%i[x] = { let y = x + %i; return f%i[y]; };\n", i, i, i - 1);
+	fprintf(file, "println[f%i[1]];\n", size - 1);
+}
+
+// size statements each adding a different number, every one is a constant register of main in the bytecode
+static void writeConstants(FILE* file, int size) {
+	fprintf(file, "let total = 0;\n");
+	for (int i = 0; i < size; i++) fprintf(file, "total = total + %i.5;\n", i);
+	fprintf(file, "println[total];\n");
+}
+
+static const ScaleAxis axes[] = {
+	{ "statements", writeStatements, 20000, 0, "--emit-c" },
+	{ "expression", writeExpression, 5000, 0, "--emit-c" },
+	{ "parens", writeParens, 64, 50000, "--emit-c" },
+	{ "nesting", writeNesting, 200, 100000, "--emit-c" },
+	{ "array", writeArray, 20000, 0, "--emit-c" },
+	{ "functions", writeFunctions, 5000, 0, "--emit-c" },
+	// Bytecode functions have at most 65535 registers
+	{ "constants", writeConstants, 4000, 0, "--disasm" },
+};
+
+#define AXIS_COUNT ((int) (sizeof(axes) / sizeof(axes[0])))
+
+/**
+ * Gets a wall clock time
+ * @return Seconds since an arbitrary point
+ */
+static double scaleSeconds(void) {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * Runs es3 on SCALE_SOURCE with the options of an axis, what it prints goes to SCALE_OUT.log
+ * @param axis - the axis
+ * @return What system returned
+ */
+static int scaleRun(const ScaleAxis* axis) {
+	char command[256];
+	snprintf(command, sizeof(command), SCALE_ES3 " --nocache %s " SCALE_SOURCE " " SCALE_OUT " > " SCALE_OUT ".log", axis->options);
+	return system(command);
+}
+
+/**
+ * Writes the program of a size to SCALE_SOURCE
+ * @param axis - the axis
+ * @param size - the size
+ * @return 0 on success, nonzero if the file can't be opened
+ */
+static int scaleWrite(const ScaleAxis* axis, int size) {
+	FILE* file = fopen(SCALE_SOURCE, "w");
+	if (file == NULL) return 1;
+	axis->write(file, size);
+	fclose(file);
+	return 0;
+}
+
+/**
+ * Transpiles the program of an axis nested far deeper than es3 allows
+ * @param axis - the axis, tooDeep is the size
+ * @return 1 if es3 gave its syntax error for it, 0 if it crashed or built it
+ */
+static int scaleRejects(const ScaleAxis* axis) {
+	if (scaleWrite(axis, axis->tooDeep) != 0) return 0;
+	// Exit codes of a crash are different on every platform, es3 prints the error before it exits
+	scaleRun(axis);
+
+	FILE* log = fopen(SCALE_OUT ".log", "r");
+	if (log == NULL) return 0;
+	char line[256];
+	int rejected = 0;
+	while (!rejected && fgets(line, sizeof(line), log) != NULL) rejected = strstr(line, "nesting too deep") != NULL;
+	fclose(log);
+	return rejected;
+}
+
+/**
+ * Times transpiling a program of a size
+ * @param axis - the axis
+ * @param size - the size
+ * @return Fastest time of SCALE_RUNS runs in seconds, negative if es3 failed
+ */
+static double scaleTime(const ScaleAxis* axis, int size) {
+	if (scaleWrite(axis, size) != 0) return -1;
+
+	double fastest = -1;
+	for (int run = 0; run < SCALE_RUNS; run++) {
+		double start = scaleSeconds();
+		if (scaleRun(axis) != 0) return -1;
+		double seconds = scaleSeconds() - start;
+		if (fastest < 0 || seconds < fastest) fastest = seconds;
+	}
+	return fastest;
+}
+
+/**
+ * Times every axis at growing sizes and compares the growth against a bound
+ * @param bound - the largest allowed exponent of time against size
+ * @return 0 if every axis is within the bound, otherwise 1
+ */
+static int scaleCheck(double bound) {
+	int failures = 0;
+	printf("%-12s", "axis");
+	for (int step = 0; step < SCALE_STEPS; step++) printf(" %14s", step ? "" : "size: ms");
+	printf(" %9s\n", "exponent");
+
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		const ScaleAxis* axis = &axes[i];
+		double first = 0;
+		double last = 0;
+		int size = axis->base;
+		int failed = 0;
+
+		printf("%-12s", axis->name);
+		for (int step = 0; step < SCALE_STEPS; step++, size *= SCALE_FACTOR) {
+			double seconds = scaleTime(axis, size);
+			if (seconds < 0) {
+				failed = 1;
+				break;
+			}
+			printf(" %6i:%7.1f", size, seconds * 1000);
+			fflush(stdout);
+			if (step == 0) first = seconds;
+			last = seconds;
+		}
+		if (failed) {
+			printf(" es3 failed, see " SCALE_OUT ".log\n");
+			failures++;
+			continue;
+		}
+
+		// The slope of log time against log size from the smallest to the largest
+		double exponent = log(last / first) / log(pow(SCALE_FACTOR, SCALE_STEPS - 1));
+		int within = exponent <= bound;
+		printf(" %9.2f%s\n", exponent, within ? "" : "  over the bound");
+		if (!within) failures++;
+
+		if (axis->tooDeep == 0) continue;
+		int rejected = scaleRejects(axis);
+		printf("%-12s %6i: %s\n", "", axis->tooDeep, rejected ? "nesting too deep" : "no syntax error, see " SCALE_OUT ".log");
+		if (!rejected) failures++;
+	}
+
+	remove(SCALE_SOURCE);
+	remove(SCALE_OUT ".c");
+	remove(SCALE_OUT ".log");
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc >= 2 && strcmp(argv[1], "--check") == 0) {
+		// Linear with some room for noise and cache effects
+		double bound = 1.3;
+		if (argc >= 4 && strcmp(argv[2], "--bound") == 0) bound = atof(argv[3]);
+		return scaleCheck(bound);
+	}
+
+	if (argc == 3) {
+		for (int i = 0; i < AXIS_COUNT; i++) {
+			if (strcmp(argv[1], axes[i].name) == 0) {
+				axes[i].write(stdout, atoi(argv[2]));
+				return 0;
+			}
+		}
+	}
+
+	printf("Usage: scale AXIS SIZE | scale --check [--bound B]\nAxes:");
+	for (int i = 0; i < AXIS_COUNT; i++) printf(" %s", axes[i].name);
+	printf("\n");
+	return 100;
+}
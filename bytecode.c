@@ -0,0 +1,859 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "vm.h"
+#include "enums.h"
+
+// Registers are 16 bit operands
+#define MAX_REGISTERS 65535
+
+typedef struct ES3Compiler_ {
+    const ES3Source* source;
+    ES3Arena* arena;
+    ES3Bytecode* bytecode;
+
+    ES3Function* func;
+    int firstTemp;
+    int temps;
+    int constCapacity;
+
+    // Set of the constants of the current function, open addressed by their bits. Each slot is 1 + the index of one
+    // in func->consts, 0 for an empty slot
+    int* constSlots;
+    int constSlotCapacity;
+
+    // Boxed vars in scope, they are released when their block ends
+    int* locals;
+    int localCount;
+    int localCapacity;
+
+    // Loops around the current statement that have a region per iteration, and what it was when each var was declared
+    int loopRegions;
+    int* varRegions;
+    int inFunction;
+
+    // Set of the strings of every literal so far, open addressed by their hash. Each slot is the esvStrLiteral
+    // cache of its text, so a text used by many literals is only made immortal once
+    ES3String** literals;
+    int literalCount;
+    int literalCapacity;
+} ES3Compiler;
+
+/**
+ * Converts the escapes in the text of a string literal the way a C compiler would, the generated code pastes it into C
+ * @param arena - arena the text is allocated from
+ * @param token - the TOKEN_STR token, quotes included
+ * @param OUT length - number of chars of the text
+ * @return The text, valid until the arena is freed
+ */
+static char* unescapeString(ES3Arena* arena, ES3Token token, size_t* length) {
+	const char* cur = token.start + 1;
+	const char* end = token.start + token.length - 1;
+	char* text = arenaAlloc(arena, end - cur + 1);
+	size_t n = 0;
+
+	while (cur < end) {
+		if (*cur != '\\' || cur + 1 == end) {
+			text[n++] = *cur++;
+			continue;
+		}
+
+		cur++;
+		char c = *cur++;
+		switch (c) {
+			case 'n': text[n++] = '\n'; break;
+			case 't': text[n++] = '\t'; break;
+			case 'r': text[n++] = '\r'; break;
+			case 'a': text[n++] = '\a'; break;
+			case 'b': text[n++] = '\b'; break;
+			case 'f': text[n++] = '\f'; break;
+			case 'v': text[n++] = '\v'; break;
+			case 'x': {
+				int value = 0;
+				while (cur < end && strchr("0123456789abcdefABCDEF", *cur) != NULL) {
+					value = value * 16 + (*cur <= '9' ? *cur - '0' : (*cur | 0x20) - 'a' + 10);
+					cur++;
+				}
+				text[n++] = (char) value;
+				break;
+			}
+			default:
+				if (c >= '0' && c <= '7') {
+					int value = c - '0';
+					for (int i = 0; i < 2 && cur < end && *cur >= '0' && *cur <= '7'; i++) {
+						value = value * 8 + *cur++ - '0';
+					}
+					text[n++] = (char) value;
+				} else {
+					// \\, \', \" and \? are the char itself
+					text[n++] = c;
+				}
+				break;
+		}
+	}
+
+	text[n] = '\0';
+	*length = n;
+	return text;
+}
+
+/**
+ * Appends an instruction to the current function
+ * @param c - the compiler
+ * @param op - an OP_... enum
+ * @param a - first operand
+ * @param b - second operand
+ * @param cc - third operand
+ * @return Index of the instruction, for patching jump targets
+ */
+static int emit(ES3Compiler* c, int op, int a, int b, int cc) {
+	ES3Function* func = c->func;
+	if (func->codeCount == func->codeCapacity) {
+		int capacity = func->codeCapacity ? func->codeCapacity * 2 : 64;
+		func->code = arenaGrow(c->arena, func->code, sizeof(ES3Instr) * func->codeCapacity, sizeof(ES3Instr) * capacity);
+		func->codeCapacity = capacity;
+	}
+
+	ES3Instr* instr = &func->code[func->codeCount];
+	instr->op = op;
+	instr->a = a;
+	instr->b = b;
+	instr->c = cc;
+	instr->target = -1;
+	return func->codeCount++;
+}
+
+/**
+ * Points a jump at the next instruction
+ * @param c - the compiler
+ * @param jump - index of the jump
+ */
+static void patchJump(ES3Compiler* c, int jump) {
+	c->func->code[jump].target = c->func->codeCount;
+}
+
+/**
+ * Gets a register for a temporary, it is free again once the statement is compiled
+ * @param c - the compiler
+ * @return The register
+ */
+static int newTemp(ES3Compiler* c) {
+	int reg = c->temps++;
+	if (c->temps > c->func->regCount) {
+		if (c->temps > MAX_REGISTERS) genericError(406, "Error: function \"%.*s\" needs too many registers\n", c->func->name.length, c->func->name.start);
+		c->func->regCount = c->temps;
+	}
+	return reg;
+}
+
+/**
+ * Adds a boxed var to the vars in scope
+ * @param c - the compiler
+ * @param reg - register of the var
+ */
+static void localsPush(ES3Compiler* c, int reg) {
+	if (c->localCount == c->localCapacity) {
+		int capacity = c->localCapacity ? c->localCapacity * 2 : 16;
+		c->locals = arenaGrow(c->arena, c->locals, sizeof(int) * c->localCapacity, sizeof(int) * capacity);
+		c->localCapacity = capacity;
+	}
+	c->locals[c->localCount++] = reg;
+}
+
+/**
+ * Releases the vars in scope from a position in the scope stack up
+ * @param c - the compiler
+ * @param from - index of the first var to release
+ */
+static void emitReleases(ES3Compiler* c, int from) {
+	for (int i = from; i < c->localCount; i++) {
+		emit(c, OP_RELEASE, c->locals[i], 0, 0);
+	}
+}
+
+/**
+ * Checks if vars of a type never hold strings or arrays, so they aren't retained or released
+ * @param valueType - the TYPE_... enum of the var
+ * @return 1 if they don't, otherwise 0
+ */
+static int isUnboxedType(int valueType) {
+	return valueType == TYPE_NUM || valueType == TYPE_BOOL;
+}
+
+/**
+ * Checks if evaluating an expression can leave strings for esvCollect, anything that isn't a number or bool can
+ * @param node - the expression node
+ * @return 1 if it can, otherwise 0
+ */
+static int makesStrings(const ES3Node* node) {
+	if (node == NULL) return 0;
+	if (node->type == NODE_CALL || !isUnboxedType(node->valueType)) return 1;
+	return makesStrings(node->left) || makesStrings(node->right);
+}
+
+/**
+ * Gets the bits that tell constants of the same type apart, numbers by their bit pattern so -0 and 0 stay apart
+ * @param value - the constant
+ * @return The bits
+ */
+static uint64_t constantBits(ES3Var value) {
+	uint64_t bits = 0;
+	switch (ES3_TYPE(value)) {
+		case 1: {
+			double num = ES3_AS_NUM(value);
+			memcpy(&bits, &num, sizeof(double));
+			break;
+		}
+		// Literals with the same text share one string
+		case 2: bits = (uint64_t) (uintptr_t) ES3_AS_STR(value); break;
+		case 3: bits = (uint64_t) ES3_AS_BOOL(value); break;
+	}
+	return bits;
+}
+
+/**
+ * Finds the slot of a constant in the set of constants of the current function
+ * @param c - the compiler
+ * @param slots - the set
+ * @param capacity - number of slots, a power of 2
+ * @param value - the constant
+ * @return The slot holding it, or the empty slot it goes in
+ */
+static int constantSlot(const ES3Compiler* c, const int* slots, int capacity, ES3Var value) {
+	uint64_t bits = constantBits(value);
+	uint64_t hash = (bits ^ (uint64_t) ES3_TYPE(value) << 60) * 0x9E3779B97F4A7C15ull;
+	int slot = (int) (hash >> 32) & (capacity - 1);
+	while (slots[slot] != 0) {
+		ES3Var k = c->func->consts[slots[slot] - 1];
+		if (ES3_TYPE(k) == ES3_TYPE(value) && constantBits(k) == bits) break;
+		slot = (slot + 1) & (capacity - 1);
+	}
+	return slot;
+}
+
+/**
+ * Gets the register of a constant of the current function, adding it if it isn't there yet
+ * @param c - the compiler
+ * @param value - the constant
+ * @return The register it is copied into when the function is called
+ */
+static int addConstant(ES3Compiler* c, ES3Var value) {
+	ES3Function* func = c->func;
+	if (func->constCount * 2 >= c->constSlotCapacity) {
+		int capacity = c->constSlotCapacity ? c->constSlotCapacity * 2 : 64;
+		int* slots = arenaAlloc(c->arena, sizeof(int) * capacity);
+		memset(slots, 0, sizeof(int) * capacity);
+		for (int i = 0; i < func->constCount; i++) {
+			slots[constantSlot(c, slots, capacity, func->consts[i])] = i + 1;
+		}
+		c->constSlots = slots;
+		c->constSlotCapacity = capacity;
+	}
+
+	int slot = constantSlot(c, c->constSlots, c->constSlotCapacity, value);
+	if (c->constSlots[slot] != 0) return func->constBase + c->constSlots[slot] - 1;
+
+	if (func->constCount == c->constCapacity) {
+		int capacity = c->constCapacity ? c->constCapacity * 2 : 16;
+		func->consts = arenaGrow(c->arena, func->consts, sizeof(ES3Var) * c->constCapacity, sizeof(ES3Var) * capacity);
+		c->constCapacity = capacity;
+	}
+	func->consts[func->constCount] = value;
+	c->constSlots[slot] = func->constCount + 1;
+	return func->constBase + func->constCount++;
+}
+
+/**
+ * Gives lets their registers and checks the names and calls of a node and the nodes in it
+ * @param c - the compiler
+ * @param node - any node in the function
+ * @param OUT regs - number of registers the params and lets of the function use so far
+ */
+static void numberVars(ES3Compiler* c, ES3Node* node, int* regs) {
+	if (node == NULL) return;
+
+	switch (node->type) {
+		case NODE_LET:
+			node->slot = (*regs)++;
+			if (*regs > MAX_REGISTERS) genericError(406, "Error: function \"%.*s\" needs too many registers\n", c->func->name.length, c->func->name.start);
+			break;
+
+		case NODE_VAR: {
+			ES3Var value;
+			if (node->decl == NULL && !vmFindConstant(node->token, &value)) {
+				sourceError(c->source, node->token.start, 404, "Error: \"%.*s\" isn't defined\n", node->token.length, node->token.start);
+			}
+			break;
+		}
+
+		case NODE_ASSIGN:
+			if (node->left->type == NODE_VAR && node->left->decl == NULL) {
+				sourceError(c->source, node->left->token.start, 405, "Error: \"%.*s\" can't be assigned to\n", node->left->token.length, node->left->token.start);
+			}
+			break;
+
+		case NODE_CALL: {
+			int params;
+			if (node->decl != NULL) {
+				params = node->decl->childCount;
+			} else {
+				node->slot = vmFindStd(node->token, &params);
+				if (node->slot < 0) sourceError(c->source, node->token.start, 402, "Error: function \"%.*s\" isn't defined\n", node->token.length, node->token.start);
+			}
+			if (node->childCount != params) {
+				sourceError(c->source, node->token.start, 403, "Error: \"%.*s\" takes %i args, got %i\n", node->token.length, node->token.start, params, node->childCount);
+			}
+			break;
+		}
+	}
+
+	for (int i = 0; i < node->childCount; i++) {
+		numberVars(c, node->children[i], regs);
+	}
+	numberVars(c, node->left, regs);
+	numberVars(c, node->right, regs);
+}
+
+/**
+ * Finds the slot of a string in the set of literals
+ * @param literals - the set
+ * @param capacity - number of slots, a power of 2
+ * @param str - the interned string
+ * @return The slot holding it, or the empty slot it goes in
+ */
+static int literalSlot(ES3String** literals, int capacity, const ES3String* str) {
+	int slot = (int) (str->hash & (size_t) (capacity - 1));
+	while (literals[slot] != NULL && literals[slot] != str) slot = (slot + 1) & (capacity - 1);
+	return slot;
+}
+
+/**
+ * Gets the string of a string literal, shared by every literal with the same text in the program
+ * @param c - the compiler
+ * @param text - the chars of the literal
+ * @param length - number of chars
+ * @return The string, it is never freed
+ */
+static ES3String* literalString(ES3Compiler* c, const char* text, size_t length) {
+	if (c->literalCount * 2 >= c->literalCapacity) {
+		int capacity = c->literalCapacity ? c->literalCapacity * 2 : 64;
+		ES3String** literals = arenaAlloc(c->arena, sizeof(ES3String*) * capacity);
+		memset(literals, 0, sizeof(ES3String*) * capacity);
+		for (int i = 0; i < c->literalCapacity; i++) {
+			if (c->literals[i] != NULL) literals[literalSlot(literals, capacity, c->literals[i])] = c->literals[i];
+		}
+		c->literals = literals;
+		c->literalCapacity = capacity;
+	}
+
+	// Interning gives literals with the same text the same string, so the set only has to compare pointers
+	int slot = literalSlot(c->literals, c->literalCapacity, esvStrIntern(text, length));
+	if (c->literals[slot] == NULL) {
+		esvStrLiteral(&c->literals[slot], text, length);
+		c->literalCount++;
+	}
+	return c->literals[slot];
+}
+
+/**
+ * Gives the literals and std constants of a node and the nodes in it their constant registers
+ * @param c - the compiler
+ * @param node - any node in the function
+ */
+static void numberConstants(ES3Compiler* c, ES3Node* node) {
+	if (node == NULL) return;
+
+	switch (node->type) {
+		case NODE_NUM:
+			node->slot = addConstant(c, ES3_NUM(node->num));
+			break;
+
+		case NODE_BOOL:
+			node->slot = addConstant(c, ES3_BOOL(node->op));
+			break;
+
+		case NODE_STR: {
+			size_t length;
+			char* text = unescapeString(c->arena, node->token, &length);
+			node->slot = addConstant(c, ES3_STR(literalString(c, text, length)));
+			break;
+		}
+
+		case NODE_VAR: {
+			ES3Var value;
+			if (node->decl == NULL && vmFindConstant(node->token, &value)) node->slot = addConstant(c, value);
+			break;
+		}
+	}
+
+	for (int i = 0; i < node->childCount; i++) {
+		numberConstants(c, node->children[i]);
+	}
+	numberConstants(c, node->left);
+	numberConstants(c, node->right);
+}
+
+static void compileExpr(ES3Compiler* c, const ES3Node* node, int target);
+
+/**
+ * Gets a register holding the value of an expression, vars and constants are used where they are
+ * @param c - the compiler
+ * @param node - the expression node
+ * @return The register, don't write to it
+ */
+static int compileOperand(ES3Compiler* c, const ES3Node* node) {
+	switch (node->type) {
+		case NODE_NUM:
+		case NODE_STR:
+		case NODE_BOOL:
+			return node->slot;
+
+		case NODE_VAR:
+			return node->decl != NULL ? node->decl->slot : node->slot;
+
+		default: {
+			int reg = newTemp(c);
+			compileExpr(c, node, reg);
+			return reg;
+		}
+	}
+}
+
+/**
+ * Gets the opcode of a binary operator
+ * @param op - the TOKEN_... enum of the operator
+ * @return The OP_... enum, -1 for operators that evaluate to their left side
+ */
+static int binaryOpcode(int op) {
+	switch (op) {
+		case TOKEN_ADD: return OP_ADD;
+		case TOKEN_SUB: return OP_SUB;
+		case TOKEN_MUL: return OP_MUL;
+		case TOKEN_DIV: return OP_DIV;
+		case TOKEN_EXP: return OP_POW;
+		case TOKEN_DEQ: return OP_EQ;
+		case TOKEN_GTT: return OP_GT;
+		case TOKEN_GTE: return OP_GE;
+		case TOKEN_LST: return OP_LT;
+		case TOKEN_LSE: return OP_LE;
+		default: return -1;
+	}
+}
+
+/**
+ * Compiles args or array items into consecutive temporaries
+ * @param c - the compiler
+ * @param node - node whose children are the values
+ * @return The register of the first one
+ */
+static int compileList(ES3Compiler* c, const ES3Node* node) {
+	int first = c->temps;
+	for (int i = 0; i < node->childCount; i++) {
+		int reg = newTemp(c);
+		compileExpr(c, node->children[i], reg);
+	}
+	return first;
+}
+
+/**
+ * Compiles an expression, only its last instruction writes to the target so the target can be one of its operands
+ * @param c - the compiler
+ * @param node - the expression node
+ * @param target - register to put the value in
+ */
+static void compileExpr(ES3Compiler* c, const ES3Node* node, int target) {
+	int mark = c->temps;
+
+	switch (node->type) {
+		case NODE_NUM:
+		case NODE_STR:
+		case NODE_BOOL:
+		case NODE_VAR:
+			emit(c, OP_MOVE, target, compileOperand(c, node), 0);
+			break;
+
+		case NODE_CALL: {
+			int first = compileList(c, node);
+			if (node->decl != NULL) {
+				emit(c, OP_CALL, target, node->decl->slot, first);
+			} else {
+				emit(c, OP_STD, target, node->slot, first);
+			}
+			break;
+		}
+
+		case NODE_ARRAY: {
+			int first = compileList(c, node);
+			emit(c, OP_ARRAY, target, first, node->childCount);
+			break;
+		}
+
+		case NODE_INDEX: {
+			int array = compileOperand(c, node->left);
+			int index = compileOperand(c, node->right);
+			emit(c, OP_INDEX, target, array, index);
+			break;
+		}
+
+		case NODE_NEG:
+			emit(c, node->left->valueType == TYPE_NUM ? OP_NEGN : OP_NEG, target, compileOperand(c, node->left), 0);
+			break;
+
+		case NODE_BINARY: {
+			int left = compileOperand(c, node->left);
+			int right = compileOperand(c, node->right);
+			int op = binaryOpcode(node->op);
+			if (op < 0) {
+				emit(c, OP_MOVE, target, left, 0);
+				break;
+			}
+
+			// Numbers never need the type checks
+			if (node->left->valueType == TYPE_NUM && node->right->valueType == TYPE_NUM) op += OP_ADDN - OP_ADD;
+			emit(c, op, target, left, right);
+			break;
+		}
+	}
+
+	c->temps = mark;
+}
+
+/**
+ * Compiles a jump that is taken when a condition is false
+ * @param c - the compiler
+ * @param node - the condition
+ * @return Index of the jump, for patchJump
+ */
+static int compileJumpUnless(ES3Compiler* c, const ES3Node* node) {
+	int mark = c->temps;
+	int jump;
+
+	int op = node->type == NODE_BINARY ? binaryOpcode(node->op) : -1;
+	if (op >= OP_EQ && op <= OP_LE && node->left->valueType == TYPE_NUM && node->right->valueType == TYPE_NUM) {
+		// Comparing numbers and branching on the result is one instruction
+		int left = compileOperand(c, node->left);
+		int right = compileOperand(c, node->right);
+		jump = emit(c, op + OP_JNEQN - OP_EQ, 0, left, right);
+	} else {
+		jump = emit(c, OP_JMPF, compileOperand(c, node), 0, 0);
+	}
+
+	c->temps = mark;
+	return jump;
+}
+
+static void compileStatement(ES3Compiler* c, const ES3Node* node);
+
+/**
+ * Compiles the statements of a block, releasing the vars it declares at the end
+ * @param c - the compiler
+ * @param node - the NODE_BLOCK node
+ */
+static void compileBlock(ES3Compiler* c, const ES3Node* node) {
+	int outer = c->localCount;
+	for (int i = 0; i < node->childCount; i++) {
+		compileStatement(c, node->children[i]);
+	}
+	emitReleases(c, outer);
+	c->localCount = outer;
+}
+
+/**
+ * Compiles a statement
+ * @param c - the compiler
+ * @param node - the statement node
+ */
+static void compileStatement(ES3Compiler* c, const ES3Node* node) {
+	c->temps = c->firstTemp;
+
+	switch (node->type) {
+		case NODE_LET:
+			compileExpr(c, node->left, node->slot);
+			c->varRegions[node->slot] = c->loopRegions;
+			if (isUnboxedType(node->valueType)) {
+				if (makesStrings(node->left)) emit(c, OP_COLLECT, 0, 0, 0);
+				break;
+			}
+
+			emit(c, OP_RETAIN, node->slot, 0, 0);
+			emit(c, OP_COLLECT, 0, 0, 0);
+			localsPush(c, node->slot);
+			break;
+
+		case NODE_ASSIGN:
+			if (node->left->type == NODE_INDEX) {
+				int array = compileOperand(c, node->left->left);
+				int index = compileOperand(c, node->left->right);
+				int value = compileOperand(c, node->right);
+				emit(c, OP_SETITEM, array, index, value);
+				break;
+			}
+
+			int var = node->left->decl->slot;
+			if (isUnboxedType(node->left->decl->valueType)) {
+				compileExpr(c, node->right, var);
+				if (makesStrings(node->right)) emit(c, OP_COLLECT, 0, 0, 0);
+				break;
+			}
+			emit(c, OP_SET, var, compileOperand(c, node->right), c->loopRegions - c->varRegions[var]);
+			break;
+
+		case NODE_CALLSTMT:
+			compileExpr(c, node->left, newTemp(c));
+			emit(c, OP_COLLECT, 0, 0, 0);
+			break;
+
+		case NODE_IF: {
+			int jump = compileJumpUnless(c, node->left);
+			compileBlock(c, node->right);
+			patchJump(c, jump);
+			break;
+		}
+
+		case NODE_WHILE: {
+			int top = c->func->codeCount;
+			// Arrays only made by one iteration are freed at its end, the condition is part of the iteration
+			int region = astMakesArrays(node->left) || astMakesArrays(node->right);
+			if (region) {
+				emit(c, OP_ENTER, 0, 0, 0);
+				c->loopRegions++;
+			}
+			// The condition can make strings too
+			if (makesStrings(node->left)) emit(c, OP_COLLECT, 0, 0, 0);
+			int jump = compileJumpUnless(c, node->left);
+
+			compileBlock(c, node->right);
+			if (region) emit(c, OP_LEAVE, 0, 0, 0);
+
+			// emit can move the code, so it has to run before code is read
+			int back = emit(c, OP_JMP, 0, 0, 0);
+			c->func->code[back].target = top;
+			patchJump(c, jump);
+			// The last iteration ends when its condition is false
+			if (region) {
+				emit(c, OP_LEAVE, 0, 0, 0);
+				c->loopRegions--;
+			}
+			break;
+		}
+
+		case NODE_RETURN: {
+			int value = compileOperand(c, node->left);
+			if (!c->inFunction) {
+				emit(c, OP_HALT, 0, 0, 0);
+				break;
+			}
+
+			// Keep the result alive while the vars are released, then hand it to the caller as a temporary
+			emit(c, OP_RESULT, value, c->loopRegions, 0);
+			emitReleases(c, 0);
+			emit(c, OP_RETURN, 0, 0, 0);
+			break;
+		}
+	}
+}
+
+/**
+ * Compiles a function or the main function
+ * @param c - the compiler
+ * @param func - the function to fill in, name filled in
+ * @param node - the NODE_FUNC node, NULL for main
+ * @param statements - the statements of the body
+ * @param statementCount - number of statements
+ */
+static void compileFunction(ES3Compiler* c, ES3Function* func, ES3Node* node, ES3Node** statements, int statementCount) {
+	ES3Node** params = node != NULL ? node->children : NULL;
+	int paramCount = node != NULL ? node->childCount : 0;
+	c->func = func;
+	c->inFunction = node != NULL;
+	c->localCount = 0;
+	c->loopRegions = 0;
+	c->constCapacity = 0;
+	c->constSlots = NULL;
+	c->constSlotCapacity = 0;
+
+	// Params, then lets, then constants, then temporaries
+	func->params = paramCount;
+	int regs = paramCount;
+	for (int i = 0; i < statementCount; i++) {
+		numberVars(c, statements[i], &regs);
+	}
+	func->constBase = regs;
+	func->constCount = 0;
+	func->consts = NULL;
+	int null = addConstant(c, ES3_NULL);
+	for (int i = 0; i < statementCount; i++) {
+		numberConstants(c, statements[i]);
+	}
+	func->regCount = func->constBase + func->constCount;
+	if (func->regCount > MAX_REGISTERS) genericError(406, "Error: function \"%.*s\" needs too many registers\n", func->name.length, func->name.start);
+	c->firstTemp = func->regCount;
+
+	c->varRegions = arenaAlloc(c->arena, sizeof(int) * (func->constBase + 1));
+	for (int i = 0; i < paramCount; i++) {
+		params[i]->slot = i;
+		c->varRegions[i] = 0;
+		if (isUnboxedType(params[i]->valueType)) continue;
+
+		// Params hold their args like vars do
+		emit(c, OP_RETAIN, i, 0, 0);
+		localsPush(c, i);
+	}
+
+	for (int i = 0; i < statementCount; i++) {
+		compileStatement(c, statements[i]);
+	}
+
+	if (!c->inFunction) {
+		emit(c, OP_HALT, 0, 0, 0);
+		return;
+	}
+
+	// Falling off the end of a function returns Null
+	emit(c, OP_RESULT, null, 0, 0);
+	emitReleases(c, 0);
+	emit(c, OP_RETURN, 0, 0, 0);
+}
+
+ES3Bytecode* bytecodeProgram(ES3Node* program, const ES3Source* source, ES3Arena* arena) {
+	ES3Compiler c = { .source = source, .arena = arena };
+
+	int funcCount = 0;
+	while (funcCount < program->childCount && program->children[funcCount]->type == NODE_FUNC) {
+		program->children[funcCount]->slot = funcCount;
+		funcCount++;
+	}
+
+	ES3Bytecode* bytecode = arenaAlloc(arena, sizeof(ES3Bytecode));
+	bytecode->count = funcCount + 1;
+	bytecode->main = funcCount;
+	bytecode->functions = arenaAlloc(arena, sizeof(ES3Function) * bytecode->count);
+	memset(bytecode->functions, 0, sizeof(ES3Function) * bytecode->count);
+	c.bytecode = bytecode;
+
+	for (int i = 0; i < funcCount; i++) {
+		ES3Node* node = program->children[i];
+		bytecode->functions[i].name = node->token;
+		compileFunction(&c, &bytecode->functions[i], node, node->left->children, node->left->childCount);
+	}
+
+	ES3Function* entry = &bytecode->functions[funcCount];
+	entry->name = program->token;
+	entry->name.start = "main";
+	entry->name.length = 4;
+	compileFunction(&c, entry, NULL, program->children + funcCount, program->childCount - funcCount);
+
+	return bytecode;
+}
+
+// How bytecodeDisasm prints the operands of each opcode
+#define FMT_NONE 0
+#define FMT_A 1
+#define FMT_AB 2
+#define FMT_ABC 3
+#define FMT_ABN 4
+#define FMT_AN 5
+#define FMT_J 6
+#define FMT_AJ 7
+#define FMT_BCJ 8
+#define FMT_CALL 9
+#define FMT_STD 10
+
+static const struct { const char* name; int format; } opInfo[OP_COUNT] = {
+	[OP_MOVE] = { "MOVE", FMT_AB },
+	[OP_ADD] = { "ADD", FMT_ABC },
+	[OP_SUB] = { "SUB", FMT_ABC },
+	[OP_MUL] = { "MUL", FMT_ABC },
+	[OP_DIV] = { "DIV", FMT_ABC },
+	[OP_POW] = { "POW", FMT_ABC },
+	[OP_EQ] = { "EQ", FMT_ABC },
+	[OP_GT] = { "GT", FMT_ABC },
+	[OP_GE] = { "GE", FMT_ABC },
+	[OP_LT] = { "LT", FMT_ABC },
+	[OP_LE] = { "LE", FMT_ABC },
+	[OP_NEG] = { "NEG", FMT_AB },
+	[OP_ADDN] = { "ADDN", FMT_ABC },
+	[OP_SUBN] = { "SUBN", FMT_ABC },
+	[OP_MULN] = { "MULN", FMT_ABC },
+	[OP_DIVN] = { "DIVN", FMT_ABC },
+	[OP_POWN] = { "POWN", FMT_ABC },
+	[OP_EQN] = { "EQN", FMT_ABC },
+	[OP_GTN] = { "GTN", FMT_ABC },
+	[OP_GEN] = { "GEN", FMT_ABC },
+	[OP_LTN] = { "LTN", FMT_ABC },
+	[OP_LEN] = { "LEN", FMT_ABC },
+	[OP_NEGN] = { "NEGN", FMT_AB },
+	[OP_JMP] = { "JMP", FMT_J },
+	[OP_JMPF] = { "JMPF", FMT_AJ },
+	[OP_JNEQN] = { "JNEQN", FMT_BCJ },
+	[OP_JNGTN] = { "JNGTN", FMT_BCJ },
+	[OP_JNGEN] = { "JNGEN", FMT_BCJ },
+	[OP_JNLTN] = { "JNLTN", FMT_BCJ },
+	[OP_JNLEN] = { "JNLEN", FMT_BCJ },
+	[OP_ARRAY] = { "ARRAY", FMT_ABN },
+	[OP_INDEX] = { "INDEX", FMT_ABC },
+	[OP_SETITEM] = { "SETITEM", FMT_ABC },
+	[OP_CALL] = { "CALL", FMT_CALL },
+	[OP_STD] = { "STD", FMT_STD },
+	[OP_RETAIN] = { "RETAIN", FMT_A },
+	[OP_RELEASE] = { "RELEASE", FMT_A },
+	[OP_SET] = { "SET", FMT_ABN },
+	[OP_COLLECT] = { "COLLECT", FMT_NONE },
+	[OP_ENTER] = { "ENTER", FMT_NONE },
+	[OP_LEAVE] = { "LEAVE", FMT_NONE },
+	[OP_RESULT] = { "RESULT", FMT_AN },
+	[OP_RETURN] = { "RETURN", FMT_NONE },
+	[OP_HALT] = { "HALT", FMT_NONE },
+};
+
+/**
+ * Prints a constant the way the program would print it
+ * @param file - file to print to
+ * @param value - the constant
+ */
+static void printConstant(FILE* file, ES3Var value) {
+	switch (ES3_TYPE(value)) {
+		case 1: fprintf(file, "%g", ES3_AS_NUM(value)); break;
+		case 2: fprintf(file, "\"%.*s\"", (int) ES3_AS_STR(value)->length, ES3_AS_STR(value)->text); break;
+		case 3: fprintf(file, ES3_AS_BOOL(value) ? "true" : "false"); break;
+		default: fprintf(file, "Null"); break;
+	}
+}
+
+void bytecodeDisasm(const ES3Bytecode* bytecode, FILE* file) {
+	for (int f = 0; f < bytecode->count; f++) {
+		const ES3Function* func = &bytecode->functions[f];
+		fprintf(file, "%.*s (params %i, registers %i)\n", func->name.length, func->name.start, func->params, func->regCount);
+		for (int i = 0; i < func->constCount; i++) {
+			fprintf(file, "        r%-5i = ", func->constBase + i);
+			printConstant(file, func->consts[i]);
+			fprintf(file, "\n");
+		}
+
+		for (int i = 0; i < func->codeCount; i++) {
+			const ES3Instr* instr = &func->code[i];
+			fprintf(file, "  %04i  %-8s", i, opInfo[instr->op].name);
+			switch (opInfo[instr->op].format) {
+				case FMT_A: fprintf(file, "r%i", instr->a); break;
+				case FMT_AB: fprintf(file, "r%i, r%i", instr->a, instr->b); break;
+				case FMT_ABC: fprintf(file, "r%i, r%i, r%i", instr->a, instr->b, instr->c); break;
+				case FMT_ABN: fprintf(file, "r%i, r%i, %i", instr->a, instr->b, instr->c); break;
+				case FMT_AN: fprintf(file, "r%i, %i", instr->a, instr->b); break;
+				case FMT_J: fprintf(file, "-> %04i", instr->target); break;
+				case FMT_AJ: fprintf(file, "r%i -> %04i", instr->a, instr->target); break;
+				case FMT_BCJ: fprintf(file, "r%i, r%i -> %04i", instr->b, instr->c, instr->target); break;
+				case FMT_CALL: {
+					const ES3Function* callee = &bytecode->functions[instr->b];
+					fprintf(file, "r%i, %.*s, r%i", instr->a, callee->name.length, callee->name.start, instr->c);
+					break;
+				}
+				case FMT_STD: fprintf(file, "r%i, %s, r%i", instr->a, vmStdName(instr->b), instr->c); break;
+			}
+			fprintf(file, "\n");
+		}
+		fprintf(file, "\n");
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast.h"
+
+// Opcodes, a b and c are registers unless noted
+#define OP_MOVE 0 // a = b
+#define OP_ADD 1 // a = b + c, and so on for the other operators
+#define OP_SUB 2
+#define OP_MUL 3
+#define OP_DIV 4
+#define OP_POW 5
+#define OP_EQ 6
+#define OP_GT 7
+#define OP_GE 8
+#define OP_LT 9
+#define OP_LE 10
+#define OP_NEG 11 // a = -b
+#define OP_ADDN 12 // Like OP_ADD to OP_NEG when b and c are known to be numbers
+#define OP_SUBN 13
+#define OP_MULN 14
+#define OP_DIVN 15
+#define OP_POWN 16
+#define OP_EQN 17
+#define OP_GTN 18
+#define OP_GEN 19
+#define OP_LTN 20
+#define OP_LEN 21
+#define OP_NEGN 22
+#define OP_JMP 23 // Jump to target
+#define OP_JMPF 24 // Jump to target if a isn't truthy
+#define OP_JNEQN 25 // Jump to target unless b == c, b and c are known to be numbers, and so on for the other comparisons
+#define OP_JNGTN 26
+#define OP_JNGEN 27
+#define OP_JNLTN 28
+#define OP_JNLEN 29
+#define OP_ARRAY 30 // a = array of the c registers from b
+#define OP_INDEX 31 // a = b{c}
+#define OP_SETITEM 32 // a{b} = c, then collect
+#define OP_CALL 33 // a = function b called with its args in the registers from c
+#define OP_STD 34 // a = std function b called with its args in the registers from c
+#define OP_RETAIN 35 // Retain a
+#define OP_RELEASE 36 // Release a
+#define OP_SET 37 // Assign b to var a, promoting it c regions out, then collect
+#define OP_COLLECT 38 // Run esvCollect
+#define OP_ENTER 39 // Enter a region
+#define OP_LEAVE 40 // Leave a region
+#define OP_RESULT 41 // Keep a as the result promoted out of the function, leaving it and the b loop regions in it
+#define OP_RETURN 42 // Return the result to the caller
+#define OP_HALT 43 // End the program
+
+#define OP_COUNT 44
+
+/**
+ * One instruction, target is the index of the instruction jumps go to
+ */
+typedef struct ES3Instr_ {
+    uint16_t op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+    int32_t target;
+} ES3Instr;
+
+/**
+ * A compiled function or the main function. Its registers are the params, then the lets, then the
+ * constants, then temporaries. The constants are copied into their registers when it is called
+ */
+typedef struct ES3Function_ {
+    ES3Token name;
+    int params;
+    int regCount;
+
+    ES3Var* consts;
+    int constBase;
+    int constCount;
+
+    ES3Instr* code;
+    int codeCount;
+    int codeCapacity;
+} ES3Function;
+
+typedef struct ES3Bytecode_ {
+    ES3Function* functions;
+    int count;
+
+    // Index of the main function, it is always the last one
+    int main;
+} ES3Bytecode;
+
+/**
+ * Lowers a program to register bytecode, names that don't exist and calls with the wrong number of args are errors
+ * @param program - the NODE_PROGRAM node after inferProgram and foldProgram, slots get numbered
+ * @param source - the source the program was parsed from, for errors
+ * @param arena - arena the bytecode is allocated from
+ * @return The bytecode, valid until the arena is freed
+ */
+ES3Bytecode* bytecodeProgram(ES3Node* program, const ES3Source* source, ES3Arena* arena);
+
+/**
+ * Prints the instructions and constants of every function
+ * @param bytecode - the bytecode
+ * @param file - file to print to
+ */
+void bytecodeDisasm(const ES3Bytecode* bytecode, FILE* file);
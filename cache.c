@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+#include "cache.h"
+#include "esvutil.h"
+
+// Longest path of a file in the cache, its directory and a name of up to 255 chars
+#define CACHE_PATH_SIZE (CACHE_DIR_SIZE + 257)
+
+static const uint32_t hashRounds[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * Mixes a full 64 byte block into the state of a hash
+ * @param hash - the hash
+ */
+static void hashBlock(ES3Hash* hash) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++) {
+		const unsigned char* p = hash->block + i * 4;
+		w[i] = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+	}
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = hash->state[0], b = hash->state[1], c = hash->state[2], d = hash->state[3];
+	uint32_t e = hash->state[4], f = hash->state[5], g = hash->state[6], h = hash->state[7];
+	for (int i = 0; i < 64; i++) {
+		uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + hashRounds[i] + w[i];
+		uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	hash->state[0] += a; hash->state[1] += b; hash->state[2] += c; hash->state[3] += d;
+	hash->state[4] += e; hash->state[5] += f; hash->state[6] += g; hash->state[7] += h;
+}
+
+void hashInit(ES3Hash* hash) {
+	static const uint32_t initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	memcpy(hash->state, initial, sizeof(initial));
+	hash->length = 0;
+	hash->used = 0;
+}
+
+void hashUpdate(ES3Hash* hash, const void* data, size_t length) {
+	const unsigned char* bytes = data;
+	hash->length += length;
+	while (length > 0) {
+		size_t n = 64 - hash->used;
+		if (n > length) n = length;
+		memcpy(hash->block + hash->used, bytes, n);
+		hash->used += n;
+		bytes += n;
+		length -= n;
+		if (hash->used == 64) {
+			hashBlock(hash);
+			hash->used = 0;
+		}
+	}
+}
+
+void hashString(ES3Hash* hash, const char* text) {
+	hashUpdate(hash, text, strlen(text) + 1);
+}
+
+void hashFile(ES3Hash* hash, const char* path) {
+	hashString(hash, path);
+
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		hashString(hash, "<missing>");
+		return;
+	}
+
+	char buffer[65536];
+	size_t n;
+	uint64_t length = 0;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		hashUpdate(hash, buffer, n);
+		length += n;
+	}
+	fclose(file);
+
+	// Its length ends it, so the next thing fed in can't look like more of it
+	hashUpdate(hash, &length, sizeof(length));
+}
+
+void hashFinish(ES3Hash* hash, char hex[65]) {
+	uint64_t bits = hash->length * 8;
+	unsigned char pad = 0x80;
+	hashUpdate(hash, &pad, 1);
+	pad = 0;
+	while (hash->used != 56) hashUpdate(hash, &pad, 1);
+
+	unsigned char length[8];
+	for (int i = 0; i < 8; i++) {
+		length[i] = (unsigned char) (bits >> (56 - i * 8));
+	}
+	hashUpdate(hash, length, 8);
+
+	for (int i = 0; i < 32; i++) {
+		sprintf(hex + i * 2, "%02x", (hash->state[i / 4] >> (24 - (i % 4) * 8)) & 0xFF);
+	}
+}
+
+/**
+ * Creates a directory and the directories it is in
+ * @param path - path of the directory
+ * @return 0 if it exists afterwards, otherwise nonzero
+ */
+static int makeDirs(const char* path) {
+	char partial[CACHE_DIR_SIZE];
+	size_t length = strlen(path);
+	if (length >= sizeof(partial)) return 1;
+
+	for (size_t i = 1; i <= length; i++) {
+		if (i < length && path[i] != '/' && path[i] != '\\') continue;
+		memcpy(partial, path, i);
+		partial[i] = '\0';
+#ifdef _WIN32
+		_mkdir(partial);
+#else
+		mkdir(partial, 0755);
+#endif
+	}
+
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat info;
+	return stat(path, &info) != 0 || !S_ISDIR(info.st_mode);
+#endif
+}
+
+/**
+ * Copies a file
+ * @param from - path of the file
+ * @param to - path of the copy, replaced if it exists
+ * @param OUT size - if present, set to the number of bytes copied
+ * @return 0 on success, otherwise nonzero
+ */
+static int copyFile(const char* from, const char* to, unsigned long long* size) {
+	FILE* in = fopen(from, "rb");
+	if (in == NULL) return 1;
+	FILE* out = fopen(to, "wb");
+	if (out == NULL) {
+		fclose(in);
+		return 1;
+	}
+
+	char buffer[65536];
+	size_t n;
+	int failed = 0;
+	unsigned long long copied = 0;
+	while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+		if (fwrite(buffer, 1, n, out) != n) failed = 1;
+		copied += n;
+	}
+	if (size != NULL) *size = copied;
+	if (ferror(in)) failed = 1;
+	fclose(in);
+	if (fclose(out) != 0) failed = 1;
+
+#ifndef _WIN32
+	chmod(to, 0755);
+#endif
+	return failed;
+}
+
+/**
+ * Gets the path of the cached executable of a key
+ * @param cache - the cache
+ * @param key - digest from hashFinish
+ * @param suffix - appended to the key
+ * @param OUT path - the path
+ */
+static void cachePath(const ES3Cache* cache, const char* key, const char* suffix, char path[CACHE_PATH_SIZE]) {
+	snprintf(path, CACHE_PATH_SIZE, "%s/%s%s", cache->dir, key, suffix);
+}
+
+int cacheOpen(ES3Cache* cache) {
+	const char* dir = getenv("ES3_CACHE_DIR");
+	if (dir != NULL && *dir != '\0') {
+		snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+	} else {
+#ifdef _WIN32
+		const char* base = getenv("LOCALAPPDATA");
+		if (base == NULL) return 1;
+		snprintf(cache->dir, sizeof(cache->dir), "%s\\es3", base);
+#else
+		const char* base = getenv("XDG_CACHE_HOME");
+		if (base != NULL && *base != '\0') {
+			snprintf(cache->dir, sizeof(cache->dir), "%s/es3", base);
+		} else {
+			base = getenv("HOME");
+			if (base == NULL) return 1;
+			snprintf(cache->dir, sizeof(cache->dir), "%s/.cache/es3", base);
+		}
+#endif
+	}
+
+	if (makeDirs(cache->dir) != 0) return 1;
+
+	// The same source built by another gcc is another program
+	ES3Hash hash;
+	hashInit(&hash);
+#ifdef _WIN32
+	FILE* gcc = _popen("gcc --version", "r");
+#else
+	FILE* gcc = popen("gcc --version", "r");
+#endif
+	if (gcc != NULL) {
+		char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), gcc)) > 0) hashUpdate(&hash, buffer, n);
+#ifdef _WIN32
+		_pclose(gcc);
+#else
+		pclose(gcc);
+#endif
+	} else {
+		hashString(&hash, "<no gcc>");
+	}
+	hashFinish(&hash, cache->compiler);
+	return 0;
+}
+
+int cacheFetch(const ES3Cache* cache, const char* key, const char* path) {
+	char cached[CACHE_PATH_SIZE];
+	cachePath(cache, key, ".exe", cached);
+	if (copyFile(cached, path, NULL) != 0) return 0;
+
+	// Its modification time is when it was last used
+#ifdef _WIN32
+	HANDLE file = CreateFileA(cached, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		SetFileTime(file, NULL, NULL, &now);
+		CloseHandle(file);
+	}
+#else
+	utime(cached, NULL);
+#endif
+	return 1;
+}
+
+typedef struct ES3CacheEntry_ {
+    char name[256];
+    unsigned long long size;
+    long long used;
+} ES3CacheEntry;
+
+static int compareEntries(const void* a, const void* b) {
+	long long x = ((const ES3CacheEntry*) a)->used;
+	long long y = ((const ES3CacheEntry*) b)->used;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Removes the least recently used executables until the cache is well under CACHE_MAX_SIZE
+ * Only called with the size file locked, but fetches can still remove a file from under it, which is fine
+ * @param cache - the cache
+ * @return Total size of the executables left
+ */
+static unsigned long long cacheEvict(const ES3Cache* cache) {
+	ES3CacheEntry* entries = NULL;
+	int count = 0;
+	int capacity = 0;
+	unsigned long long total = 0;
+
+#ifdef _WIN32
+	char pattern[CACHE_PATH_SIZE];
+	snprintf(pattern, sizeof(pattern), "%s\\*.exe", cache->dir);
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA(pattern, &found);
+	if (search == INVALID_HANDLE_VALUE) return 0;
+	do {
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			entries = srealloc(entries, sizeof(ES3CacheEntry) * capacity);
+		}
+		ES3CacheEntry* entry = &entries[count++];
+		snprintf(entry->name, sizeof(entry->name), "%s", found.cFileName);
+		entry->size = (unsigned long long) found.nFileSizeHigh << 32 | found.nFileSizeLow;
+		entry->used = (long long) found.ftLastWriteTime.dwHighDateTime << 32 | found.ftLastWriteTime.dwLowDateTime;
+		total += entry->size;
+	} while (FindNextFileA(search, &found));
+	FindClose(search);
+#else
+	DIR* dir = opendir(cache->dir);
+	if (dir == NULL) return 0;
+	struct dirent* found;
+	while ((found = readdir(dir)) != NULL) {
+		size_t length = strlen(found->d_name);
+		if (length < 4 || length >= 256 || strcmp(found->d_name + length - 4, ".exe") != 0) continue;
+
+		char path[CACHE_PATH_SIZE];
+		struct stat info;
+		snprintf(path, sizeof(path), "%s/%s", cache->dir, found->d_name);
+		if (stat(path, &info) != 0) continue;
+
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			entries = srealloc(entries, sizeof(ES3CacheEntry) * capacity);
+		}
+		ES3CacheEntry* entry = &entries[count++];
+		memcpy(entry->name, found->d_name, length + 1);
+		entry->size = (unsigned long long) info.st_size;
+		entry->used = (long long) info.st_mtime;
+		total += entry->size;
+	}
+	closedir(dir);
+#endif
+
+	if (total > CACHE_MAX_SIZE) {
+		// Down to 3/4 so the next few stores don't evict again
+		qsort(entries, count, sizeof(ES3CacheEntry), compareEntries);
+		for (int i = 0; i < count && total > CACHE_MAX_SIZE / 4 * 3; i++) {
+			char path[CACHE_PATH_SIZE];
+			snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+			remove(path);
+			total -= entries[i].size;
+		}
+	}
+	free(entries);
+	return total;
+}
+
+#ifdef _WIN32
+typedef HANDLE ES3CacheLock;
+#else
+typedef int ES3CacheLock;
+#endif
+
+/**
+ * Opens the file holding the total size of the cache and locks it, other threads and processes storing wait until
+ * it is unlocked
+ * @param cache - the cache
+ * @param OUT lock - the open file
+ * @return 0 on success, nonzero if it can't be opened or locked
+ */
+static int cacheLock(const ES3Cache* cache, ES3CacheLock* lock) {
+	char path[CACHE_PATH_SIZE];
+	cachePath(cache, "size", "", path);
+#ifdef _WIN32
+	*lock = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, 0, NULL);
+	if (*lock == INVALID_HANDLE_VALUE) return 1;
+	OVERLAPPED whole = { 0 };
+	if (LockFileEx(*lock, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole)) return 0;
+	CloseHandle(*lock);
+	return 1;
+#else
+	*lock = open(path, O_RDWR | O_CREAT, 0644);
+	if (*lock < 0) return 1;
+	if (flock(*lock, LOCK_EX) == 0) return 0;
+	close(*lock);
+	return 1;
+#endif
+}
+
+/**
+ * Unlocks and closes the size file
+ * @param lock - the file from cacheLock
+ */
+static void cacheUnlock(ES3CacheLock lock) {
+#ifdef _WIN32
+	OVERLAPPED whole = { 0 };
+	UnlockFileEx(lock, 0, MAXDWORD, MAXDWORD, &whole);
+	CloseHandle(lock);
+#else
+	flock(lock, LOCK_UN);
+	close(lock);
+#endif
+}
+
+/**
+ * Reads the total size of the cache from the locked size file
+ * @param lock - the file from cacheLock
+ * @param OUT total - the total
+ * @return 0 on success, nonzero if the file is new or doesn't hold a number
+ */
+static int cacheReadTotal(ES3CacheLock lock, unsigned long long* total) {
+	char text[32];
+#ifdef _WIN32
+	DWORD length = 0;
+	SetFilePointer(lock, 0, NULL, FILE_BEGIN);
+	if (!ReadFile(lock, text, sizeof(text) - 1, &length, NULL)) return 1;
+#else
+	ssize_t length = pread(lock, text, sizeof(text) - 1, 0);
+	if (length < 0) return 1;
+#endif
+	text[length] = '\0';
+
+	char* end;
+	*total = strtoull(text, &end, 10);
+	return end == text;
+}
+
+/**
+ * Replaces the total size of the cache in the locked size file
+ * @param lock - the file from cacheLock
+ * @param total - the total
+ */
+static void cacheWriteTotal(ES3CacheLock lock, unsigned long long total) {
+	char text[32];
+	int length = snprintf(text, sizeof(text), "%llu\n", total);
+#ifdef _WIN32
+	DWORD written;
+	SetFilePointer(lock, 0, NULL, FILE_BEGIN);
+	WriteFile(lock, text, length, &written, NULL);
+	SetEndOfFile(lock);
+#else
+	if (ftruncate(lock, 0) == 0 && pwrite(lock, text, length, 0) != length) ftruncate(lock, 0);
+#endif
+}
+
+// Stores made by this process so far
+static atomic_int storeCount;
+
+void cacheStore(const ES3Cache* cache, const char* key, const char* path) {
+	char temporary[CACHE_PATH_SIZE];
+	char cached[CACHE_PATH_SIZE];
+	char suffix[64];
+	// Unique to this store, other processes and threads of a batch can be storing the same program
+	int store = atomic_fetch_add(&storeCount, 1);
+#ifdef _WIN32
+	snprintf(suffix, sizeof(suffix), ".%d.%d.tmp", _getpid(), store);
+#else
+	snprintf(suffix, sizeof(suffix), ".%d.%d.tmp", (int) getpid(), store);
+#endif
+	cachePath(cache, key, suffix, temporary);
+	cachePath(cache, key, ".exe", cached);
+
+	unsigned long long size;
+	if (copyFile(path, temporary, &size) != 0) {
+		remove(temporary);
+		return;
+	}
+#ifdef _WIN32
+	if (!MoveFileExA(temporary, cached, MOVEFILE_REPLACE_EXISTING)) remove(temporary);
+#else
+	if (rename(temporary, cached) != 0) remove(temporary);
+#endif
+
+	// Without the size file every store has to list the directory
+	ES3CacheLock lock;
+	if (cacheLock(cache, &lock) != 0) {
+		cacheEvict(cache);
+		return;
+	}
+
+	// The total only ever errs high, a store replacing a program counts it twice. So the directory is listed, and the
+	// total worked out again, when it says the cache is over the limit or the size file is new
+	unsigned long long total;
+	if (cacheReadTotal(lock, &total) != 0 || total + size > CACHE_MAX_SIZE) total = cacheEvict(cache);
+	else total += size;
+	cacheWriteTotal(lock, total);
+	cacheUnlock(lock);
+}
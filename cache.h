@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped whenever the generated code changes, the build time of es3 is part of every key too
+#define ES3_VERSION "3.1"
+
+// Once the cached executables add up to more than this the least recently used ones are removed
+#define CACHE_MAX_SIZE (256ull * 1024 * 1024)
+// Longest path of the cache directory
+#define CACHE_DIR_SIZE 1024
+
+/**
+ * Directory of compiled programs, named by the SHA-256 of everything that went into building them
+ * ES3_CACHE_DIR overrides where it is, by default it is es3 under the user's cache directory
+ *  - compiler: digest of what gcc --version prints, part of every key so a program built by another gcc isn't reused
+ */
+typedef struct ES3Cache_ {
+    char dir[CACHE_DIR_SIZE];
+    char compiler[65];
+} ES3Cache;
+
+/**
+ * SHA-256 of data fed in pieces
+ */
+typedef struct ES3Hash_ {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} ES3Hash;
+
+/**
+ * Starts a hash
+ * @param hash - OUT the hash to initialize
+ */
+void hashInit(ES3Hash* hash);
+
+/**
+ * Feeds bytes into a hash
+ * @param hash - the hash
+ * @param data - the bytes
+ * @param length - number of bytes
+ */
+void hashUpdate(ES3Hash* hash, const void* data, size_t length);
+
+/**
+ * Feeds a string into a hash, including its NUL so consecutive strings can't run into each other
+ * @param hash - the hash
+ * @param text - the string
+ */
+void hashString(ES3Hash* hash, const char* text);
+
+/**
+ * Feeds the contents of a file into a hash, a file that can't be read is fed in as a marker
+ * @param hash - the hash
+ * @param path - path of the file
+ */
+void hashFile(ES3Hash* hash, const char* path);
+
+/**
+ * Finishes a hash
+ * @param hash - the hash, can't be fed afterwards
+ * @param OUT hex - the digest as 64 lowercase hex digits and a NUL
+ */
+void hashFinish(ES3Hash* hash, char hex[65]);
+
+/**
+ * Finds the cache directory and creates it if it doesn't exist, and runs gcc --version for the compiler digest
+ * @param cache - OUT the cache
+ * @return 0 on success, nonzero if there is no usable cache directory
+ */
+int cacheOpen(ES3Cache* cache);
+
+/**
+ * Copies a cached executable out of the cache and marks it as used
+ * @param cache - the cache
+ * @param key - digest from hashFinish
+ * @param path - where to put the executable
+ * @return 1 if it was cached, otherwise 0
+ */
+int cacheFetch(const ES3Cache* cache, const char* key, const char* path);
+
+/**
+ * Adds an executable to the cache, then removes the least recently used ones if it got too big
+ * Other processes only ever see complete files, it is written under a temporary name and renamed. The total size of
+ * the cache is kept in a file next to the executables, so the directory is only listed when it goes over the limit
+ * @param cache - the cache
+ * @param key - digest from hashFinish
+ * @param path - the executable
+ */
+void cacheStore(const ES3Cache* cache, const char* key, const char* path);
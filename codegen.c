@@ -0,0 +1,888 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codegen.h"
+#include "enums.h"
+
+/**
+ * Appends the text of a token
+ * @param out - buffer to append to
+ * @param token - the token
+ */
+static void emitToken(ES3StrBuf* out, ES3Token token) {
+	strbufAppendN(out, token.start, token.length);
+}
+
+/**
+ * Appends the C name of a var, function or param
+ * @param out - buffer to append to
+ * @param token - the name token
+ */
+static void emitName(ES3StrBuf* out, ES3Token token) {
+	emitToken(out, token);
+	strbufAppend(out, "__raw");
+}
+
+/**
+ * Gets the runtime function and op code of a binary operator
+ * @param op - the TOKEN_... enum of the operator
+ * @param OUT code - the op argument the runtime function expects
+ * @return Name of the runtime function
+ */
+static const char* binaryFunction(int op, const char** code) {
+	switch (op) {
+		case TOKEN_ADD: *code = "1"; return "esvExpr";
+		case TOKEN_SUB: *code = "2"; return "esvExpr";
+		case TOKEN_MUL: *code = "1"; return "esvTerm";
+		case TOKEN_DIV: *code = "2"; return "esvTerm";
+		case TOKEN_EXP: *code = "1"; return "esvExpo";
+		case TOKEN_DEQ: *code = "1"; return "esvComp";
+		case TOKEN_GTT: *code = "2"; return "esvComp";
+		case TOKEN_GTE: *code = "3"; return "esvComp";
+		case TOKEN_LST: *code = "4"; return "esvComp";
+		case TOKEN_LSE: *code = "5"; return "esvComp";
+		default: *code = "0"; return "esvExpr";
+	}
+}
+
+/**
+ * Gets the C operator of a binary operator on unboxed values
+ * @param op - the TOKEN_... enum of the operator, not TOKEN_EXP
+ * @return The C operator
+ */
+static const char* nativeOperator(int op) {
+	switch (op) {
+		case TOKEN_ADD: return " + ";
+		case TOKEN_SUB: return " - ";
+		case TOKEN_MUL: return " * ";
+		case TOKEN_DIV: return " / ";
+		case TOKEN_DEQ: return " == ";
+		case TOKEN_GTT: return " > ";
+		case TOKEN_GTE: return " >= ";
+		case TOKEN_LST: return " < ";
+		case TOKEN_LSE: return " <= ";
+		default: return " , ";
+	}
+}
+
+/**
+ * Gets the C type a var or param is declared with
+ * @param valueType - the TYPE_... enum of the var
+ * @return double for numbers, int for bools, otherwise ES3Var
+ */
+static const char* declType(int valueType) {
+	switch (valueType) {
+		case TYPE_NUM: return "double ";
+		case TYPE_BOOL: return "int ";
+		default: return "ES3Var ";
+	}
+}
+
+/**
+ * Checks if vars of a type are stored as a double or int instead of an ES3Var
+ * @param valueType - the TYPE_... enum of the var
+ * @return 1 if they are, otherwise 0
+ */
+static int isUnboxedType(int valueType) {
+	return valueType == TYPE_NUM || valueType == TYPE_BOOL;
+}
+
+/**
+ * Checks if the C expression of a node evaluates to a double or int instead of an ES3Var
+ * @param node - the expression node
+ * @return 1 if it does, otherwise 0
+ */
+static int isUnboxed(const ES3Node* node) {
+	if (!isUnboxedType(node->valueType)) return 0;
+	if (node->type == NODE_VAR) return node->decl != NULL;
+	return node->type == NODE_NEG || node->type == NODE_BINARY;
+}
+
+/**
+ * Appends the value of a number literal
+ * @param out - buffer to append to
+ * @param node - the NODE_NUM node
+ */
+static void emitNumber(ES3StrBuf* out, const ES3Node* node) {
+	char num[32];
+	const char* text = num;
+	size_t length;
+	if (node->token.length) {
+		text = node->token.start;
+		length = node->token.length;
+	} else {
+		// Folded numbers have no source text, 17 digits is enough to get the same double back
+		length = snprintf(num, sizeof(num), "%.17g", node->num);
+	}
+	strbufAppendN(out, text, length);
+
+	// Whole numbers would be int literals in C, and 1 / 2 has to stay a double division when unboxed
+	if (!memchr(text, '.', length) && !memchr(text, 'e', length)) strbufAppend(out, ".0");
+}
+
+/**
+ * Appends the C expression for a node of TYPE_NUM or TYPE_BOOL, it evaluates to a double or an int
+ * @param node - the expression node
+ * @param out - buffer to append to
+ */
+static void emitUnboxed(const ES3Node* node, ES3StrBuf* out) {
+	switch (node->type) {
+		case NODE_NUM:
+			emitNumber(out, node);
+			break;
+
+		case NODE_BOOL:
+			strbufAppend(out, node->op ? "1" : "0");
+			break;
+
+		case NODE_VAR:
+			// Vars without a declaration are the std constants, which are ES3Var macros
+			if (node->decl == NULL) {
+				strbufAppend(out, "ES3_AS_NUM(");
+				emitName(out, node->token);
+				strbufAppend(out, ")");
+			} else {
+				emitName(out, node->token);
+			}
+			break;
+
+		case NODE_NEG:
+			strbufAppend(out, "(-");
+			emitUnboxed(node->left, out);
+			strbufAppend(out, ")");
+			break;
+
+		case NODE_BINARY:
+			strbufAppend(out, node->op == TOKEN_EXP ? "pow(" : "(");
+			emitUnboxed(node->left, out);
+			strbufAppend(out, node->op == TOKEN_EXP ? ", " : nativeOperator(node->op));
+			emitUnboxed(node->right, out);
+			strbufAppend(out, ")");
+			break;
+	}
+}
+
+static void emitExpr(const ES3Node* node, ES3StrBuf* out);
+
+/**
+ * Appends the name of a temporary
+ * @param out - buffer to append to
+ * @param temp - its number
+ */
+static void emitTempName(ES3StrBuf* out, int temp) {
+	char name[24];
+	snprintf(name, sizeof(name), "esvTemp%i", temp);
+	strbufAppend(out, name);
+}
+
+/**
+ * Appends an operand, or the temporary it was already evaluated into
+ * @param node - the operand
+ * @param out - buffer to append to
+ */
+static void emitOperand(const ES3Node* node, ES3StrBuf* out) {
+	if (node->temp) emitTempName(out, node->temp);
+	else emitExpr(node, out);
+}
+
+/**
+ * Appends "(" and assignments of the operands of a node that go into temporaries, each followed by a comma
+ * C doesn't order the args of a call, the items of an initializer or the operands of a runtime operator, so those
+ * with effects are evaluated first in the order the VM evaluates them
+ * @param node - a call, array, binary or index node
+ * @param out - buffer to append to
+ * @return 1 if there were any, then the caller closes the bracket after the expression
+ */
+static int emitTemps(const ES3Node* node, ES3StrBuf* out) {
+	int count = node->type == NODE_CALL || node->type == NODE_ARRAY ? node->childCount : 2;
+	int any = 0;
+	for (int i = 0; i < count; i++) {
+		const ES3Node* operand = node->type == NODE_CALL || node->type == NODE_ARRAY ? node->children[i] : i ? node->right : node->left;
+		if (!operand->temp) continue;
+
+		if (!any) strbufAppend(out, "(");
+		emitTempName(out, operand->temp);
+		strbufAppend(out, " = ");
+		emitExpr(operand, out);
+		strbufAppend(out, ", ");
+		any = 1;
+	}
+	return any;
+}
+
+/**
+ * Appends a comma separated list of the children of a node
+ * @param node - node whose children are expressions
+ * @param out - buffer to append to
+ */
+static void emitArgs(const ES3Node* node, ES3StrBuf* out) {
+	for (int i = 0; i < node->childCount; i++) {
+		if (i > 0) strbufAppend(out, ", ");
+
+		// Unboxed params take the unboxed value
+		const ES3Node* func = node->type == NODE_CALL ? node->decl : NULL;
+		if (func && i < func->childCount && isUnboxedType(func->children[i]->valueType)) {
+			emitUnboxed(node->children[i], out);
+		} else {
+			emitOperand(node->children[i], out);
+		}
+	}
+}
+
+/**
+ * Appends the C lvalue of the array item an index node refers to
+ * @param node - the NODE_INDEX node
+ * @param array - name of a C var holding the array to use instead of emitting node->left, can be NULL
+ * @param out - buffer to append to
+ */
+static void emitItem(const ES3Node* node, const char* array, ES3StrBuf* out) {
+	const ES3Node* index = node->right;
+	int sequenced = array == NULL && emitTemps(node, out);
+
+	// Arrays never change length, so a whole number below the least length the array can have is always in range
+	if (node->left->valueType == TYPE_ARR && index->type == NODE_NUM && index->num >= 0 && index->num < node->left->length && index->num == (int) index->num) {
+		char items[32];
+		snprintf(items, sizeof(items), ")->items[%i]", (int) index->num);
+
+		strbufAppend(out, "ES3_AS_ARR(");
+		if (array) strbufAppend(out, array); else emitOperand(node->left, out);
+		strbufAppend(out, items);
+		if (sequenced) strbufAppend(out, ")");
+		return;
+	}
+
+	if (isUnboxedType(index->valueType) || index->type == NODE_NUM) {
+		strbufAppend(out, "(*esvIndex(");
+		if (array) strbufAppend(out, array); else emitOperand(node->left, out);
+		strbufAppend(out, ", ");
+		emitUnboxed(index, out);
+	} else {
+		strbufAppend(out, "(*esvIndexVar(");
+		if (array) strbufAppend(out, array); else emitOperand(node->left, out);
+		strbufAppend(out, ", ");
+		emitOperand(index, out);
+	}
+	strbufAppend(out, sequenced ? ")))" : "))");
+}
+
+/**
+ * Appends the C expression for an expression node, it evaluates to an ES3Var
+ * @param node - the expression node
+ * @param out - buffer to append to
+ */
+static void emitExpr(const ES3Node* node, ES3StrBuf* out) {
+	if (isUnboxed(node)) {
+		strbufAppend(out, node->valueType == TYPE_NUM ? "ES3_NUM(" : "ES3_BOOL(");
+		emitUnboxed(node, out);
+		strbufAppend(out, ")");
+		return;
+	}
+
+	switch (node->type) {
+		case NODE_NUM:
+			strbufAppend(out, "ES3_NUM(");
+			emitNumber(out, node);
+			strbufAppend(out, ")");
+			break;
+
+		case NODE_STR: {
+			char literal[48];
+			snprintf(literal, sizeof(literal), "ES3_STR(esvStrLiteral(&esvLiterals[%i], ", node->op);
+			strbufAppend(out, literal);
+			emitToken(out, node->token);
+			strbufAppend(out, ", sizeof(");
+			emitToken(out, node->token);
+			strbufAppend(out, ") - 1))");
+			break;
+		}
+
+		case NODE_BOOL:
+			strbufAppend(out, node->op ? "ES3_BOOL(1)" : "ES3_BOOL(0)");
+			break;
+
+		case NODE_VAR:
+			emitName(out, node->token);
+			break;
+
+		case NODE_CALL: {
+			int sequenced = emitTemps(node, out);
+			emitName(out, node->token);
+			strbufAppend(out, "(");
+			emitArgs(node, out);
+			strbufAppend(out, sequenced ? "))" : ")");
+			break;
+		}
+
+		case NODE_ARRAY: {
+			if (node->childCount == 0) {
+				strbufAppend(out, "esvArrayNew(0, NULL)");
+				break;
+			}
+			int sequenced = emitTemps(node, out);
+			strbufAppend(out, "esvArrayNew(");
+			char length[24];
+			snprintf(length, sizeof(length), "%i", node->childCount);
+			strbufAppend(out, length);
+			strbufAppend(out, ", (ES3Var[]) { ");
+			emitArgs(node, out);
+			strbufAppend(out, sequenced ? " }))" : " })");
+			break;
+		}
+
+		case NODE_INDEX:
+			emitItem(node, NULL, out);
+			break;
+
+		case NODE_NEG:
+			strbufAppend(out, "esvUnary(");
+			emitExpr(node->left, out);
+			strbufAppend(out, ")");
+			break;
+
+		case NODE_BINARY: {
+			int sequenced = emitTemps(node, out);
+			const char* code;
+			strbufAppend(out, binaryFunction(node->op, &code));
+			strbufAppend(out, "(");
+			emitOperand(node->left, out);
+			strbufAppend(out, ", ");
+			strbufAppend(out, code);
+			strbufAppend(out, ", ");
+			emitOperand(node->right, out);
+			strbufAppend(out, sequenced ? "))" : ")");
+			break;
+		}
+	}
+}
+
+/**
+ * Appends a C condition that is true when an expression is truthy
+ * @param node - the expression node
+ * @param out - buffer to append to
+ */
+static void emitCondition(const ES3Node* node, ES3StrBuf* out) {
+	switch (node->valueType) {
+		case TYPE_NUM:
+			emitUnboxed(node, out);
+			strbufAppend(out, " != 0");
+			break;
+
+		case TYPE_BOOL:
+			emitUnboxed(node, out);
+			break;
+
+		default:
+			strbufAppend(out, "esvTruthy(");
+			emitExpr(node, out);
+			strbufAppend(out, ")");
+			break;
+	}
+}
+
+/**
+ * Boxed vars and params in scope while emitting a function or main, they hold references to strings
+ * region counts the loops around the current statement that have a region per iteration, varRegions is what it was at each var
+ */
+typedef struct ES3Locals_ {
+    const ES3Node** vars;
+    int* varRegions;
+    int count;
+    int capacity;
+
+    int region;
+    int inFunction;
+    ES3Arena* arena;
+} ES3Locals;
+
+/**
+ * Adds a var or param to the innermost scope if it is boxed
+ * @param locals - the vars in scope
+ * @param decl - the NODE_LET or param node
+ */
+static void localsPush(ES3Locals* locals, const ES3Node* decl) {
+	if (isUnboxedType(decl->valueType)) return;
+
+	if (locals->count == locals->capacity) {
+		int capacity = locals->capacity ? locals->capacity * 2 : 16;
+		locals->vars = arenaGrow(locals->arena, locals->vars, sizeof(const ES3Node*) * locals->capacity, sizeof(const ES3Node*) * capacity);
+		locals->varRegions = arenaGrow(locals->arena, locals->varRegions, sizeof(int) * locals->capacity, sizeof(int) * capacity);
+		locals->capacity = capacity;
+	}
+	locals->varRegions[locals->count] = locals->region;
+	locals->vars[locals->count++] = decl;
+}
+
+/**
+ * Appends an expression, promoting arrays it makes out of the regions the value escapes
+ * @param node - the expression node
+ * @param regions - number of regions between the current one and the one the value is stored in
+ * @param out - buffer to append to
+ */
+static void emitEscaping(const ES3Node* node, int regions, ES3StrBuf* out) {
+	if (regions == 0 || (node->valueType != TYPE_ARR && node->valueType != TYPE_UNKNOWN)) {
+		emitExpr(node, out);
+		return;
+	}
+
+	char region[32];
+	snprintf(region, sizeof(region), ", esvDepth - %i)", regions);
+	strbufAppend(out, "esvPromote(");
+	emitExpr(node, out);
+	strbufAppend(out, region);
+}
+
+/**
+ * Finds how many regions were entered since a var was declared
+ * @param locals - the vars in scope
+ * @param decl - the NODE_LET or param node
+ * @return The number of regions, 0 for unboxed vars as they never hold arrays
+ */
+static int regionsSince(const ES3Locals* locals, const ES3Node* decl) {
+	for (int i = locals->count - 1; i >= 0; i--) {
+		if (locals->vars[i] == decl) return locals->region - locals->varRegions[i];
+	}
+	return 0;
+}
+
+/**
+ * Appends releases of the vars in scope from a position in the scope stack up
+ * @param locals - the vars in scope
+ * @param from - index of the first var to release
+ * @param out - buffer to append to
+ */
+static void emitReleases(const ES3Locals* locals, int from, ES3StrBuf* out) {
+	for (int i = from; i < locals->count; i++) {
+		strbufAppend(out, "esvRelease(");
+		emitName(out, locals->vars[i]->token);
+		strbufAppend(out, ");\n");
+	}
+}
+
+static void emitStatement(const ES3Node* node, ES3Locals* locals, ES3StrBuf* out);
+
+/**
+ * Checks if an expression reads a var, a let that reads itself sees Null like it does on the VM
+ * @param node - the expression node
+ * @param decl - the NODE_LET node
+ * @return 1 if it does, otherwise 0
+ */
+static int readsVar(const ES3Node* node, const ES3Node* decl) {
+	if (node == NULL) return 0;
+	if (node->type == NODE_VAR) return node->decl == decl;
+
+	for (int i = 0; i < node->childCount; i++) {
+		if (readsVar(node->children[i], decl)) return 1;
+	}
+	return readsVar(node->left, decl) || readsVar(node->right, decl);
+}
+
+/**
+ * Appends a code block and its statements, releasing the vars it declares at the end
+ * @param node - the NODE_BLOCK node
+ * @param locals - the vars in scope
+ * @param out - buffer to append to
+ */
+static void emitBlock(const ES3Node* node, ES3Locals* locals, ES3StrBuf* out) {
+	int outer = locals->count;
+
+	strbufAppend(out, "{\n");
+	for (int i = 0; i < node->childCount; i++) {
+		emitStatement(node->children[i], locals, out);
+	}
+	emitReleases(locals, outer, out);
+	strbufAppend(out, "}\n");
+
+	locals->count = outer;
+}
+
+/**
+ * Appends the C code for a statement node
+ * @param node - the statement node
+ * @param locals - the vars in scope
+ * @param out - buffer to append to
+ */
+static void emitStatement(const ES3Node* node, ES3Locals* locals, ES3StrBuf* out) {
+	switch (node->type) {
+		case NODE_LET:
+			strbufAppend(out, declType(node->valueType));
+			emitName(out, node->token);
+			if (isUnboxedType(node->valueType)) {
+				strbufAppend(out, " = ");
+				emitUnboxed(node->left, out);
+				strbufAppend(out, ";\n");
+				break;
+			}
+			if (readsVar(node->left, node)) {
+				strbufAppend(out, " = ES3_NULL;\n");
+				emitName(out, node->token);
+			}
+			strbufAppend(out, " = esvRetain(");
+			emitExpr(node->left, out);
+			strbufAppend(out, ");\nesvCollect();\n");
+			localsPush(locals, node);
+			break;
+
+		case NODE_ASSIGN:
+			if (isUnboxed(node->left)) {
+				emitName(out, node->left->token);
+				strbufAppend(out, " = ");
+				emitUnboxed(node->right, out);
+				strbufAppend(out, ";\n");
+				break;
+			}
+			if (node->left->type == NODE_INDEX) {
+				// The array is only evaluated once, esvAssignItem needs it for its region
+				strbufAppend(out, "{\nES3Var esvArray = ");
+				emitExpr(node->left->left, out);
+				strbufAppend(out, ";\n");
+				// Then the index, then the value
+				if (node->left->right->temp) {
+					emitTempName(out, node->left->right->temp);
+					strbufAppend(out, " = ");
+					emitExpr(node->left->right, out);
+					strbufAppend(out, ";\n");
+				}
+				strbufAppend(out, "esvAssignItem(esvArray, &");
+				emitItem(node->left, "esvArray", out);
+				strbufAppend(out, ", ");
+				emitExpr(node->right, out);
+				strbufAppend(out, ");\n}\nesvCollect();\n");
+				break;
+			}
+			strbufAppend(out, "esvAssign(&");
+			emitExpr(node->left, out);
+			strbufAppend(out, ", ");
+			emitEscaping(node->right, regionsSince(locals, node->left->decl), out);
+			strbufAppend(out, ");\nesvCollect();\n");
+			break;
+
+		case NODE_CALLSTMT:
+			emitExpr(node->left, out);
+			strbufAppend(out, ";\nesvCollect();\n");
+			break;
+
+		case NODE_IF:
+			strbufAppend(out, "if (");
+			emitCondition(node->left, out);
+			strbufAppend(out, ") ");
+			emitBlock(node->right, locals, out);
+			break;
+
+		case NODE_WHILE: {
+			// Arrays only made by one iteration are freed at its end, the condition is part of the iteration
+			int region = astMakesArrays(node->left) || astMakesArrays(node->right);
+			if (region) {
+				strbufAppend(out, "for (;;) {\nesvEnter();\nif (!(");
+				emitCondition(node->left, out);
+				strbufAppend(out, ")) {\nesvLeave();\nbreak;\n}\n");
+				locals->region++;
+			} else {
+				strbufAppend(out, "while (");
+				emitCondition(node->left, out);
+				strbufAppend(out, ") ");
+				if (isUnboxedType(node->left->valueType)) {
+					emitBlock(node->right, locals, out);
+					break;
+				}
+				strbufAppend(out, "{\n");
+			}
+
+			// The condition can make strings too
+			if (!isUnboxedType(node->left->valueType)) strbufAppend(out, "esvCollect();\n");
+			emitBlock(node->right, locals, out);
+			if (region) {
+				strbufAppend(out, "esvLeave();\n");
+				locals->region--;
+			}
+			strbufAppend(out, "}\n");
+			break;
+		}
+
+		case NODE_RETURN:
+			if (!locals->inFunction) {
+				strbufAppend(out, "return ");
+				emitExpr(node->left, out);
+				strbufAppend(out, ";\n");
+				break;
+			}
+
+			// Keep the result alive while the locals are released, then hand it to the caller as a temporary
+			strbufAppend(out, "{\nES3Var esvResult = esvRetain(");
+			emitEscaping(node->left, locals->region + 1, out);
+			strbufAppend(out, ");\n");
+			for (int i = 0; i <= locals->region; i++) {
+				strbufAppend(out, "esvLeave();\n");
+			}
+			emitReleases(locals, 0, out);
+			strbufAppend(out, "esvRelease(esvResult);\nreturn esvResult;\n}\n");
+			break;
+	}
+}
+
+/**
+ * Appends the return type, name and params of a function
+ * @param node - the NODE_FUNC node
+ * @param out - buffer to append to
+ */
+static void emitSignature(const ES3Node* node, ES3StrBuf* out) {
+	strbufAppend(out, "ES3Var ");
+	emitName(out, node->token);
+	strbufAppend(out, "(");
+	for (int i = 0; i < node->childCount; i++) {
+		if (i > 0) strbufAppend(out, ", ");
+		strbufAppend(out, declType(node->children[i]->valueType));
+		emitName(out, node->children[i]->token);
+	}
+	strbufAppend(out, ")");
+}
+
+static int numberTemps(ES3Node* node, int* count);
+
+/**
+ * Numbers the temporaries of one operand of a list C doesn't order
+ * @param node - the operand
+ * @param OUT pending - the last operand so far with effects, it gets a temporary once a later one has effects too
+ * @param OUT count - number of temporaries numbered so far
+ */
+static void numberOperand(ES3Node* node, ES3Node** pending, int* count) {
+	if (!numberTemps(node, count)) return;
+	if (*pending != NULL) (*pending)->temp = ++*count;
+	*pending = node;
+}
+
+/**
+ * Gives every operand that has to be evaluated before the operands after it its own temporary
+ * Only operands with effects need one, calls can print or read input and indexes can stop the program
+ * @param node - any node
+ * @param OUT count - number of temporaries numbered so far
+ * @return 1 if evaluating the node can have effects, otherwise 0
+ */
+static int numberTemps(ES3Node* node, int* count) {
+	if (node == NULL) return 0;
+
+	ES3Node* pending = NULL;
+	switch (node->type) {
+		case NODE_CALL:
+		case NODE_ARRAY:
+			for (int i = 0; i < node->childCount; i++) {
+				numberOperand(node->children[i], &pending, count);
+			}
+			return node->type == NODE_CALL || pending != NULL;
+
+		case NODE_BINARY:
+		case NODE_INDEX:
+			numberOperand(node->left, &pending, count);
+			numberOperand(node->right, &pending, count);
+			return node->type == NODE_INDEX || pending != NULL;
+
+		case NODE_ASSIGN:
+			// The array is evaluated into esvArray first, then the index and the value
+			if (node->left->type == NODE_INDEX) {
+				numberTemps(node->left->left, count);
+				numberOperand(node->left->right, &pending, count);
+			}
+			numberOperand(node->right, &pending, count);
+			return 1;
+
+		default: {
+			int effects = 0;
+			for (int i = 0; i < node->childCount; i++) {
+				effects |= numberTemps(node->children[i], count);
+			}
+			effects |= numberTemps(node->left, count);
+			effects |= numberTemps(node->right, count);
+			return effects;
+		}
+	}
+}
+
+/**
+ * Numbers the temporaries of a function or main and appends their declarations
+ * @param statements - the statements of the body
+ * @param count - number of statements
+ * @param out - buffer to append to
+ */
+static void emitTempDecls(ES3Node** statements, int count, ES3StrBuf* out) {
+	int temps = 0;
+	for (int i = 0; i < count; i++) numberTemps(statements[i], &temps);
+	for (int i = 1; i <= temps; i++) {
+		strbufAppend(out, "ES3Var ");
+		emitTempName(out, i);
+		strbufAppend(out, ";\n");
+	}
+}
+
+/**
+ * Appends a function definition, codegenProgram puts static in front as it has every function in one unit
+ * @param node - the NODE_FUNC node
+ * @param out - buffer to append to
+ * @param arena - arena the scope stack is allocated from
+ */
+static void emitFunction(const ES3Node* node, ES3StrBuf* out, ES3Arena* arena) {
+	ES3Locals locals = { .inFunction = 1, .arena = arena };
+
+	emitSignature(node, out);
+	strbufAppend(out, " {\n");
+	emitTempDecls(node->left->children, node->left->childCount, out);
+	strbufAppend(out, "esvEnter();\n");
+
+	// Params hold their args like vars do
+	for (int i = 0; i < node->childCount; i++) {
+		localsPush(&locals, node->children[i]);
+	}
+	for (int i = 0; i < locals.count; i++) {
+		strbufAppend(out, "esvRetain(");
+		emitName(out, locals.vars[i]->token);
+		strbufAppend(out, ");\n");
+	}
+
+	const ES3Node* body = node->left;
+	for (int i = 0; i < body->childCount; i++) {
+		emitStatement(body->children[i], &locals, out);
+	}
+
+	// Falling off the end of a function returns Null
+	strbufAppend(out, "esvLeave();\n");
+	emitReleases(&locals, 0, out);
+	strbufAppend(out, "return ES3_NULL;\n}\n");
+}
+
+/**
+ * Gives every string literal its own index in the literal cache
+ * @param node - any node
+ * @param OUT count - number of literals numbered so far
+ */
+static void numberLiterals(ES3Node* node, int* count) {
+	if (node == NULL) return;
+	if (node->type == NODE_STR) node->op = (*count)++;
+
+	for (int i = 0; i < node->childCount; i++) {
+		numberLiterals(node->children[i], count);
+	}
+	numberLiterals(node->left, count);
+	numberLiterals(node->right, count);
+}
+
+void codegenProgram(ES3Node* program, ES3StrBuf* out, ES3Arena* arena) {
+	// Comes first so its precompiled header can be used
+	strbufAppend(out, "#include \"stdpch.h\"\n#include <stdio.h>\n\n");
+
+	// String literals are interned once and kept in this cache
+	int literalCount = 0;
+	numberLiterals(program, &literalCount);
+	if (literalCount > 0) {
+		char literals[64];
+		snprintf(literals, sizeof(literals), "static ES3String* esvLiterals[%i];\n\n", literalCount);
+		strbufAppend(out, literals);
+	}
+
+	// Functions can call the ones defined after them and each other
+	int functions = 0;
+	for (; functions < program->childCount && program->children[functions]->type == NODE_FUNC; functions++) {
+		strbufAppend(out, "static ");
+		emitSignature(program->children[functions], out);
+		strbufAppend(out, ";\n");
+	}
+	if (functions > 0) strbufAppend(out, "\n");
+
+	int i = 0;
+	for (; i < functions; i++) {
+		strbufAppend(out, "static ");
+		emitFunction(program->children[i], out, arena);
+	}
+
+	if (i == program->childCount) {
+		strbufAppend(out, "int main() { }");
+		return;
+	}
+
+	ES3Locals locals = { .inFunction = 0, .arena = arena };
+	strbufAppend(out, "int main() {\n");
+	emitTempDecls(program->children + i, program->childCount - i, out);
+	for (; i < program->childCount; i++) {
+		emitStatement(program->children[i], &locals, out);
+	}
+	strbufAppend(out, "esvFlush();\nreturn 0;\n}");
+}
+
+
+/**
+ * Declares every function a node calls that isn't declared yet
+ * @param node - any node
+ * @param declared - functions declared so far, starting with the one being emitted
+ * @param count - OUT number of functions in declared
+ * @param out - buffer to append to
+ */
+static void emitCallees(const ES3Node* node, const ES3Node** declared, int* count, ES3StrBuf* out) {
+	if (node == NULL) return;
+
+	if (node->type == NODE_CALL && node->decl != NULL) {
+		int found = 0;
+		for (int i = 0; i < *count && !found; i++) found = declared[i] == node->decl;
+		if (!found) {
+			declared[(*count)++] = node->decl;
+			emitSignature(node->decl, out);
+			strbufAppend(out, ";\n");
+		}
+	}
+
+	for (int i = 0; i < node->childCount; i++) {
+		emitCallees(node->children[i], declared, count, out);
+	}
+	emitCallees(node->left, declared, count, out);
+	emitCallees(node->right, declared, count, out);
+}
+
+/**
+ * Starts a unit with the includes, the literal cache and declarations of the functions it calls
+ * @param nodes - the function or statements of main the unit holds
+ * @param count - number of nodes
+ * @param declared - scratch for emitCallees, big enough for every function, its first item is the function or NULL
+ * @param out - buffer to append to
+ */
+static void emitUnitStart(ES3Node** nodes, int count, const ES3Node** declared, ES3StrBuf* out) {
+	strbufAppend(out, "#include \"stdpch.h\"\n#include <stdio.h>\n\n");
+
+	int literalCount = 0;
+	for (int i = 0; i < count; i++) numberLiterals(nodes[i], &literalCount);
+	if (literalCount > 0) {
+		char literals[64];
+		snprintf(literals, sizeof(literals), "static ES3String* esvLiterals[%i];\n\n", literalCount);
+		strbufAppend(out, literals);
+	}
+
+	int declaredCount = 1;
+	for (int i = 0; i < count; i++) emitCallees(nodes[i], declared, &declaredCount, out);
+	strbufAppend(out, "\n");
+}
+
+int codegenUnits(ES3Node* program, ES3StrBuf** units, ES3Arena* arena) {
+	int functions = 0;
+	while (functions < program->childCount && program->children[functions]->type == NODE_FUNC) functions++;
+
+	*units = arenaAlloc(arena, sizeof(ES3StrBuf) * (functions + 1));
+	const ES3Node** declared = arenaAlloc(arena, sizeof(const ES3Node*) * (functions + 1));
+
+	for (int i = 0; i < functions; i++) {
+		ES3StrBuf* out = &(*units)[i];
+		*out = strbufNewIn(arena);
+		declared[0] = program->children[i];
+		emitUnitStart(&program->children[i], 1, declared, out);
+		emitFunction(program->children[i], out, arena);
+	}
+
+	ES3StrBuf* out = &(*units)[functions];
+	*out = strbufNewIn(arena);
+	declared[0] = NULL;
+	emitUnitStart(program->children + functions, program->childCount - functions, declared, out);
+
+	ES3Locals locals = { .inFunction = 0, .arena = arena };
+	strbufAppend(out, "int main() {\n");
+	emitTempDecls(program->children + functions, program->childCount - functions, out);
+	for (int i = functions; i < program->childCount; i++) {
+		emitStatement(program->children[i], &locals, out);
+	}
+	strbufAppend(out, "esvFlush();\nreturn 0;\n}");
+	return functions + 1;
+}
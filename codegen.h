@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ast.h"
+
+/**
+ * Emits the C translation of a whole program
+ * @param program - the NODE_PROGRAM node, string literals get numbered in op
+ * @param out - buffer the C source code is appended to
+ * @param arena - arena for scratch memory, released by the caller
+ */
+void codegenProgram(ES3Node* program, ES3StrBuf* out, ES3Arena* arena);
+
+
+/**
+ * Emits the C translation of a program as one translation unit per function followed by one for main, so a unit
+ * only changes when its function or the signatures of the functions it calls do. Functions aren't static, each unit
+ * declares the functions it calls and string literals are numbered within each unit
+ * @param program - the NODE_PROGRAM node, string literals get numbered in op
+ * @param OUT units - the units, allocated from the arena
+ * @param arena - arena for the units and scratch memory, released by the caller
+ * @return The number of units
+ */
+int codegenUnits(ES3Node* program, ES3StrBuf** units, ES3Arena* arena);
@@ -56,4 +56,30 @@
 #define TOKENV_RET "return"
 #define TOKENV_LOP "while"
 #define TOKENV_TRU "true"
-#define TOKENV_FLS "false"
\ No newline at end of file
+#define TOKENV_FLS "false"
+
+#define NODE_PROGRAM 1 // Program: functions, then statements
+#define NODE_FUNC 2 // Function definition: let name[params] = { ... };
+#define NODE_BLOCK 3 // Code block: { ... }
+#define NODE_LET 4 // Define var: let name = value;
+#define NODE_ASSIGN 5 // Redefine var: target = value;
+#define NODE_CALLSTMT 6 // Call function statement: name[args];
+#define NODE_IF 7 // If statement: if (cond) { ... };
+#define NODE_WHILE 8 // Loop statement: while (cond) { ... };
+#define NODE_RETURN 9 // Return statement: return value;
+#define NODE_NUM 10 // Number literal
+#define NODE_STR 11 // String literal
+#define NODE_BOOL 12 // Bool literal: true, false
+#define NODE_VAR 13 // Variable
+#define NODE_CALL 14 // Call function: name[args]
+#define NODE_ARRAY 15 // Array literal: [items]
+#define NODE_INDEX 16 // Array index: target{index}
+#define NODE_NEG 17 // Negation: -value
+#define NODE_BINARY 18 // Binary operator, op is the TOKEN_... enum of the operator
+
+#define TYPE_UNKNOWN -1 // Type not known at compile time
+#define TYPE_NULL 0 // Null, also what operators return on mismatched types
+#define TYPE_NUM 1 // Number
+#define TYPE_STR 2 // String
+#define TYPE_BOOL 3 // Bool
+#define TYPE_ARR 4 // Array
@@ -4,236 +4,703 @@
 #include <stdarg.h>
 #include <stdlib.h>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "esvutil.h"
 
-void genericError(FILE* sourceFilePtr, int code, const char* const message, ...) {
+void genericError(int code, const char* const message, ...) {
+	// Everything the program printed comes before the error
+	esvFlush();
+
 	va_list args;
 	va_start(args, message);
 
-	if (sourceFilePtr != NULL) {
-		int lineNum = 0;
-		fseek(sourceFilePtr, 1L, SEEK_CUR);
-		while (ftell(sourceFilePtr) > 1) {
-			fseek(sourceFilePtr, -1L, SEEK_CUR);
-			char c = ungetc(getc(sourceFilePtr), sourceFilePtr);
-			if (c == '\n') lineNum++;
-		}
-
-		printf("Error on line %i: ", lineNum+1);
-	}
-
 	vprintf(message, args);
 
-
 	va_end(args);
 
 	__debugbreak();
 	exit(code);
 }
 
+#ifdef ES3_ALLOC_STATS
+_Thread_local ES3AllocStats allocStats;
+#endif
+
 void* smalloc(size_t size) {
+#ifdef ES3_ALLOC_STATS
+	allocStats.mallocs++;
+	allocStats.mallocBytes += size;
+#endif
 	void* m = malloc(size);
 	if (m == NULL) {
-		genericError(NULL, 102, "Out of memory!");
+		genericError(102, "Out of memory!");
 	}
 	return m;
 }
 
 void* srealloc(void* _Block, size_t size) {
+#ifdef ES3_ALLOC_STATS
+	allocStats.mallocs++;
+	allocStats.mallocBytes += size;
+#endif
 	void* m = realloc(_Block, size);
 	if (m == NULL) {
 		free(m);
-		genericError(NULL, 102, "Out of memory!");
+		genericError(102, "Out of memory!");
 	}
 	_Block = m;
 	return m;
 }
 
-char* str_repeat(char* str, int times) {
-	if (times < 1) return "";
-	int ostrlen = strlen(str);
-	int size = ostrlen * times + 1;
-	char* ret = (char*) smalloc(sizeof(char) * size);
-	do {
-		for (int i = 0; i < ostrlen; i++) {
-			ret[i + times * ostrlen] = str[i];
+// Every allocation is aligned to this, large enough for any type the transpiler or runtime stores
+#define ARENA_ALIGN 16
+#define ARENA_HEADER ((sizeof(ES3ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+void arenaInit(ES3Arena* arena, size_t blockSize) {
+	arena->blocks = NULL;
+	arena->blockSize = blockSize;
+}
+
+void* arenaAlloc(ES3Arena* arena, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+#ifdef ES3_ALLOC_STATS
+	allocStats.arenaAllocs++;
+	allocStats.arenaBytes += size;
+#endif
+
+	ES3ArenaBlock* block = arena->blocks;
+	if (block == NULL || block->size - block->used < size) {
+		size_t blockSize = size > arena->blockSize ? size : arena->blockSize;
+		block = smalloc(ARENA_HEADER + blockSize);
+		block->used = 0;
+		block->size = blockSize;
+
+		// Keep filling the current block if an oversized allocation got its own
+		if (arena->blocks != NULL && blockSize > arena->blockSize) {
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
 		}
-	} while (times-- > 0);
-	ret[size] = '\0';
+	}
+
+	void* m = (char*) block + ARENA_HEADER + block->used;
+	block->used += size;
+	return m;
+}
+
+void* arenaDup(ES3Arena* arena, const void* source, size_t size) {
+	return memcpy(arenaAlloc(arena, size), source, size);
+}
+
+void* arenaGrow(ES3Arena* arena, void* old, size_t oldSize, size_t newSize) {
+	size_t oldAligned = (oldSize + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+	size_t newAligned = (newSize + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	ES3ArenaBlock* block = arena->blocks;
+	if (old != NULL && block != NULL && (char*) old + oldAligned == (char*) block + ARENA_HEADER + block->used && block->size - block->used >= newAligned - oldAligned) {
+		block->used += newAligned - oldAligned;
+		return old;
+	}
+
+	void* m = arenaAlloc(arena, newSize);
+	if (old != NULL) memcpy(m, old, oldSize);
+	return m;
+}
+
+char* arenaRepeat(ES3Arena* arena, const char* str, int times) {
+	if (times < 0) times = 0;
+	size_t length = strlen(str);
+	char* ret = arenaAlloc(arena, length * times + 1);
+	for (int i = 0; i < times; i++) {
+		memcpy(ret + i * length, str, length);
+	}
+	ret[length * times] = '\0';
 	return ret;
 }
 
-char* sstrcat(char* destination, const char* source) {
-	int size = strlen(destination) + strlen(source) + 1;
-	destination = srealloc(destination, size);
-	strcat(destination, source);
-	return destination;
-}
-
-char* sstrpre(char* destination, const char* source) {
-	size_t len = strlen(source);
-	destination = srealloc(destination, strlen(destination) + len + 1);
-    memmove(destination + len, destination, strlen(destination) + 1);
-	destination = memcpy(destination, source, len);
-	return destination;
-}
-
-char* esvToString(ES3Var a) {
-    // Number
-    if (a.type == 1) { 
-        char* buffer = smalloc(sizeof(char) * 1080);
-        snprintf(buffer, 1080, "%g", a.valNum);
-        return buffer;
-    }
-    // String
-    else if (a.type == 2) {
-        char* buffer = smalloc(sizeof(char) * (strlen(a.valString) + 3));
-        buffer[0] = '"';
-        buffer[1] = '\0';
-        buffer = sstrcat(buffer, a.valString);
-        buffer = sstrcat(buffer, "\"");
-        return buffer;
-    }
-    // Array
-    else if (a.type == 4) {
-        char *buffer = smalloc(sizeof(char) * 2);
-        buffer[0] = '[';
-        buffer[1] = '\0';
-
-        while (a.valArrCur) {
-            char* strVal = esvToString(*a.valArrCur);
-            int size = strlen(buffer) + strlen(strVal) + 1;
-            buffer = srealloc(buffer, size+2);
-            buffer = sstrcat(buffer, strVal);
-
-            if (a.valArrNext) buffer = sstrcat(buffer, ", ");
-            if (a.valArrCur->type == 1 || a.valArrCur->type == 2 || a.valArrCur->type == 4) free(strVal);
-            if (a.valArrNext != NULL) a = *a.valArrNext; else break;
+void arenaFree(ES3Arena* arena) {
+	ES3ArenaBlock* block = arena->blocks;
+	while (block != NULL) {
+		ES3ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->blocks = NULL;
+}
+
+ES3StrBuf strbufNew(void) {
+	ES3StrBuf buf = { .data = smalloc(16), .start = 0, .length = 0, .capacity = 16, .arena = NULL };
+	buf.data[0] = '\0';
+	return buf;
+}
+
+ES3StrBuf strbufNewIn(ES3Arena* arena) {
+	ES3StrBuf buf = { .data = arenaAlloc(arena, 16), .start = 0, .length = 0, .capacity = 16, .arena = arena };
+	buf.data[0] = '\0';
+	return buf;
+}
+
+/**
+ * Makes sure a string buffer has room for at least front chars before and back chars after its text
+ * @param buf - the buffer
+ * @param front - chars needed before the text
+ * @param back - chars needed after the text, not counting the NUL terminator
+ */
+static void strbufReserve(ES3StrBuf* buf, size_t front, size_t back) {
+	size_t tail = buf->capacity - buf->start - buf->length - 1;
+	if (buf->start >= front && tail >= back) return;
+
+	// Grow geometrically on the side that ran out so repeated prepends or appends stay amortized O(1)
+	size_t newStart = buf->start >= front ? buf->start : front + buf->length + 16;
+	size_t newTail = tail >= back ? tail : back + buf->length + 16;
+	size_t newCapacity = newStart + buf->length + 1 + newTail;
+
+	char* data = buf->arena ? arenaAlloc(buf->arena, newCapacity) : smalloc(newCapacity);
+	memcpy(data + newStart, buf->data + buf->start, buf->length + 1);
+	if (buf->arena == NULL) free(buf->data);
+
+	buf->data = data;
+	buf->start = newStart;
+	buf->capacity = newCapacity;
+}
+
+void strbufAppendN(ES3StrBuf* buf, const char* source, size_t length) {
+	strbufReserve(buf, 0, length);
+	char* end = buf->data + buf->start + buf->length;
+	memcpy(end, source, length);
+	end[length] = '\0';
+	buf->length += length;
+}
+
+void strbufAppend(ES3StrBuf* buf, const char* source) {
+	strbufAppendN(buf, source, strlen(source));
+}
+
+void strbufAppendBuf(ES3StrBuf* buf, ES3StrBuf* source) {
+	strbufAppendN(buf, source->data + source->start, source->length);
+	strbufFree(source);
+}
+
+void strbufPrepend(ES3StrBuf* buf, const char* source) {
+	size_t length = strlen(source);
+	strbufReserve(buf, length, 0);
+	buf->start -= length;
+	buf->length += length;
+	memcpy(buf->data + buf->start, source, length);
+}
+
+void strbufWrap(ES3StrBuf* buf, const char* before, const char* after) {
+	strbufPrepend(buf, before);
+	strbufAppend(buf, after);
+}
+
+const char* strbufText(const ES3StrBuf* buf) {
+	return buf->data + buf->start;
+}
+
+void strbufWrite(const ES3StrBuf* buf, FILE* file) {
+	fwrite(buf->data + buf->start, 1, buf->length, file);
+}
+
+void strbufFree(ES3StrBuf* buf) {
+	if (buf->arena == NULL) free(buf->data);
+	buf->data = NULL;
+	buf->start = 0;
+	buf->length = 0;
+	buf->capacity = 0;
+}
+
+// Output is written here and only handed to stdio when it fills up or is flushed
+#define OUT_CAPACITY (64 * 1024)
+// Enough for any number printed with %g
+#define OUT_NUMBER_MAX 32
+
+static struct {
+    char data[OUT_CAPACITY];
+    size_t length;
+
+    // -1 until the first write checks if stdout is a terminal
+    int interactive;
+} out = { .interactive = -1 };
+
+void esvFlush(void) {
+    if (out.length > 0) fwrite(out.data, 1, out.length, stdout);
+    out.length = 0;
+    fflush(stdout);
+}
+
+void esvWrite(const char* text, size_t length) {
+    if (OUT_CAPACITY - out.length < length) {
+        esvFlush();
+        // Too big to be worth copying
+        if (length >= OUT_CAPACITY) {
+            fwrite(text, 1, length, stdout);
+            return;
         }
-        
-        buffer = srealloc(buffer, strlen(buffer)+2);
-        buffer = sstrcat(buffer, "]");
-        
-        return buffer;
     }
+    memcpy(out.data + out.length, text, length);
+    out.length += length;
+}
 
-    switch (a.type) {
-        case 0:
-            return "Null";
+void esvWriteLine(void) {
+    if (out.interactive < 0) out.interactive = isatty(fileno(stdout));
+
+    esvWrite("\n", 1);
+    // Someone watching should see each line as it is printed
+    if (out.interactive) esvFlush();
+}
+
+void esvWriteVar(ES3Var a) {
+    switch (ES3_TYPE(a)) {
+        case 1:
+            if (OUT_CAPACITY - out.length < OUT_NUMBER_MAX) esvFlush();
+            out.length += snprintf(out.data + out.length, OUT_NUMBER_MAX, "%g", ES3_AS_NUM(a));
+            break;
+        case 2:
+            esvWrite("\"", 1);
+            esvWrite(ES3_AS_STR(a)->text, ES3_AS_STR(a)->length);
+            esvWrite("\"", 1);
+            break;
         case 3:
-            return a.valBool ? "true" : "false";
+            if (ES3_AS_BOOL(a)) esvWrite("true", 4); else esvWrite("false", 5);
+            break;
+        case 4:
+            esvWrite("[", 1);
+            for (size_t i = 0; i < ES3_AS_ARR(a)->length; i++) {
+                if (i > 0) esvWrite(", ", 2);
+                esvWriteVar(ES3_AS_ARR(a)->items[i]);
+            }
+            esvWrite("]", 1);
+            break;
+        case 0:
+            esvWrite("Null", 4);
+            break;
         default:
-            return "Undefined";
+            esvWrite("Undefined", 9);
+            break;
     }
 }
 
-ES3Var esvComp(ES3Var a, int op, ES3Var b) {
+int esvDepth = 0;
+
+// Most programs never nest deeper than this, so the stack only gets malloc'd for deep recursion
+#define REGION_INITIAL_CAPACITY 64
+
+static ES3Array* regionsInitial[REGION_INITIAL_CAPACITY];
+ES3Array** esvRegions = regionsInitial;
+int esvRegionCapacity = REGION_INITIAL_CAPACITY;
+
+void esvRegionsGrow(void) {
+    int capacity = esvRegionCapacity * 2;
+    if (esvRegions == regionsInitial) {
+        esvRegions = smalloc(sizeof(ES3Array*) * capacity);
+        memcpy(esvRegions, regionsInitial, sizeof(regionsInitial));
+    } else {
+        esvRegions = srealloc(esvRegions, sizeof(ES3Array*) * capacity);
+    }
+    esvRegionCapacity = capacity;
+}
+
+/**
+ * Adds an array to the front of the list of a region
+ * @param array - the array, not in any list
+ * @param region - depth of the region
+ */
+static void regionPush(ES3Array* array, int region) {
+    array->region = region;
+    array->next = esvRegions[region];
+    array->link = &esvRegions[region];
+    if (array->next != NULL) array->next->link = &array->next;
+    esvRegions[region] = array;
+}
+
+void esvRegionFree(ES3Array* arrays) {
+    while (arrays != NULL) {
+        ES3Array* next = arrays->next;
+        // Arrays it holds are in this region too or outlive it, only strings are counted
+        for (size_t i = 0; i < arrays->length; i++) {
+            esvRelease(arrays->items[i]);
+        }
+        free(arrays);
+        arrays = next;
+    }
+}
+
+ES3Var esvArrayNew(size_t length, const ES3Var* items) {
+    ES3Array* array = smalloc(sizeof(ES3Array) + sizeof(ES3Var) * length);
+    array->length = length;
+    array->capacity = length;
+    for (size_t i = 0; i < length; i++) {
+        array->items[i] = esvRetain(items[i]);
+    }
+    regionPush(array, esvDepth);
+    return ES3_ARR(array);
+}
+
+ES3Var esvPromote(ES3Var a, int region) {
+    if (ES3_TYPE(a) != 4) return a;
+
+    ES3Array* array = ES3_AS_ARR(a);
+    if (array->region <= region) return a;
+
+    *array->link = array->next;
+    if (array->next != NULL) array->next->link = array->link;
+    regionPush(array, region);
+
+    // Moved before its items so arrays holding themselves stop here
+    for (size_t i = 0; i < array->length; i++) {
+        esvPromote(array->items[i], region);
+    }
+    return a;
+}
+
+// Literals hold this many refs so they are never freed
+#define STR_IMMORTAL ((size_t) 1 << (sizeof(size_t) * 8 - 2))
+// The zero count table isn't scanned until it holds this many strings
+#define ZCT_MIN_LIMIT 256
+
+static struct {
+    ES3String** buckets;
+    size_t bucketCount;
+    size_t count;
+} strTable;
+
+static struct {
+    ES3String** items;
+    size_t count;
+    size_t capacity;
+    size_t limit;
+
+    // Shallowest depth of the strings the last scan had to keep, they can be freed once the calls return to it
+    int keptDepth;
+} zct = { .limit = ZCT_MIN_LIMIT, .keptDepth = -1 };
+
+/**
+ * FNV-1a hash of some chars
+ * @param text - the chars
+ * @param length - number of chars
+ * @return The hash
+ */
+static size_t strHash(const char* text, size_t length) {
+    size_t hash = (size_t) 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) text[i]) * (size_t) 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Doubles the buckets of the intern table, rehashing with the cached hashes
+ */
+static void strTableGrow(void) {
+    size_t bucketCount = strTable.bucketCount ? strTable.bucketCount * 2 : 256;
+    ES3String** buckets = smalloc(sizeof(ES3String*) * bucketCount);
+    memset(buckets, 0, sizeof(ES3String*) * bucketCount);
+
+    for (size_t i = 0; i < strTable.bucketCount; i++) {
+        ES3String* str = strTable.buckets[i];
+        while (str != NULL) {
+            ES3String* next = str->next;
+            str->next = buckets[str->hash & (bucketCount - 1)];
+            buckets[str->hash & (bucketCount - 1)] = str;
+            str = next;
+        }
+    }
+
+    free(strTable.buckets);
+    strTable.buckets = buckets;
+    strTable.bucketCount = bucketCount;
+}
+
+/**
+ * Puts a string nothing holds into the zero count table, or lowers its depth if it is already there
+ * @param str - the string
+ * @param depth - shallowest call depth that could still be using it
+ */
+static void zctAdd(ES3String* str, int depth) {
+    if (str->zctDepth >= 0) {
+        if (depth < str->zctDepth) str->zctDepth = depth;
+        return;
+    }
+
+    if (zct.count == zct.capacity) {
+        zct.capacity = zct.capacity ? zct.capacity * 2 : ZCT_MIN_LIMIT;
+        zct.items = srealloc(zct.items, sizeof(ES3String*) * zct.capacity);
+    }
+    zct.items[zct.count++] = str;
+    str->zctDepth = depth;
+}
+
+/**
+ * Removes a string from the intern table and frees it
+ * @param str - the string
+ */
+static void strFree(ES3String* str) {
+    ES3String** link = &strTable.buckets[str->hash & (strTable.bucketCount - 1)];
+    while (*link != str) link = &(*link)->next;
+    *link = str->next;
+    strTable.count--;
+    free(str);
+}
+
+ES3String* esvStrIntern(const char* text, size_t length) {
+    size_t hash = strHash(text, length);
+
+    if (strTable.bucketCount) {
+        for (ES3String* str = strTable.buckets[hash & (strTable.bucketCount - 1)]; str != NULL; str = str->next) {
+            if (str->hash == hash && str->length == length && !memcmp(str->text, text, length)) {
+                // A string waiting to be freed is a temporary again, now at this depth
+                if (str->refs == 0) zctAdd(str, esvDepth);
+                return str;
+            }
+        }
+    }
+
+    if (strTable.count >= strTable.bucketCount) strTableGrow();
+
+    ES3String* str = smalloc(sizeof(ES3String) + length + 1);
+    str->refs = 0;
+    str->length = length;
+    str->hash = hash;
+    str->zctDepth = -1;
+    memcpy(str->text, text, length);
+    str->text[length] = '\0';
+
+    str->next = strTable.buckets[hash & (strTable.bucketCount - 1)];
+    strTable.buckets[hash & (strTable.bucketCount - 1)] = str;
+    strTable.count++;
+
+    zctAdd(str, esvDepth);
+    return str;
+}
+
+ES3String* esvStrLiteral(ES3String** cache, const char* text, size_t length) {
+    if (*cache == NULL) {
+        *cache = esvStrIntern(text, length);
+        // Every site with the same text shares the string, adding STR_IMMORTAL for each would wrap the count
+        if ((*cache)->refs < STR_IMMORTAL) (*cache)->refs += STR_IMMORTAL;
+    }
+    return *cache;
+}
+
+ES3Var esvRetain(ES3Var a) {
+    if (ES3_TYPE(a) == 2) ES3_AS_STR(a)->refs++;
+    return a;
+}
+
+/**
+ * Drops a reference to a var
+ * @param a - the var no longer stored
+ * @param depth - shallowest call depth that could still be using it as a temporary
+ */
+static void release(ES3Var a, int depth) {
+    if (ES3_TYPE(a) != 2) return;
+
+    ES3String* str = ES3_AS_STR(a);
+    if (--str->refs == 0) zctAdd(str, depth);
+}
+
+void esvRelease(ES3Var a) {
+    release(a, esvDepth);
+}
+
+void esvAssign(ES3Var* target, ES3Var value) {
+    ES3Var old = *target;
+    *target = esvRetain(value);
+    release(old, esvDepth);
+}
+
+void esvAssignItem(ES3Var array, ES3Var* item, ES3Var value) {
+    ES3Var old = *item;
+    *item = esvRetain(esvPromote(value, ES3_AS_ARR(array)->region));
+    // Any unfinished call could have read the item before a deeper call overwrote it
+    release(old, 0);
+}
+
+void esvCollect(void) {
+    if (zct.count < zct.limit && esvDepth > zct.keptDepth) return;
+
+    size_t kept = 0;
+    zct.keptDepth = -1;
+    for (size_t i = 0; i < zct.count; i++) {
+        ES3String* str = zct.items[i];
+        if (str->refs > 0) {
+            // Stored again since it was added, it comes back if its count drops to 0 again
+            str->zctDepth = -1;
+        } else if (str->zctDepth >= esvDepth) {
+            strFree(str);
+        } else {
+            // A call that hasn't finished its statement could still be using it
+            if (kept == 0 || str->zctDepth < zct.keptDepth) zct.keptDepth = str->zctDepth;
+            zct.items[kept++] = str;
+        }
+    }
+    zct.count = kept;
+
+    // Scan again once the table has grown by as much as it kept, so each string is scanned amortized O(1) times
+    zct.limit = kept * 2 > ZCT_MIN_LIMIT ? kept * 2 : ZCT_MIN_LIMIT;
+}
+
+ES3Var* esvIndex(ES3Var a, double index) {
+    if (ES3_TYPE(a) != 4) genericError(301, "Runtime error: Only arrays can be indexed\n");
+
+    // Written so NaN fails the check too
+    if (!(index >= 0 && index < ES3_AS_ARR(a)->length) || index != (size_t) index) {
+        genericError(302, "Runtime error: Index %g is out of range for an array of length %g\n", index, (double) ES3_AS_ARR(a)->length);
+    }
+    return &ES3_AS_ARR(a)->items[(size_t) index];
+}
+
+ES3Var* esvIndexVar(ES3Var a, ES3Var index) {
+    if (ES3_TYPE(index) != 1) genericError(303, "Runtime error: Array indexes must be numbers\n");
+    return esvIndex(a, ES3_AS_NUM(index));
+}
+
+ES3Var esvCompSlow(ES3Var a, int op, ES3Var b) {
     if (op == 0) return a;
 
-    switch (a.type) {
+    switch (ES3_TYPE(a)) {
         case 1:
-            if (b.type != 1) return (ES3Var) { .type = 0 };
+            if (ES3_TYPE(b) != 1) return ES3_NULL;
             switch (op) {
                 case 1:
-                    return (ES3Var) { .type = 3, .valBool = a.valNum == b.valNum };
+                    return ES3_BOOL(ES3_AS_NUM(a) == ES3_AS_NUM(b));
                 case 2:
-                    return (ES3Var) { .type = 3, .valBool = a.valNum >  b.valNum };
+                    return ES3_BOOL(ES3_AS_NUM(a) >  ES3_AS_NUM(b));
                 case 3:
-                    return (ES3Var) { .type = 3, .valBool = a.valNum >= b.valNum };
+                    return ES3_BOOL(ES3_AS_NUM(a) >= ES3_AS_NUM(b));
                 case 4:
-                    return (ES3Var) { .type = 3, .valBool = a.valNum <  b.valNum };
+                    return ES3_BOOL(ES3_AS_NUM(a) <  ES3_AS_NUM(b));
                 case 5:
-                    return (ES3Var) { .type = 3, .valBool = a.valNum <= b.valNum };
+                    return ES3_BOOL(ES3_AS_NUM(a) <= ES3_AS_NUM(b));
             }
         case 2:
-            if (b.type != 2) return (ES3Var) { .type = 0 };
+            if (ES3_TYPE(b) != 2) return ES3_NULL;
+            // Strings are interned, so equal strings are the same object
+            if (ES3_AS_STR(a) == ES3_AS_STR(b)) return ES3_BOOL(op == 1 || op == 3 || op == 5);
             switch(op) {
                 case 1:
-                    return (ES3Var) { .type = 3, .valBool = strcmp(a.valString, b.valString) == 0};
+                    return ES3_BOOL(0);
                 case 2:
-                    return (ES3Var) { .type = 3, .valBool = strcmp(a.valString, b.valString) >  0};
+                    return ES3_BOOL(strcmp(ES3_AS_STR(a)->text, ES3_AS_STR(b)->text) >  0);
                 case 3:
-                    return (ES3Var) { .type = 3, .valBool = strcmp(a.valString, b.valString) >= 0};
+                    return ES3_BOOL(strcmp(ES3_AS_STR(a)->text, ES3_AS_STR(b)->text) >= 0);
                 case 4:
-                    return (ES3Var) { .type = 3, .valBool = strcmp(a.valString, b.valString) <  0};
+                    return ES3_BOOL(strcmp(ES3_AS_STR(a)->text, ES3_AS_STR(b)->text) <  0);
                 case 5:
-                    return (ES3Var) { .type = 3, .valBool = strcmp(a.valString, b.valString) <= 0};
+                    return ES3_BOOL(strcmp(ES3_AS_STR(a)->text, ES3_AS_STR(b)->text) <= 0);
             }
         case 3:
-            if (b.type != 3) return (ES3Var) { .type = 0 };
+            if (ES3_TYPE(b) != 3) return ES3_NULL;
             switch (op) {
                 case 1:
-                    return (ES3Var) { .type = 3, .valBool = a.valBool == b.valBool };
+                    return ES3_BOOL(ES3_AS_BOOL(a) == ES3_AS_BOOL(b));
                 case 2:
-                    return (ES3Var) { .type = 3, .valBool = a.valBool >  b.valBool };
+                    return ES3_BOOL(ES3_AS_BOOL(a) >  ES3_AS_BOOL(b));
                 case 3:
-                    return (ES3Var) { .type = 3, .valBool = a.valBool >= b.valBool };
+                    return ES3_BOOL(ES3_AS_BOOL(a) >= ES3_AS_BOOL(b));
                 case 4:
-                    return (ES3Var) { .type = 3, .valBool = a.valBool <  b.valBool };
+                    return ES3_BOOL(ES3_AS_BOOL(a) <  ES3_AS_BOOL(b));
                 case 5:
-                    return (ES3Var) { .type = 3, .valBool = a.valBool <= b.valBool };
+                    return ES3_BOOL(ES3_AS_BOOL(a) <= ES3_AS_BOOL(b));
             }
         default:
-            return (ES3Var) { .type = 0 };
+            return ES3_NULL;
     }
 }
 
-ES3Var esvTerm(ES3Var a, int op, ES3Var b) {
+ES3Var esvTermSlow(ES3Var a, int op, ES3Var b) {
     if (op == 0) return a;
 
-    switch (a.type) {
+    switch (ES3_TYPE(a)) {
         case 1:
-            if (b.type != 1) return (ES3Var) { .type = 0 };
+            if (ES3_TYPE(b) != 1) return ES3_NULL;
             switch (op) {
                 case 1:
-                    return (ES3Var) { .type = 1, .valNum = a.valNum * b.valNum };
+                    return ES3_NUM(ES3_AS_NUM(a) * ES3_AS_NUM(b));
                 case 2:
-                    return (ES3Var) { .type = 1, .valNum = a.valNum / b.valNum };
+                    return ES3_NUM(ES3_AS_NUM(a) / ES3_AS_NUM(b));
             }
         default:
-            return (ES3Var) { .type = 0 };
+            return ES3_NULL;
     }
 }
 
-ES3Var esvExpr(ES3Var a, int op, ES3Var b) {
+ES3Var esvExprSlow(ES3Var a, int op, ES3Var b) {
     if (op == 0) return a;
 
-    switch (a.type) {
+    switch (ES3_TYPE(a)) {
         case 1:
-            if (b.type != 1) return (ES3Var) { .type = 0 };
+            if (ES3_TYPE(b) != 1) return ES3_NULL;
             switch (op) {
                 case 1:
-                    return (ES3Var) { .type = 1, .valNum = a.valNum + b.valNum };
+                    return ES3_NUM(ES3_AS_NUM(a) + ES3_AS_NUM(b));
                 case 2:
-                    return (ES3Var) { .type = 1, .valNum = a.valNum - b.valNum };
+                    return ES3_NUM(ES3_AS_NUM(a) - ES3_AS_NUM(b));
             }
         default:
-            return (ES3Var) { .type = 0 };
+            return ES3_NULL;
     }
 }
 
-ES3Var esvExpo(ES3Var a, int op, ES3Var b) {
+ES3Var esvExpoSlow(ES3Var a, int op, ES3Var b) {
     if (op == 0) return a;
 
-    switch (a.type) {
+    switch (ES3_TYPE(a)) {
         case 1:
-            if (b.type != 1) return (ES3Var) { .type = 0 };
+            if (ES3_TYPE(b) != 1) return ES3_NULL;
             switch (op) {
                 case 1:
-                    return (ES3Var) { .type = 1, .valNum = pow(a.valNum, b.valNum) };
+                    return ES3_NUM(pow(ES3_AS_NUM(a), ES3_AS_NUM(b)));
             }
         default:
-            return (ES3Var) { .type = 0 };
+            return ES3_NULL;
+    }
+}
+
+#ifndef ES3_INLINE
+
+ES3Var esvComp(ES3Var a, int op, ES3Var b) {
+    return esvCompSlow(a, op, b);
+}
+
+ES3Var esvTerm(ES3Var a, int op, ES3Var b) {
+    return esvTermSlow(a, op, b);
+}
+
+ES3Var esvExpr(ES3Var a, int op, ES3Var b) {
+    return esvExprSlow(a, op, b);
+}
+
+ES3Var esvExpo(ES3Var a, int op, ES3Var b) {
+    return esvExpoSlow(a, op, b);
+}
+
+ES3Var esvUnary(ES3Var a) {
+    switch (ES3_TYPE(a)) {
+        case 1:
+            return ES3_NUM(-ES3_AS_NUM(a));
+        default:
+            return ES3_NULL;
     }
 }
 
 int esvTruthy(ES3Var a) {
-    switch (a.type){
+    switch (ES3_TYPE(a)){
         case 1:
-            return a.valNum != 0;
+            return ES3_AS_NUM(a) != 0;
         case 3:
-            return a.valBool;
+            return ES3_AS_BOOL(a);
         default:
             return 0;
     }
-}
\ No newline at end of file
+}
+
+#endif
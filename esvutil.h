@@ -1,46 +1,322 @@
 #pragma once
 
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Vars are only made and read through the ES3_... macros so the representation can be picked at compile time
+ *  - ES3_TYPE(v): 0 Null, 1 number, 2 string, 3 bool, 4 array
+ *  - ES3_AS_NUM, ES3_AS_STR, ES3_AS_BOOL, ES3_AS_ARR: the value, only valid for a var of that type
+ *  - ES3_NULL, ES3_NUM(x), ES3_STR(x), ES3_BOOL(x), ES3_ARR(x): make a var
+ */
+#ifdef ES3_NANBOX
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * NaN boxed var, numbers are stored as their double and everything else is hidden in NaN bit patterns
+ * Arithmetic only ever makes the canonical NaN 0x7FF8... or 0xFFF8..., so tags from 0xFFF9 up are free
+ * The top 16 bits are 0xFFF9 + type and the low 48 bits hold the bool or pointer, which fits user space pointers on x86-64 and AArch64
+ */
+typedef struct ES3Var_ {
+    uint64_t bits;
+} ES3Var;
+
+#define ES3_TAG_BASE 0xFFF9u
+#define ES3_PAYLOAD_MASK 0x0000FFFFFFFFFFFFull
+
+static inline ES3Var esvBox(int type, uint64_t payload) {
+	return (ES3Var) { ((uint64_t) (ES3_TAG_BASE + type) << 48) | payload };
+}
+
+static inline int esvType(ES3Var v) {
+	unsigned tag = (unsigned) (v.bits >> 48);
+	return tag >= ES3_TAG_BASE ? (int) (tag - ES3_TAG_BASE) : 1;
+}
+
+static inline ES3Var esvNum(double x) {
+	ES3Var v;
+	memcpy(&v.bits, &x, sizeof(double));
+	// Any NaN could have a payload that looks like a tag, the quiet NaN keeps its sign since 0xFFF8 is below the tags
+	if (x != x) v.bits = (v.bits & 0x8000000000000000ull) | 0x7FF8000000000000ull;
+	return v;
+}
+
+static inline double esvAsNum(ES3Var v) {
+	double x;
+	memcpy(&x, &v.bits, sizeof(double));
+	return x;
+}
+
+#define ES3_TYPE(v) esvType(v)
+#define ES3_AS_NUM(v) esvAsNum(v)
+#define ES3_AS_STR(v) ((struct ES3String_*) (uintptr_t) ((v).bits & ES3_PAYLOAD_MASK))
+#define ES3_AS_BOOL(v) ((int) ((v).bits & 1))
+#define ES3_AS_ARR(v) ((struct ES3Array_*) (uintptr_t) ((v).bits & ES3_PAYLOAD_MASK))
+
+#define ES3_NULL esvBox(0, 0)
+#define ES3_NUM(x) esvNum(x)
+#define ES3_STR(x) esvBox(2, (uint64_t) (uintptr_t) (x))
+#define ES3_BOOL(x) esvBox(3, (x) ? 1 : 0)
+#define ES3_ARR(x) esvBox(4, (uint64_t) (uintptr_t) (x))
+
+#else
+
 typedef struct ES3Var_ {
     int type;
 
     double valNum;
-    char* valString;
+    struct ES3String_* valString;
     int valBool;
 
-    struct ES3Var_* valArrCur;
-    struct ES3Var_* valArrNext;
+    struct ES3Array_* valArr;
 } ES3Var;
 
+#define ES3_TYPE(v) ((v).type)
+#define ES3_AS_NUM(v) ((v).valNum)
+#define ES3_AS_STR(v) ((v).valString)
+#define ES3_AS_BOOL(v) ((v).valBool)
+#define ES3_AS_ARR(v) ((v).valArr)
+
+#define ES3_NULL ((ES3Var) { .type = 0 })
+#define ES3_NUM(x) ((ES3Var) { .type = 1, .valNum = (x) })
+#define ES3_STR(x) ((ES3Var) { .type = 2, .valString = (x) })
+#define ES3_BOOL(x) ((ES3Var) { .type = 3, .valBool = (x) })
+#define ES3_ARR(x) ((ES3Var) { .type = 4, .valArr = (x) })
+
+#endif
+
 /**
- * Errors with message and error code
- * @param message - message in error
+ * Array stored in one allocation, its items follow the length and capacity so indexing is O(1)
+ * Vars that hold the same array share it, so assigning to an item is seen through all of them
+ * Every array belongs to the region it was made in and is freed with it, unless it was promoted to an outer
+ * region first. Arrays it holds are always in the same or an outer region
+ */
+typedef struct ES3Array_ {
+    size_t length;
+    size_t capacity;
+
+    int region;
+    struct ES3Array_* next;
+    struct ES3Array_** link;
+
+    ES3Var items[];
+} ES3Array;
+
+/**
+ * Immutable string, every string is interned so strings with the same text are the same object
+ * refs counts the vars and array items holding it, temporaries aren't counted. A string whose count
+ * drops to 0 waits in the zero count table, tagged with the shallowest depth that could still be
+ * using it as a temporary, and is freed by esvCollect once that depth has finished its statement
+ */
+typedef struct ES3String_ {
+    size_t refs;
+    size_t length;
+    size_t hash;
+    int zctDepth;
+    struct ES3String_* next;
+    char text[];
+} ES3String;
+
+// Depth of regions, generated functions enter one per call and loops that can make arrays enter one per iteration
+extern int esvDepth;
+// Arrays made in each region that haven't been promoted out of it, indexed by depth
+extern struct ES3Array_** esvRegions;
+extern int esvRegionCapacity;
+
+/**
+ * Doubles the region stack, called by esvEnter when it is full
+ */
+void esvRegionsGrow(void);
+
+/**
+ * Frees the arrays of a region that was just left, releasing what they hold
+ * @param arrays - the first array of the region
+ */
+void esvRegionFree(struct ES3Array_* arrays);
+
+static inline void esvEnter(void) {
+	if (++esvDepth == esvRegionCapacity) esvRegionsGrow();
+	esvRegions[esvDepth] = NULL;
+}
+
+static inline void esvLeave(void) {
+	struct ES3Array_* arrays = esvRegions[esvDepth--];
+	if (arrays != NULL) esvRegionFree(arrays);
+}
+
+/**
+ * Growable string with slack on both ends, so appends and prepends are both amortized O(1)
+ * The text is data[start] up to data[start + length] and is always NUL terminated
+ * If arena is set the data is allocated from it and is released with the arena
+ */
+typedef struct ES3StrBuf_ {
+    char* data;
+    size_t start;
+    size_t length;
+    size_t capacity;
+
+    struct ES3Arena_* arena;
+} ES3StrBuf;
+
+typedef struct ES3ArenaBlock_ {
+    struct ES3ArenaBlock_* next;
+    size_t used;
+    size_t size;
+} ES3ArenaBlock;
+
+/**
+ * Bump allocator, everything allocated from it is released at once by arenaFree
+ */
+typedef struct ES3Arena_ {
+    ES3ArenaBlock* blocks;
+    size_t blockSize;
+} ES3Arena;
+
+/**
+ * Allocations made on a thread, for --time-report. Only counted when ES3_ALLOC_STATS is defined, which the
+ * Makefile does for es3 and not for the runtime library programs link
+ *  - mallocs, mallocBytes: calls to smalloc and srealloc and the bytes they asked for
+ *  - arenaAllocs, arenaBytes: the same for arenaAlloc, a new block of an arena counts as an smalloc too
+ */
+typedef struct ES3AllocStats_ {
+    size_t mallocs;
+    size_t mallocBytes;
+    size_t arenaAllocs;
+    size_t arenaBytes;
+} ES3AllocStats;
+
+#ifdef ES3_ALLOC_STATS
+extern _Thread_local ES3AllocStats allocStats;
+#endif
+
+/**
+ * Errors with message and error code, see sourceError for errors at a position in the source code
  * @param code - error code
+ * @param message - message in error
+ */
+void genericError(int code, const char* const message, ...);
+
+/**
+ * Creates an empty string buffer
+ * @return The buffer, must be freed with strbufFree
+ */
+ES3StrBuf strbufNew(void);
+
+/**
+ * Creates an empty string buffer whose data is allocated from an arena
+ * @param arena - the arena to allocate from
+ * @return The buffer, valid until the arena is freed
+ */
+ES3StrBuf strbufNewIn(struct ES3Arena_* arena);
+
+/**
+ * Appends chars to the end of a string buffer, source does not need to be NUL terminated
+ * @param buf - buffer to add to
+ * @param source - chars to add
+ * @param length - number of chars of source to add
  */
-void genericError(FILE* sourceFilePtr, int code, const char* const message, ...);
+void strbufAppendN(ES3StrBuf* buf, const char* source, size_t length);
 
 /**
- * Resizes destination to fit both strings and prepends source to destination
- * @param destination - original string
+ * Appends a string to the end of a string buffer
+ * @param buf - buffer to add to
  * @param source - string to add
- * @return The new string, must be freed
  */
-char* sstrpre(char* destination, const char* source);
+void strbufAppend(ES3StrBuf* buf, const char* source);
 
 /**
- * Wrapper for strcat that resizes the string to fit before calling
- * @param destination - original string
+ * Appends the contents of a string buffer to another and frees the source buffer
+ * @param buf - buffer to add to
+ * @param source - buffer to add, freed after the call
+ */
+void strbufAppendBuf(ES3StrBuf* buf, ES3StrBuf* source);
+
+/**
+ * Prepends a string to the start of a string buffer
+ * @param buf - buffer to add to
  * @param source - string to add
- * @return The new string, must be freed
  */
-char* sstrcat(char* destination, const char* source);
+void strbufPrepend(ES3StrBuf* buf, const char* source);
+
+/**
+ * Wraps the contents of a string buffer, e.g. "a, 1, b" to "esvExpr(a, 1, b)"
+ * @param buf - buffer to wrap
+ * @param before - string to prepend
+ * @param after - string to append
+ */
+void strbufWrap(ES3StrBuf* buf, const char* before, const char* after);
+
+/**
+ * Gets the NUL terminated text of a string buffer
+ * @param buf - the buffer
+ * @return The text, owned by the buffer
+ */
+const char* strbufText(const ES3StrBuf* buf);
+
+/**
+ * Writes the contents of a string buffer to a file
+ * @param buf - the buffer
+ * @param file - file to write to
+ */
+void strbufWrite(const ES3StrBuf* buf, FILE* file);
+
+/**
+ * Frees the memory of a string buffer
+ * @param buf - the buffer
+ */
+void strbufFree(ES3StrBuf* buf);
+
+/**
+ * Creates an empty arena
+ * @param arena - OUT the arena to initialize
+ * @param blockSize - size of the blocks the arena carves allocations out of, larger allocations get their own block
+ */
+void arenaInit(ES3Arena* arena, size_t blockSize);
 
 /**
- * Allocates a new string that is the str repeated by times
- * @param str - char string to be repeated
+ * Allocates memory from an arena, aligned for any type. Exits and errors if out of memory
+ * @param arena - the arena to allocate from
+ * @param size - ammount of memory to be allocated
+ * @return Pointer to the memory, valid until arenaFree
+ */
+void* arenaAlloc(ES3Arena* arena, size_t size);
+
+/**
+ * Allocates a copy of size bytes of memory from an arena
+ * @param arena - the arena to allocate from
+ * @param source - memory to copy
+ * @param size - ammount of memory to copy
+ * @return Pointer to the copy, valid until arenaFree
+ */
+void* arenaDup(ES3Arena* arena, const void* source, size_t size);
+
+/**
+ * Grows an allocation made from an arena, in place if it is the last allocation of the current block
+ * @param arena - the arena it was allocated from
+ * @param old - the allocation, can be NULL
+ * @param oldSize - size of the allocation
+ * @param newSize - new size, not less than oldSize
+ * @return Pointer to the grown allocation, the contents are kept
+ */
+void* arenaGrow(ES3Arena* arena, void* old, size_t oldSize, size_t newSize);
+
+/**
+ * Allocates a string that is str repeated from an arena
+ * @param arena - the arena to allocate from
+ * @param str - string to be repeated
  * @param times - the number of times to repeat str
- * @return The new string, must be freed
+ * @return The new string, valid until arenaFree
  */
-char* str_repeat(char* str, int times);
+char* arenaRepeat(ES3Arena* arena, const char* str, int times);
+
+/**
+ * Frees every allocation made from an arena, the arena can be reused afterwards
+ * @param arena - the arena to free
+ */
+void arenaFree(ES3Arena* arena);
 
 /**
  * Wrapper for realloc that exits and errors if realloc fails
@@ -56,11 +332,192 @@ void* srealloc(void* _Block, size_t size);
  */
 void* smalloc(size_t size);
 
-char* esvToString(ES3Var a);
+/**
+ * Writes chars to the buffered standard output
+ * @param text - the chars, does not need to be NUL terminated
+ * @param length - number of chars
+ */
+void esvWrite(const char* text, size_t length);
+
+/**
+ * Writes a newline to the buffered standard output, flushing it if stdout is a terminal
+ */
+void esvWriteLine(void);
+
+/**
+ * Writes the text form of a var straight into the buffered standard output, strings are quoted
+ * @param a - the var to write
+ */
+void esvWriteVar(ES3Var a);
+
+/**
+ * Hands everything written so far to stdout, called before reading input and before the program ends
+ */
+void esvFlush(void);
+
+/**
+ * Creates an array var holding a copy of a list of values in the current region
+ * @param length - number of values
+ * @param items - the values, can be NULL if length is 0
+ * @return The array var
+ */
+ES3Var esvArrayNew(size_t length, const ES3Var* items);
+
+/**
+ * Moves an array and the arrays it holds to an outer region so they outlive the current one, other vars are left alone
+ * @param a - the var escaping, returned or stored where the current region can't free it
+ * @param region - depth of the region it escapes to
+ * @return a
+ */
+ES3Var esvPromote(ES3Var a, int region);
+
+/**
+ * Gets the interned string with some text, creating it if there isn't one yet
+ * @param text - the chars of the string, does not need to be NUL terminated
+ * @param length - number of chars
+ * @return The string, a new one isn't held by anything until it is stored
+ */
+ES3String* esvStrIntern(const char* text, size_t length);
+
+/**
+ * Gets the string of a string literal, it is interned on first use and never freed
+ * @param cache - OUT where the string is kept between calls, must start as NULL
+ * @param text - the chars of the literal
+ * @param length - number of chars
+ * @return The string
+ */
+ES3String* esvStrLiteral(ES3String** cache, const char* text, size_t length);
+
+/**
+ * Counts a new reference to a var, only strings are counted
+ * @param a - the var being stored
+ * @return a
+ */
+ES3Var esvRetain(ES3Var a);
+
+/**
+ * Drops a reference to a var, a string nothing holds anymore is freed by a later esvCollect
+ * @param a - the var no longer stored
+ */
+void esvRelease(ES3Var a);
+
+/**
+ * Stores a value in a var, counting the new value and releasing the old one
+ * @param target - the var
+ * @param value - the new value
+ */
+void esvAssign(ES3Var* target, ES3Var value);
+
+/**
+ * Stores a value in an array item like esvAssign, arrays are shared so the old value could still be a temporary anywhere
+ * The value is promoted to the region of the array
+ * @param array - the array holding the item
+ * @param item - the array item
+ * @param value - the new value
+ */
+void esvAssignItem(ES3Var array, ES3Var* item, ES3Var value);
+
+/**
+ * Frees the strings that nothing holds and no unfinished statement can still be using, called between statements
+ * Only scans the zero count table once it has grown enough, so calls are amortized O(1)
+ */
+void esvCollect(void);
+
+/**
+ * Gets an item of an array, errors if a isn't an array or index isn't a whole number in range
+ * @param a - the array
+ * @param index - 0 based index of the item
+ * @return Pointer to the item, stays valid as long as the array does
+ */
+ES3Var* esvIndex(ES3Var a, double index);
+
+/**
+ * Gets an item of an array like esvIndex, errors if index isn't a number
+ * @param a - the array
+ * @param index - 0 based index of the item
+ * @return Pointer to the item, stays valid as long as the array does
+ */
+ES3Var* esvIndexVar(ES3Var a, ES3Var index);
+
+// Operators on any types, the ones below only handle numbers and bools themselves and call these for everything else
+ES3Var esvCompSlow(ES3Var a, int op, ES3Var b);
+ES3Var esvTermSlow(ES3Var a, int op, ES3Var b);
+ES3Var esvExprSlow(ES3Var a, int op, ES3Var b);
+ES3Var esvExpoSlow(ES3Var a, int op, ES3Var b);
+
+/*
+ * With ES3_INLINE the operators are static inline so gcc can inline them into a program, and with -flto
+ * into the runtime too. esvutil.c still exports them out of line for code built without it
+ */
+#ifdef ES3_INLINE
+
+#include <math.h>
+
+static inline ES3Var esvComp(ES3Var a, int op, ES3Var b) {
+	if (op == 0) return a;
+	if (ES3_TYPE(a) == 1 && ES3_TYPE(b) == 1) {
+		switch (op) {
+			case 1: return ES3_BOOL(ES3_AS_NUM(a) == ES3_AS_NUM(b));
+			case 2: return ES3_BOOL(ES3_AS_NUM(a) >  ES3_AS_NUM(b));
+			case 3: return ES3_BOOL(ES3_AS_NUM(a) >= ES3_AS_NUM(b));
+			case 4: return ES3_BOOL(ES3_AS_NUM(a) <  ES3_AS_NUM(b));
+			case 5: return ES3_BOOL(ES3_AS_NUM(a) <= ES3_AS_NUM(b));
+		}
+	}
+	if (ES3_TYPE(a) == 3 && ES3_TYPE(b) == 3) {
+		switch (op) {
+			case 1: return ES3_BOOL(ES3_AS_BOOL(a) == ES3_AS_BOOL(b));
+			case 2: return ES3_BOOL(ES3_AS_BOOL(a) >  ES3_AS_BOOL(b));
+			case 3: return ES3_BOOL(ES3_AS_BOOL(a) >= ES3_AS_BOOL(b));
+			case 4: return ES3_BOOL(ES3_AS_BOOL(a) <  ES3_AS_BOOL(b));
+			case 5: return ES3_BOOL(ES3_AS_BOOL(a) <= ES3_AS_BOOL(b));
+		}
+	}
+	return esvCompSlow(a, op, b);
+}
+
+static inline ES3Var esvTerm(ES3Var a, int op, ES3Var b) {
+	if (op == 0) return a;
+	if (ES3_TYPE(a) == 1 && ES3_TYPE(b) == 1) {
+		if (op == 1) return ES3_NUM(ES3_AS_NUM(a) * ES3_AS_NUM(b));
+		if (op == 2) return ES3_NUM(ES3_AS_NUM(a) / ES3_AS_NUM(b));
+	}
+	return esvTermSlow(a, op, b);
+}
+
+static inline ES3Var esvExpr(ES3Var a, int op, ES3Var b) {
+	if (op == 0) return a;
+	if (ES3_TYPE(a) == 1 && ES3_TYPE(b) == 1) {
+		if (op == 1) return ES3_NUM(ES3_AS_NUM(a) + ES3_AS_NUM(b));
+		if (op == 2) return ES3_NUM(ES3_AS_NUM(a) - ES3_AS_NUM(b));
+	}
+	return esvExprSlow(a, op, b);
+}
+
+static inline ES3Var esvExpo(ES3Var a, int op, ES3Var b) {
+	if (op == 0) return a;
+	if (op == 1 && ES3_TYPE(a) == 1 && ES3_TYPE(b) == 1) return ES3_NUM(pow(ES3_AS_NUM(a), ES3_AS_NUM(b)));
+	return esvExpoSlow(a, op, b);
+}
+
+static inline ES3Var esvUnary(ES3Var a) {
+	return ES3_TYPE(a) == 1 ? ES3_NUM(-ES3_AS_NUM(a)) : ES3_NULL;
+}
+
+static inline int esvTruthy(ES3Var a) {
+	if (ES3_TYPE(a) == 1) return ES3_AS_NUM(a) != 0;
+	if (ES3_TYPE(a) == 3) return ES3_AS_BOOL(a);
+	return 0;
+}
+
+#else
 
 ES3Var esvComp(ES3Var a, int op, ES3Var b);
 ES3Var esvTerm(ES3Var a, int op, ES3Var b);
 ES3Var esvExpr(ES3Var a, int op, ES3Var b);
 ES3Var esvExpo(ES3Var a, int op, ES3Var b);
+ES3Var esvUnary(ES3Var a);
+
+int esvTruthy(ES3Var a);
 
-int esvTruthy(ES3Var a);
\ No newline at end of file
+#endif
\ No newline at end of file
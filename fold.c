@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "fold.h"
+#include "enums.h"
+
+// Values of the constants defined in std.c, they have to be kept the same
+static const struct { const char* name; double value; } stdConstants[] = {
+	{ "PI", 3.14159265358979323846 },
+	{ "E", 2.71828182845904523536 },
+	{ "RAD", 0.01745329238474369049072265625 },
+	{ "DEG", 57.295780181884765625 },
+};
+
+/**
+ * Gets the runtime value of a literal or std constant
+ * @param node - an expression node
+ * @param OUT value - the value if it is known
+ * @return 1 if the value is known at compile time, otherwise 0
+ */
+static int constantValue(const ES3Node* node, ES3Var* value) {
+	switch (node->type) {
+		case NODE_NUM:
+			*value = ES3_NUM(node->num);
+			return 1;
+
+		case NODE_BOOL:
+			*value = ES3_BOOL(node->op);
+			return 1;
+
+		case NODE_VAR:
+			// std.c defines these as macros so they can't be shadowed by a var or param
+			for (size_t i = 0; i < sizeof(stdConstants) / sizeof(stdConstants[0]); i++) {
+				if (astTokenIs(node->token, stdConstants[i].name)) {
+					*value = ES3_NUM(stdConstants[i].value);
+					return 1;
+				}
+			}
+			return 0;
+
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Turns a node into a literal of a constant value
+ * @param node - the node to overwrite
+ * @param value - a number or bool
+ */
+static void makeLiteral(ES3Node* node, ES3Var value) {
+	node->type = ES3_TYPE(value) == 1 ? NODE_NUM : NODE_BOOL;
+	node->valueType = ES3_TYPE(value);
+	node->num = ES3_TYPE(value) == 1 ? ES3_AS_NUM(value) : 0;
+	node->op = ES3_TYPE(value) == 3 ? ES3_AS_BOOL(value) : 0;
+	node->left = NULL;
+	node->right = NULL;
+	node->childCount = 0;
+
+	// An empty token tells codegen to print the number instead of copying the source text
+	node->token.length = 0;
+}
+
+/**
+ * Checks that evaluating an expression can't have side effects, so it can be dropped
+ * @param node - an expression node
+ * @return 1 if the expression doesn't call any function, otherwise 0
+ */
+static int isPure(const ES3Node* node) {
+	if (node == NULL) return 1;
+	if (node->type == NODE_CALL) return 0;
+	for (int i = 0; i < node->childCount; i++) {
+		if (!isPure(node->children[i])) return 0;
+	}
+	return isPure(node->left) && isPure(node->right);
+}
+
+/**
+ * Checks if a node is a number literal with a value
+ * @param node - an expression node
+ * @param value - the value to compare against
+ * @return 1 if it is, otherwise 0
+ */
+static int isNumber(const ES3Node* node, double value) {
+	return node->type == NODE_NUM && node->num == value;
+}
+
+/**
+ * Evaluates a binary operator with the same runtime function the generated code would call
+ * @param op - TOKEN_... enum of the operator
+ * @param a - left operand
+ * @param b - right operand
+ * @return The result
+ */
+static ES3Var evalBinary(int op, ES3Var a, ES3Var b) {
+	switch (op) {
+		case TOKEN_ADD: return esvExpr(a, 1, b);
+		case TOKEN_SUB: return esvExpr(a, 2, b);
+		case TOKEN_MUL: return esvTerm(a, 1, b);
+		case TOKEN_DIV: return esvTerm(a, 2, b);
+		case TOKEN_EXP: return esvExpo(a, 1, b);
+		case TOKEN_DEQ: return esvComp(a, 1, b);
+		case TOKEN_GTT: return esvComp(a, 2, b);
+		case TOKEN_GTE: return esvComp(a, 3, b);
+		case TOKEN_LST: return esvComp(a, 4, b);
+		case TOKEN_LSE: return esvComp(a, 5, b);
+		default: return ES3_NULL;
+	}
+}
+
+/**
+ * Simplifies a binary operator with a number literal operand that doesn't change the other operand
+ * @param node - the NODE_BINARY node, its operands are already folded
+ * @return The node that replaces it, or node if it can't be simplified
+ */
+static ES3Node* foldIdentity(ES3Node* node) {
+	ES3Node* left = node->left;
+	ES3Node* right = node->right;
+
+	// Operators on a non number give Null, so x has to be known to be a number
+	switch (node->op) {
+		// x + 0 isn't x for x = -0, as -0 + 0 is +0. x - 0 is always x, but x - -0 is x + 0
+		case TOKEN_SUB:
+			if (left->valueType == TYPE_NUM && isNumber(right, 0) && !signbit(right->num)) return left;
+			break;
+
+		case TOKEN_MUL:
+			if (left->valueType == TYPE_NUM && isNumber(right, 1)) return left;
+			if (right->valueType == TYPE_NUM && isNumber(left, 1)) return right;
+			break;
+
+		case TOKEN_DIV:
+			if (left->valueType == TYPE_NUM && isNumber(right, 1)) return left;
+			break;
+
+		case TOKEN_EXP:
+			if (left->valueType == TYPE_NUM && isNumber(right, 1)) return left;
+			// pow(x, 0) is 1 even for NaN and infinities
+			if (left->valueType == TYPE_NUM && isNumber(right, 0) && isPure(left)) {
+				makeLiteral(node, ES3_NUM(1));
+			}
+			break;
+	}
+	return node;
+}
+
+/**
+ * Folds an expression and the expressions in it
+ * @param node - an expression node
+ * @return The node that replaces it
+ */
+static ES3Node* foldExpr(ES3Node* node) {
+	for (int i = 0; i < node->childCount; i++) {
+		node->children[i] = foldExpr(node->children[i]);
+	}
+
+	ES3Var a;
+	ES3Var b;
+	switch (node->type) {
+		case NODE_NUM:
+			node->valueType = TYPE_NUM;
+			break;
+
+		case NODE_STR:
+			node->valueType = TYPE_STR;
+			break;
+
+		case NODE_BOOL:
+			node->valueType = TYPE_BOOL;
+			break;
+
+		case NODE_ARRAY:
+			node->valueType = TYPE_ARR;
+			break;
+
+		case NODE_VAR:
+			if (constantValue(node, &a)) node->valueType = ES3_TYPE(a);
+			break;
+
+		case NODE_INDEX:
+			node->left = foldExpr(node->left);
+			node->right = foldExpr(node->right);
+			break;
+
+		case NODE_NEG:
+			node->left = foldExpr(node->left);
+			if (constantValue(node->left, &a)) {
+				a = esvUnary(a);
+				if (ES3_TYPE(a) == 1) makeLiteral(node, a);
+			}
+			break;
+
+		case NODE_BINARY:
+			node->left = foldExpr(node->left);
+			node->right = foldExpr(node->right);
+			if (constantValue(node->left, &a) && constantValue(node->right, &b)) {
+				ES3Var result = evalBinary(node->op, a, b);
+
+				// Results with no literal in C like Null or inf are left to the runtime
+				if ((ES3_TYPE(result) == 1 && isfinite(ES3_AS_NUM(result))) || ES3_TYPE(result) == 3) {
+					makeLiteral(node, result);
+				}
+				break;
+			}
+			return foldIdentity(node);
+	}
+	return node;
+}
+
+/**
+ * Folds the expressions in a statement and the statements in it
+ * @param node - a statement, block or function node
+ */
+static void foldStatement(ES3Node* node) {
+	switch (node->type) {
+		case NODE_PROGRAM:
+		case NODE_BLOCK:
+			for (int i = 0; i < node->childCount; i++) {
+				foldStatement(node->children[i]);
+			}
+			break;
+
+		case NODE_FUNC:
+			foldStatement(node->left);
+			break;
+
+		case NODE_LET:
+		case NODE_CALLSTMT:
+		case NODE_RETURN:
+			node->left = foldExpr(node->left);
+			break;
+
+		case NODE_ASSIGN:
+			// The target is left alone, it has to stay an lvalue
+			node->right = foldExpr(node->right);
+			break;
+
+		case NODE_IF:
+		case NODE_WHILE:
+			node->left = foldExpr(node->left);
+			foldStatement(node->right);
+			break;
+	}
+}
+
+void foldProgram(ES3Node* program) {
+	foldStatement(program);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "ast.h"
+
+/**
+ * Folds constant expressions and removes identity operations from a syntax tree in place
+ *  - operators on number and bool literals and the std constants are evaluated with the runtime operators
+ *  - x * 1, x / 1, x - 0, x ^ 1 and x ^ 0 are simplified when x is known to be a number, x + 0 is kept as it is +0 for x = -0
+ * @param program - the NODE_PROGRAM node
+ */
+void foldProgram(ES3Node* program);
@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "infer.h"
+#include "enums.h"
+
+// No value has reached the var yet, only used while inferring
+#define TYPE_NONE -2
+
+typedef struct ES3DeclList_ {
+    ES3Node** items;
+    int count;
+    int capacity;
+} ES3DeclList;
+
+/**
+ * Declarations in the order they were made, with their names hashed into chains so finding one is O(1)
+ * Each chain starts at the newest declaration in it, so inner declarations shadow outer ones, and removing the
+ * newest declarations puts back the chain heads they replaced
+ *  - heads: for each bucket the index of the newest declaration in it, -1 if there is none
+ *  - next: for each declaration the index of the one before it in its bucket
+ */
+typedef struct ES3Names_ {
+    ES3DeclList decls;
+    int* next;
+    int* heads;
+    int headCount;
+} ES3Names;
+
+/**
+ * Declarations while resolving names
+ *  - every: every var and param
+ *  - owners: for each of every the NODE_FUNC it is in, or the NODE_PROGRAM for main
+ *  - owner: the function being resolved
+ */
+typedef struct ES3Scope_ {
+    ES3Names visible;
+    ES3DeclList every;
+    ES3DeclList owners;
+    ES3Names functions;
+
+    ES3Node* owner;
+    ES3Arena* arena;
+} ES3Scope;
+
+/**
+ * Where inference is at, each function and main is inferred on its own until its types stop changing
+ *  - changed: a var or param of the function being inferred changed, so it needs another pass
+ *  - queue: functions to infer again as the type of one of their params changed, main is the NODE_PROGRAM
+ */
+typedef struct ES3Infer_ {
+    int changed;
+    ES3DeclList queue;
+    ES3Arena* arena;
+} ES3Infer;
+
+/**
+ * Adds a node to the end of a list
+ * @param arena - arena the list is allocated from
+ * @param list - the list
+ * @param node - the node to add
+ */
+static void declListPush(ES3Arena* arena, ES3DeclList* list, ES3Node* node) {
+	if (list->count == list->capacity) {
+		int capacity = list->capacity ? list->capacity * 2 : 16;
+		list->items = arenaGrow(arena, list->items, sizeof(ES3Node*) * list->capacity, sizeof(ES3Node*) * capacity);
+		list->capacity = capacity;
+	}
+	list->items[list->count++] = node;
+}
+
+/**
+ * Checks if two tokens have the same text
+ * @param a - first token
+ * @param b - second token
+ * @return 1 if they are equal, otherwise 0
+ */
+static int tokensEqual(ES3Token a, ES3Token b) {
+	return a.length == b.length && !memcmp(a.start, b.start, a.length);
+}
+
+/**
+ * Gets the bucket of a name
+ * @param names - the names
+ * @param token - the name token
+ * @return Index into names->heads
+ */
+static int namesBucket(const ES3Names* names, ES3Token token) {
+	// FNV-1a
+	unsigned hash = 2166136261u;
+	for (int i = 0; i < token.length; i++) hash = (hash ^ (unsigned char) token.start[i]) * 16777619u;
+	return (int) (hash & (unsigned) (names->headCount - 1));
+}
+
+/**
+ * Adds a declaration, it shadows any with the same name
+ * @param arena - arena the names are allocated from
+ * @param names - the names
+ * @param decl - the declaration
+ */
+static void namesPush(ES3Arena* arena, ES3Names* names, ES3Node* decl) {
+	int oldCapacity = names->decls.capacity;
+	declListPush(arena, &names->decls, decl);
+	if (names->decls.capacity != oldCapacity) {
+		names->next = arenaGrow(arena, names->next, sizeof(int) * oldCapacity, sizeof(int) * names->decls.capacity);
+	}
+
+	// Rehashed from the oldest so every chain stays newest first
+	int from = names->decls.count - 1;
+	if (names->decls.count > names->headCount) {
+		names->headCount = names->headCount ? names->headCount * 2 : 64;
+		names->heads = arenaAlloc(arena, sizeof(int) * names->headCount);
+		for (int i = 0; i < names->headCount; i++) names->heads[i] = -1;
+		from = 0;
+	}
+	for (int i = from; i < names->decls.count; i++) {
+		int bucket = namesBucket(names, names->decls.items[i]->token);
+		names->next[i] = names->heads[bucket];
+		names->heads[bucket] = i;
+	}
+}
+
+/**
+ * Removes the newest declarations
+ * @param names - the names
+ * @param count - number of declarations to keep
+ */
+static void namesTruncate(ES3Names* names, int count) {
+	while (names->decls.count > count) {
+		int i = --names->decls.count;
+		names->heads[namesBucket(names, names->decls.items[i]->token)] = names->next[i];
+	}
+}
+
+/**
+ * Finds the newest declaration of a name
+ * @param names - the names
+ * @param token - the name token
+ * @return The declaration, or NULL if there is none
+ */
+static ES3Node* namesFind(const ES3Names* names, ES3Token token) {
+	if (names->headCount == 0) return NULL;
+	for (int i = names->heads[namesBucket(names, token)]; i >= 0; i = names->next[i]) {
+		if (tokensEqual(names->decls.items[i]->token, token)) return names->decls.items[i];
+	}
+	return NULL;
+}
+
+/**
+ * Adds a declaration to the innermost scope
+ * @param scope - the scope stack
+ * @param decl - the NODE_LET or param node
+ */
+static void scopePush(ES3Scope* scope, ES3Node* decl) {
+	namesPush(scope->arena, &scope->visible, decl);
+	declListPush(scope->arena, &scope->every, decl);
+	declListPush(scope->arena, &scope->owners, scope->owner);
+	decl->valueType = TYPE_NONE;
+}
+
+/**
+ * Links the names used in an expression to their declarations
+ * @param scope - the scope stack
+ * @param node - an expression node
+ */
+static void resolveExpr(ES3Scope* scope, ES3Node* node) {
+	if (node == NULL) return;
+
+	// Inner scopes shadow outer ones like in the emitted C
+	if (node->type == NODE_VAR) node->decl = namesFind(&scope->visible, node->token);
+	// NULL for std functions
+	if (node->type == NODE_CALL) node->decl = namesFind(&scope->functions, node->token);
+
+	for (int i = 0; i < node->childCount; i++) {
+		resolveExpr(scope, node->children[i]);
+	}
+	resolveExpr(scope, node->left);
+	resolveExpr(scope, node->right);
+}
+
+/**
+ * Links the names used in a statement to their declarations
+ * @param scope - the scope stack
+ * @param node - a statement, block or function node
+ */
+static void resolveStatement(ES3Scope* scope, ES3Node* node) {
+	int outer = scope->visible.decls.count;
+
+	switch (node->type) {
+		case NODE_PROGRAM:
+		case NODE_BLOCK:
+			for (int i = 0; i < node->childCount; i++) {
+				resolveStatement(scope, node->children[i]);
+			}
+			break;
+
+		case NODE_FUNC: {
+			ES3Node* owner = scope->owner;
+			scope->owner = node;
+			for (int i = 0; i < node->childCount; i++) {
+				scopePush(scope, node->children[i]);
+			}
+			resolveStatement(scope, node->left);
+			// Main's statements come after the functions and belong to the program
+			scope->owner = owner;
+			break;
+		}
+
+		case NODE_LET:
+			// Like in C the var is in scope in its own initializer
+			scopePush(scope, node);
+			resolveExpr(scope, node->left);
+			return;
+
+		case NODE_ASSIGN:
+			resolveExpr(scope, node->left);
+			resolveExpr(scope, node->right);
+			return;
+
+		case NODE_CALLSTMT:
+		case NODE_RETURN:
+			resolveExpr(scope, node->left);
+			return;
+
+		case NODE_IF:
+		case NODE_WHILE:
+			resolveExpr(scope, node->left);
+			resolveStatement(scope, node->right);
+			return;
+	}
+
+	// Programs, functions and blocks end a scope
+	namesTruncate(&scope->visible, outer);
+}
+
+/**
+ * Combines the type a var already has with the type of a new value
+ * @param decl - the NODE_LET or param node
+ * @param type - type of the value
+ * @param length - least length of the value if it is an array
+ * @return 1 if the type of the var changed, otherwise 0
+ */
+static int joinType(ES3Node* decl, int type, int length) {
+	if (type == TYPE_NONE) return 0;
+
+	if (decl->valueType == TYPE_NONE) {
+		decl->valueType = type;
+		decl->length = length;
+		return 1;
+	}
+	if (decl->valueType != type) {
+		int changed = decl->valueType != TYPE_UNKNOWN;
+		decl->valueType = TYPE_UNKNOWN;
+		return changed;
+	}
+	if (type == TYPE_ARR && length < decl->length) {
+		decl->length = length;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Queues a function or main to be inferred again
+ * @param infer - the inference state
+ * @param unit - the NODE_FUNC, or the NODE_PROGRAM for main
+ */
+static void inferQueue(ES3Infer* infer, ES3Node* unit) {
+	// A call in a loop passes to the same function over and over
+	if (infer->queue.count && infer->queue.items[infer->queue.count - 1] == unit) return;
+	declListPush(infer->arena, &infer->queue, unit);
+}
+
+/**
+ * Infers the type of an expression from the current types of vars and passes the args of calls to params
+ * @param node - an expression node
+ * @param infer - the inference state, the called function is queued if the type of one of its params changed
+ * @return The TYPE_... enum, or TYPE_NONE if it depends on a var no value has reached yet
+ */
+static int inferExpr(ES3Node* node, ES3Infer* infer) {
+	for (int i = 0; i < node->childCount; i++) {
+		int argType = inferExpr(node->children[i], infer);
+		if (node->type == NODE_CALL && node->decl && i < node->decl->childCount) {
+			if (joinType(node->decl->children[i], argType, node->children[i]->length)) inferQueue(infer, node->decl);
+		}
+	}
+
+	int type = TYPE_UNKNOWN;
+	switch (node->type) {
+		case NODE_NUM:
+			type = TYPE_NUM;
+			break;
+
+		case NODE_BOOL:
+			type = TYPE_BOOL;
+			break;
+
+		case NODE_ARRAY:
+			type = TYPE_ARR;
+			node->length = node->childCount;
+			break;
+
+		case NODE_VAR:
+			if (node->decl) {
+				type = node->decl->valueType;
+				node->length = node->decl->length;
+			} else if (astTokenIs(node->token, "PI") || astTokenIs(node->token, "E") || astTokenIs(node->token, "RAD") || astTokenIs(node->token, "DEG")) {
+				type = TYPE_NUM;
+			}
+			break;
+
+		case NODE_INDEX:
+			inferExpr(node->left, infer);
+			inferExpr(node->right, infer);
+			break;
+
+		case NODE_NEG: {
+			int operand = inferExpr(node->left, infer);
+			if (operand == TYPE_NUM || operand == TYPE_NONE) type = operand;
+			break;
+		}
+
+		case NODE_BINARY: {
+			int left = inferExpr(node->left, infer);
+			int right = inferExpr(node->right, infer);
+			if (left == TYPE_UNKNOWN || right == TYPE_UNKNOWN) break;
+			if (left == TYPE_NONE || right == TYPE_NONE) {
+				type = TYPE_NONE;
+				break;
+			}
+
+			// The runtime operators give Null when the operand types don't fit
+			switch (node->op) {
+				case TOKEN_ADD:
+				case TOKEN_SUB:
+				case TOKEN_MUL:
+				case TOKEN_DIV:
+				case TOKEN_EXP:
+					if (left == TYPE_NUM && right == TYPE_NUM) type = TYPE_NUM;
+					break;
+
+				default:
+					if (left == right && (left == TYPE_NUM || left == TYPE_BOOL)) type = TYPE_BOOL;
+					break;
+			}
+			break;
+		}
+	}
+
+	node->valueType = type;
+	return type;
+}
+
+/**
+ * Passes the values in a statement to the vars and params they are stored in
+ * @param node - a statement, block or function node, for the program only main is inferred
+ * @param infer - the inference state, changed is set if the type of a var in the statement changed
+ */
+static void inferStatement(ES3Node* node, ES3Infer* infer) {
+	switch (node->type) {
+		case NODE_PROGRAM:
+		case NODE_BLOCK:
+			for (int i = 0; i < node->childCount; i++) {
+				if (node->children[i]->type != NODE_FUNC) inferStatement(node->children[i], infer);
+			}
+			break;
+
+		case NODE_FUNC:
+			inferStatement(node->left, infer);
+			break;
+
+		case NODE_LET: {
+			int type = inferExpr(node->left, infer);
+			infer->changed |= joinType(node, type, node->left->length);
+			break;
+		}
+
+		case NODE_ASSIGN: {
+			int type = inferExpr(node->right, infer);
+			inferExpr(node->left, infer);
+			if (node->left->type == NODE_VAR && node->left->decl) infer->changed |= joinType(node->left->decl, type, node->right->length);
+			break;
+		}
+
+		case NODE_CALLSTMT:
+		case NODE_RETURN:
+			inferExpr(node->left, infer);
+			break;
+
+		case NODE_IF:
+		case NODE_WHILE:
+			inferExpr(node->left, infer);
+			inferStatement(node->right, infer);
+			break;
+	}
+}
+
+/**
+ * Boxes every var or param no value reaches, like the params of a function that is never called, and queues
+ * the functions they are in
+ * @param scope - the scope holding every declaration
+ * @param infer - the inference state
+ */
+static void boxUnreached(ES3Scope* scope, ES3Infer* infer) {
+	for (int i = 0; i < scope->every.count; i++) {
+		if (scope->every.items[i]->valueType == TYPE_NONE) {
+			scope->every.items[i]->valueType = TYPE_UNKNOWN;
+			inferQueue(infer, scope->owners.items[i]);
+		}
+	}
+}
+
+void inferProgram(ES3Node* program, ES3Arena* arena) {
+	ES3Scope scope = { .owner = program, .arena = arena };
+	// Pushed in reverse so a name defined twice finds its first definition
+	for (int i = program->childCount - 1; i >= 0; i--) {
+		if (program->children[i]->type == NODE_FUNC) namesPush(arena, &scope.functions, program->children[i]);
+	}
+	resolveStatement(&scope, program);
+
+	// Types only go from none, to number or bool, to unknown so this reaches a fixed point. Vars only get
+	// values from their own function and params only from calls, so a function is only inferred again when
+	// one of its params changed instead of passing over the whole program until nothing changes
+	ES3Infer infer = { .arena = arena };
+	for (int i = program->childCount - 1; i >= 0; i--) {
+		if (program->children[i]->type == NODE_FUNC) inferQueue(&infer, program->children[i]);
+	}
+	inferQueue(&infer, program);
+	do {
+		while (infer.queue.count) {
+			ES3Node* unit = infer.queue.items[--infer.queue.count];
+			do {
+				infer.changed = 0;
+				inferStatement(unit, &infer);
+			} while (infer.changed);
+		}
+		boxUnreached(&scope, &infer);
+	} while (infer.queue.count);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ast.h"
+
+/**
+ * Infers which vars and params are always numbers or always bools so codegen can keep them unboxed
+ *  - links every NODE_VAR to its declaration and every NODE_CALL to its function
+ *  - sets valueType of lets and params to TYPE_NUM, TYPE_BOOL or TYPE_ARR if every value they get has that type, otherwise TYPE_UNKNOWN
+ *  - sets valueType of expressions to TYPE_NUM, TYPE_BOOL or TYPE_ARR if they always evaluate to that type, otherwise TYPE_UNKNOWN
+ *  - sets length of arrays to the least number of items they can have, arrays never change length so this bounds indexes
+ * @param program - the NODE_PROGRAM node
+ * @param arena - arena the scope lists are allocated from
+ */
+void inferProgram(ES3Node* program, ES3Arena* arena);
@@ -0,0 +1,585 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "jit.h"
+#include "vm.h"
+
+// Machine code is only emitted for x86-64, elsewhere jitNew returns NULL and everything stays in the VM
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X64
+#endif
+
+// Size of the executable memory shared by every compiled function
+#define JIT_CODE_SIZE (1 << 20)
+
+// Register the first arg of a function is passed in, rcx for the Windows calling convention and rdi for System V
+#ifdef _WIN32
+#define JIT_ARG_REG 1
+#else
+#define JIT_ARG_REG 7
+#endif
+
+// Bytes under the registers of a frame, Windows wants 32 bytes of shadow space for the callee below every call
+#define JIT_SHADOW 32
+
+// What ES3Jit.stack is set to by a call that ran out of stack, every compiled function it returns through returns at once
+#define JIT_OUT_OF_STACK INT_MAX
+
+typedef struct ES3JitBuf_ {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+} ES3JitBuf;
+
+/**
+ * A rel32 operand of a jump that is filled in once every instruction has its offset
+ *  - pos: offset of the rel32 in the machine code
+ *  - target: index of the instruction it jumps to
+ */
+typedef struct ES3JitFixup_ {
+    size_t pos;
+    int target;
+} ES3JitFixup;
+
+/**
+ * Gets the C function a std function that maps a number to a number is, for calling it from machine code
+ * @param index - index of the std function
+ * @return The function, NULL for std functions that don't work on numbers
+ */
+static double (*jitStdFunction(int index))(double) {
+	const char* name = vmStdName(index);
+	if (strcmp(name, "sqrt") == 0) return sqrt;
+	if (strcmp(name, "sin") == 0) return sin;
+	if (strcmp(name, "cos") == 0) return cos;
+	if (strcmp(name, "tan") == 0) return tan;
+	return NULL;
+}
+
+/**
+ * Finds the instructions of a function that can run
+ * @param func - the function
+ * @param OUT reachable - one flag per instruction
+ */
+static void jitReachable(const ES3Function* func, char* reachable) {
+	int* work = smalloc(sizeof(int) * (func->codeCount + 1));
+	int count = 0;
+
+	memset(reachable, 0, func->codeCount);
+	work[count++] = 0;
+	reachable[0] = 1;
+	while (count > 0) {
+		int i = work[--count];
+		const ES3Instr* instr = &func->code[i];
+
+		int next[2];
+		int nextCount = 0;
+		if (instr->op != OP_JMP && instr->op != OP_RETURN && instr->op != OP_HALT && i + 1 < func->codeCount) next[nextCount++] = i + 1;
+		if (instr->op == OP_JMP || instr->op == OP_JMPF || (instr->op >= OP_JNEQN && instr->op <= OP_JNLEN)) next[nextCount++] = instr->target;
+
+		for (int j = 0; j < nextCount; j++) {
+			if (reachable[next[j]]) continue;
+			reachable[next[j]] = 1;
+			work[count++] = next[j];
+		}
+	}
+
+	free(work);
+}
+
+/**
+ * Checks if a register a function reads always holds a number, lets and temporaries only ever get numbers
+ * in a function that passes jitCheck, so only the constants have to be looked at
+ * @param func - the function
+ * @param reg - the register
+ * @return 1 if it does, otherwise 0
+ */
+static int jitNumberRegister(const ES3Function* func, int reg) {
+	if (reg < func->constBase || reg >= func->constBase + func->constCount) return 1;
+	return ES3_TYPE(func->consts[reg - func->constBase]) == 1;
+}
+
+/**
+ * Checks if the instructions of a function can all be compiled to templates working on doubles
+ * The functions it calls are checked by the caller
+ * @param bytecode - the bytecode
+ * @param func - the function
+ * @param reachable - flags from jitReachable
+ * @return 1 if they can, otherwise 0
+ */
+static int jitCheck(const ES3Bytecode* bytecode, const ES3Function* func, const char* reachable) {
+	if (func->params > JIT_MAX_PARAMS || func->regCount > JIT_MAX_REGISTERS) return 0;
+
+	for (int i = 0; i < func->codeCount; i++) {
+		if (!reachable[i]) continue;
+		const ES3Instr* instr = &func->code[i];
+
+		switch (instr->op) {
+			case OP_MOVE:
+			case OP_NEG:
+			case OP_NEGN:
+				if (!jitNumberRegister(func, instr->b)) return 0;
+				break;
+
+			case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+			case OP_ADDN: case OP_SUBN: case OP_MULN: case OP_DIVN: case OP_POWN:
+			case OP_JNEQN: case OP_JNGTN: case OP_JNGEN: case OP_JNLTN: case OP_JNLEN:
+				if (!jitNumberRegister(func, instr->b) || !jitNumberRegister(func, instr->c)) return 0;
+				break;
+
+			case OP_JMPF:
+			case OP_RESULT:
+				// Loop regions are only entered by loops that make arrays
+				if (instr->op == OP_RESULT && instr->b != 0) return 0;
+				if (!jitNumberRegister(func, instr->a)) return 0;
+				break;
+
+			case OP_CALL:
+				for (int j = 0; j < bytecode->functions[instr->b].params; j++) {
+					if (!jitNumberRegister(func, instr->c + j)) return 0;
+				}
+				break;
+
+			case OP_STD:
+				if (jitStdFunction(instr->b) == NULL || !jitNumberRegister(func, instr->c)) return 0;
+				break;
+
+			// Numbers aren't counted or collected
+			case OP_JMP:
+			case OP_RETAIN:
+			case OP_RELEASE:
+			case OP_COLLECT:
+			case OP_RETURN:
+				break;
+
+			// Bools, arrays, strings, regions and the end of the program
+			default:
+				return 0;
+		}
+	}
+	return 1;
+}
+
+static void bufByte(ES3JitBuf* buf, unsigned char byte) {
+	if (buf->length == buf->capacity) {
+		buf->capacity = buf->capacity ? buf->capacity * 2 : 256;
+		buf->data = srealloc(buf->data, buf->capacity);
+	}
+	buf->data[buf->length++] = byte;
+}
+
+static void bufBytes(ES3JitBuf* buf, const char* bytes, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		bufByte(buf, (unsigned char) bytes[i]);
+	}
+}
+
+static void bufInt32(ES3JitBuf* buf, int32_t value) {
+	for (int i = 0; i < 4; i++) {
+		bufByte(buf, (unsigned char) ((uint32_t) value >> (i * 8)));
+	}
+}
+
+static void bufInt64(ES3JitBuf* buf, uint64_t value) {
+	for (int i = 0; i < 8; i++) {
+		bufByte(buf, (unsigned char) (value >> (i * 8)));
+	}
+}
+
+/**
+ * Emits an SSE2 instruction whose memory operand is a register of the frame, e.g. movsd xmm0, [rsp + disp]
+ * @param buf - the machine code
+ * @param prefix - 0xF2 for scalar double instructions, 0x66 for packed double ones
+ * @param opcode - the byte after 0x0F
+ * @param xmm - xmm0 to xmm7
+ * @param reg - the bytecode register
+ */
+static void emitSse(ES3JitBuf* buf, unsigned char prefix, unsigned char opcode, int xmm, int reg) {
+	bufByte(buf, prefix);
+	bufByte(buf, 0x0F);
+	bufByte(buf, opcode);
+	// mod 10 with a SIB byte for rsp and a disp32
+	bufByte(buf, 0x84 | (xmm << 3));
+	bufByte(buf, 0x24);
+	bufInt32(buf, JIT_SHADOW + reg * 8);
+}
+
+// movsd xmm, [rsp + disp]
+static void emitLoad(ES3JitBuf* buf, int xmm, int reg) {
+	emitSse(buf, 0xF2, 0x10, xmm, reg);
+}
+
+// movsd [rsp + disp], xmm
+static void emitStore(ES3JitBuf* buf, int xmm, int reg) {
+	emitSse(buf, 0xF2, 0x11, xmm, reg);
+}
+
+/**
+ * Emits a jump to an instruction of the bytecode
+ * @param buf - the machine code
+ * @param fixups - OUT where the rel32 is recorded
+ * @param fixupCount - OUT number of fixups
+ * @param opcode - 0xE9 for jmp, otherwise the second byte of a 0x0F jcc
+ * @param target - index of the instruction
+ */
+static void emitJump(ES3JitBuf* buf, ES3JitFixup* fixups, int* fixupCount, unsigned char opcode, int target) {
+	if (opcode != 0xE9) bufByte(buf, 0x0F);
+	bufByte(buf, opcode);
+	fixups[*fixupCount].pos = buf->length;
+	fixups[*fixupCount].target = target;
+	(*fixupCount)++;
+	bufInt32(buf, 0);
+}
+
+/**
+ * Emits a call to a C function that takes and returns doubles
+ * @param buf - the machine code
+ * @param function - address of the function
+ */
+static void emitCallC(ES3JitBuf* buf, const void* function) {
+	// mov rax, imm64; call rax
+	bufBytes(buf, "\x48\xB8", 2);
+	bufInt64(buf, (uint64_t) (uintptr_t) function);
+	bufBytes(buf, "\xFF\xD0", 2);
+}
+
+/**
+ * Compiles a function that passed jitCheck, the calls in it go through the entries of the JIT
+ * @param jit - the JIT
+ * @param func - the function
+ * @param reachable - flags from jitReachable
+ * @param OUT buf - the machine code, jumps are relative so it can be copied anywhere
+ */
+static void jitEmit(ES3Jit* jit, const ES3Function* func, const char* reachable, ES3JitBuf* buf) {
+	size_t* offsets = smalloc(sizeof(size_t) * func->codeCount);
+	// Jumps emit at most two fixups
+	ES3JitFixup* fixups = smalloc(sizeof(ES3JitFixup) * (func->codeCount * 2 + 1));
+	int fixupCount = 0;
+
+	// push rbp; mov rbp, rsp; sub rsp, frame. rsp stays 16 byte aligned for calls
+	int frame = (JIT_SHADOW + func->regCount * 8 + 15) & ~15;
+	bufBytes(buf, "\x55\x48\x89\xE5\x48\x81\xEC", 7);
+	bufInt32(buf, frame);
+
+	/*
+	 * Deep recursion would overflow the C stack, which is much smaller than the stack of the VM. Frames are counted in
+	 * jit->stack with the return address and rbp: mov rax, &jit->stack; add dword [rax], size; cmp dword [rax], limit;
+	 * jle +8; mov dword [rax], JIT_OUT_OF_STACK; leave; ret
+	 */
+	bufBytes(buf, "\x48\xB8", 2);
+	bufInt64(buf, (uint64_t) (uintptr_t) &jit->stack);
+	bufBytes(buf, "\x81\x00", 2);
+	bufInt32(buf, frame + 16);
+	bufBytes(buf, "\x81\x38", 2);
+	bufInt32(buf, JIT_MAX_STACK);
+	bufBytes(buf, "\x7E\x08\xC7\x00", 4);
+	bufInt32(buf, JIT_OUT_OF_STACK);
+	bufBytes(buf, "\xC9\xC3", 2);
+
+	// Copy the args in: mov rax, [arg + i * 8]; mov [rsp + disp], rax
+	for (int i = 0; i < func->params; i++) {
+		bufBytes(buf, "\x48\x8B", 2);
+		bufByte(buf, 0x80 | JIT_ARG_REG);
+		bufInt32(buf, i * 8);
+		bufBytes(buf, "\x48\x89\x84\x24", 4);
+		bufInt32(buf, JIT_SHADOW + i * 8);
+	}
+
+	// The constants are immediates: mov rax, imm64; mov [rsp + disp], rax
+	for (int i = 0; i < func->constCount; i++) {
+		if (ES3_TYPE(func->consts[i]) != 1) continue;
+		double value = ES3_AS_NUM(func->consts[i]);
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(double));
+		bufBytes(buf, "\x48\xB8", 2);
+		bufInt64(buf, bits);
+		bufBytes(buf, "\x48\x89\x84\x24", 4);
+		bufInt32(buf, JIT_SHADOW + (func->constBase + i) * 8);
+	}
+
+	for (int i = 0; i < func->codeCount; i++) {
+		offsets[i] = buf->length;
+		if (!reachable[i]) continue;
+		const ES3Instr* instr = &func->code[i];
+
+		switch (instr->op) {
+			case OP_MOVE:
+				emitLoad(buf, 0, instr->b);
+				emitStore(buf, 0, instr->a);
+				break;
+
+			case OP_ADD: case OP_ADDN:
+			case OP_SUB: case OP_SUBN:
+			case OP_MUL: case OP_MULN:
+			case OP_DIV: case OP_DIVN: {
+				int op = instr->op >= OP_ADDN ? instr->op - (OP_ADDN - OP_ADD) : instr->op;
+				// addsd, subsd, mulsd and divsd
+				static const unsigned char opcodes[] = { [OP_ADD] = 0x58, [OP_SUB] = 0x5C, [OP_MUL] = 0x59, [OP_DIV] = 0x5E };
+				emitLoad(buf, 0, instr->b);
+				emitSse(buf, 0xF2, opcodes[op], 0, instr->c);
+				emitStore(buf, 0, instr->a);
+				break;
+			}
+
+			case OP_POW:
+			case OP_POWN:
+				emitLoad(buf, 0, instr->b);
+				emitLoad(buf, 1, instr->c);
+				emitCallC(buf, (const void*) pow);
+				emitStore(buf, 0, instr->a);
+				break;
+
+			case OP_NEG:
+			case OP_NEGN:
+				// Flip the sign bit: mov rax, [b]; btc rax, 63; mov [a], rax
+				bufBytes(buf, "\x48\x8B\x84\x24", 4);
+				bufInt32(buf, JIT_SHADOW + instr->b * 8);
+				bufBytes(buf, "\x48\x0F\xBA\xF8\x3F", 5);
+				bufBytes(buf, "\x48\x89\x84\x24", 4);
+				bufInt32(buf, JIT_SHADOW + instr->a * 8);
+				break;
+
+			case OP_JMP:
+				emitJump(buf, fixups, &fixupCount, 0xE9, instr->target);
+				break;
+
+			case OP_JMPF:
+				// 0 is the only falsy number, NaN is unordered and truthy: xorpd xmm1, xmm1; ucomisd xmm0, xmm1; jp +6; je
+				emitLoad(buf, 0, instr->a);
+				bufBytes(buf, "\x66\x0F\x57\xC9\x66\x0F\x2E\xC1\x7A\x06", 10);
+				emitJump(buf, fixups, &fixupCount, 0x84, instr->target);
+				break;
+
+			case OP_JNEQN:
+				// Not equal when unordered or ZF is clear
+				emitLoad(buf, 0, instr->b);
+				emitSse(buf, 0x66, 0x2E, 0, instr->c);
+				emitJump(buf, fixups, &fixupCount, 0x8A, instr->target);
+				emitJump(buf, fixups, &fixupCount, 0x85, instr->target);
+				break;
+
+			case OP_JNGTN:
+			case OP_JNGEN:
+				// ucomisd b, c sets CF when b < c or unordered, so jb and jbe also jump for NaN
+				emitLoad(buf, 0, instr->b);
+				emitSse(buf, 0x66, 0x2E, 0, instr->c);
+				emitJump(buf, fixups, &fixupCount, instr->op == OP_JNGTN ? 0x86 : 0x82, instr->target);
+				break;
+
+			case OP_JNLTN:
+			case OP_JNLEN:
+				// b < c is c > b
+				emitLoad(buf, 0, instr->c);
+				emitSse(buf, 0x66, 0x2E, 0, instr->b);
+				emitJump(buf, fixups, &fixupCount, instr->op == OP_JNLTN ? 0x86 : 0x82, instr->target);
+				break;
+
+			case OP_CALL:
+				// lea arg, [rsp + disp]; mov rax, &entry; call [rax]
+				bufBytes(buf, "\x48\x8D", 2);
+				bufByte(buf, 0x84 | (JIT_ARG_REG << 3));
+				bufByte(buf, 0x24);
+				bufInt32(buf, JIT_SHADOW + instr->c * 8);
+				bufBytes(buf, "\x48\xB8", 2);
+				bufInt64(buf, (uint64_t) (uintptr_t) &jit->entries[instr->b]);
+				bufBytes(buf, "\xFF\x10", 2);
+				// Return if the callee ran out of stack: mov rax, &jit->stack; cmp dword [rax], limit; jle +2; leave; ret
+				bufBytes(buf, "\x48\xB8", 2);
+				bufInt64(buf, (uint64_t) (uintptr_t) &jit->stack);
+				bufBytes(buf, "\x81\x38", 2);
+				bufInt32(buf, JIT_MAX_STACK);
+				bufBytes(buf, "\x7E\x02\xC9\xC3", 4);
+				emitStore(buf, 0, instr->a);
+				break;
+
+			case OP_STD:
+				emitLoad(buf, 0, instr->c);
+				emitCallC(buf, (const void*) jitStdFunction(instr->b));
+				emitStore(buf, 0, instr->a);
+				break;
+
+			case OP_RESULT:
+				// Stays in xmm0 through the releases, which emit nothing
+				emitLoad(buf, 0, instr->a);
+				break;
+
+			case OP_RETURN:
+				// mov rax, &jit->stack; sub dword [rax], size; leave; ret
+				bufBytes(buf, "\x48\xB8", 2);
+				bufInt64(buf, (uint64_t) (uintptr_t) &jit->stack);
+				bufBytes(buf, "\x81\x28", 2);
+				bufInt32(buf, frame + 16);
+				bufBytes(buf, "\xC9\xC3", 2);
+				break;
+		}
+	}
+
+	for (int i = 0; i < fixupCount; i++) {
+		int32_t rel = (int32_t) (offsets[fixups[i].target] - (fixups[i].pos + 4));
+		memcpy(buf->data + fixups[i].pos, &rel, sizeof(int32_t));
+	}
+
+	free(offsets);
+	free(fixups);
+}
+
+/**
+ * Compiles a function and the functions it calls that aren't compiled yet, if all of them can be
+ * Functions that can't be compiled are never tried again
+ * @param jit - the JIT
+ * @param root - index of the hot function
+ */
+static void jitCompile(ES3Jit* jit, int root) {
+	const ES3Bytecode* bytecode = jit->bytecode;
+	int count = bytecode->count;
+
+	// Functions reachable through calls, in the order they were found
+	int* found = smalloc(sizeof(int) * count);
+	char* isFound = calloc(count, 1);
+	char* ok = calloc(count, 1);
+	char** reachable = calloc(count, sizeof(char*));
+	if (isFound == NULL || ok == NULL || reachable == NULL) genericError(1, "Out of memory!");
+
+	int foundCount = 0;
+	found[foundCount++] = root;
+	isFound[root] = 1;
+	for (int n = 0; n < foundCount; n++) {
+		int f = found[n];
+		const ES3Function* func = &bytecode->functions[f];
+		reachable[f] = smalloc(func->codeCount);
+		jitReachable(func, reachable[f]);
+		ok[f] = jit->calls[f] >= 0 && f != bytecode->main && jitCheck(bytecode, func, reachable[f]);
+		if (!ok[f]) continue;
+
+		for (int i = 0; i < func->codeCount; i++) {
+			int callee = func->code[i].b;
+			if (!reachable[f][i] || func->code[i].op != OP_CALL || isFound[callee] || jit->entries[callee] != NULL) continue;
+			isFound[callee] = 1;
+			found[foundCount++] = callee;
+		}
+	}
+
+	// A function can only be compiled if everything it calls is, recursive calls are fine
+	for (int changed = 1; changed;) {
+		changed = 0;
+		for (int n = 0; n < foundCount; n++) {
+			int f = found[n];
+			if (!ok[f]) continue;
+			const ES3Function* func = &bytecode->functions[f];
+			for (int i = 0; i < func->codeCount; i++) {
+				int callee = func->code[i].b;
+				if (!reachable[f][i] || func->code[i].op != OP_CALL || jit->entries[callee] != NULL || ok[callee]) continue;
+				ok[f] = 0;
+				changed = 1;
+				break;
+			}
+		}
+	}
+
+	ES3JitBuf* bufs = calloc(count, sizeof(ES3JitBuf));
+	if (bufs == NULL) genericError(1, "Out of memory!");
+	size_t total = 0;
+	for (int n = 0; n < foundCount; n++) {
+		int f = found[n];
+		if (!ok[f]) {
+			jit->calls[f] = -1;
+			continue;
+		}
+		if (!ok[root]) continue;
+		jitEmit(jit, &bytecode->functions[f], reachable[f], &bufs[f]);
+		// Keeps every function 16 byte aligned
+		total += (bufs[f].length + 15) & ~(size_t) 15;
+	}
+
+	if (ok[root] && jit->used + total > jit->capacity) {
+		// Out of executable memory, the rest of the program stays in the VM
+		for (int n = 0; n < foundCount; n++) {
+			jit->calls[found[n]] = -1;
+		}
+	} else if (ok[root]) {
+#ifdef _WIN32
+		DWORD protect;
+		VirtualProtect(jit->code, jit->capacity, PAGE_READWRITE, &protect);
+#else
+		mprotect(jit->code, jit->capacity, PROT_READ | PROT_WRITE);
+#endif
+		for (int n = 0; n < foundCount; n++) {
+			int f = found[n];
+			if (!ok[f]) continue;
+			memcpy(jit->code + jit->used, bufs[f].data, bufs[f].length);
+			jit->entries[f] = (ES3JitEntry) (void*) (jit->code + jit->used);
+			jit->used += (bufs[f].length + 15) & ~(size_t) 15;
+		}
+#ifdef _WIN32
+		VirtualProtect(jit->code, jit->capacity, PAGE_EXECUTE_READ, &protect);
+		FlushInstructionCache(GetCurrentProcess(), jit->code, jit->capacity);
+#else
+		mprotect(jit->code, jit->capacity, PROT_READ | PROT_EXEC);
+#endif
+	}
+
+	for (int n = 0; n < foundCount; n++) {
+		free(reachable[found[n]]);
+		free(bufs[found[n]].data);
+	}
+	free(bufs);
+	free(reachable);
+	free(ok);
+	free(isFound);
+	free(found);
+}
+
+ES3Jit* jitNew(const ES3Bytecode* bytecode) {
+#ifndef JIT_X64
+	return NULL;
+#else
+#ifdef _WIN32
+	unsigned char* code = VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (code == NULL) return NULL;
+#else
+	unsigned char* code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED) return NULL;
+#endif
+
+	ES3Jit* jit = smalloc(sizeof(ES3Jit));
+	jit->bytecode = bytecode;
+	jit->entries = calloc(bytecode->count, sizeof(ES3JitEntry));
+	jit->calls = calloc(bytecode->count, sizeof(int));
+	jit->stack = 0;
+	if (jit->entries == NULL || jit->calls == NULL) genericError(1, "Out of memory!");
+	jit->code = code;
+	jit->used = 0;
+	jit->capacity = JIT_CODE_SIZE;
+	return jit;
+#endif
+}
+
+ES3JitEntry jitEntry(ES3Jit* jit, int function) {
+	if (jit->entries[function] != NULL) return jit->entries[function];
+	if (jit->calls[function] < 0 || ++jit->calls[function] < JIT_THRESHOLD) return NULL;
+
+	jitCompile(jit, function);
+	return jit->entries[function];
+}
+
+void jitFree(ES3Jit* jit) {
+	if (jit == NULL) return;
+
+#ifdef _WIN32
+	VirtualFree(jit->code, 0, MEM_RELEASE);
+#else
+	munmap(jit->code, jit->capacity);
+#endif
+	free(jit->entries);
+	free(jit->calls);
+	free(jit);
+}
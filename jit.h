@@ -0,0 +1,55 @@
+#pragma once
+
+#include "bytecode.h"
+
+// Calls with only number args a function gets in the VM before it is compiled to machine code
+#define JIT_THRESHOLD 1000
+// Most params and registers a function can have to be compiled
+#define JIT_MAX_PARAMS 16
+#define JIT_MAX_REGISTERS 4096
+// Bytes of the C stack compiled functions can take before the call that needs more starts over in the VM
+#define JIT_MAX_STACK (512 * 1024)
+
+/**
+ * Machine code of a function, it takes its args as doubles and returns a double
+ */
+typedef double (*ES3JitEntry)(const double* args);
+
+/**
+ * Compiles functions that only ever compute with numbers to x86-64 machine code. Each opcode is a fixed
+ * template working on the registers as unboxed doubles in the native stack frame
+ *  - entries: machine code of each function, NULL until it is compiled
+ *  - calls: number calls each function got so far, -1 once it can't or shouldn't be compiled
+ *  - stack: bytes of the C stack the running compiled functions take, not 0 after a call returns if it ran out
+ */
+typedef struct ES3Jit_ {
+    const ES3Bytecode* bytecode;
+    ES3JitEntry* entries;
+    int* calls;
+    int stack;
+
+    unsigned char* code;
+    size_t used;
+    size_t capacity;
+} ES3Jit;
+
+/**
+ * Creates a JIT for the functions of a program
+ * @param bytecode - the bytecode, must outlive the JIT
+ * @return The JIT, must be freed with jitFree. NULL if machine code can't be run on this platform
+ */
+ES3Jit* jitNew(const ES3Bytecode* bytecode);
+
+/**
+ * Counts a call of a function whose args are all numbers, compiling it once it is hot
+ * @param jit - the JIT
+ * @param function - index of the function
+ * @return Its machine code, NULL if it isn't compiled
+ */
+ES3JitEntry jitEntry(ES3Jit* jit, int function);
+
+/**
+ * Frees a JIT and its machine code
+ * @param jit - the JIT, can be NULL
+ */
+void jitFree(ES3Jit* jit);
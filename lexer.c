@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "lexer.h"
+#include "esvutil.h"
+#include "enums.h"
+
+#define CC_OTHER 0
+#define CC_SPACE 1
+#define CC_COMMENT 2
+#define CC_DIGIT 3
+#define CC_ALPHA 4
+#define CC_QUOTE 5
+#define CC_PUNCT 6
+#define CC_CMP 7
+
+typedef struct ES3Lexer_ {
+    const ES3Source* source;
+
+    const char* cur;
+    const char* end;
+
+    int line;
+    const char* lineStart;
+} ES3Lexer;
+
+static const unsigned char charClasses[256] = {
+	[' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\r'] = CC_SPACE, ['\n'] = CC_SPACE,
+	['#'] = CC_COMMENT,
+	['0' ... '9'] = CC_DIGIT,
+	['a' ... 'z'] = CC_ALPHA, ['A' ... 'Z'] = CC_ALPHA,
+	[TOKENV_BST] = CC_QUOTE,
+	[TOKENV_ADD] = CC_PUNCT, [TOKENV_SUB] = CC_PUNCT, [TOKENV_MUL] = CC_PUNCT, [TOKENV_DIV] = CC_PUNCT,
+	[TOKENV_EXP] = CC_PUNCT, [TOKENV_EDL] = CC_PUNCT, [TOKENV_BPR] = CC_PUNCT, [TOKENV_EPR] = CC_PUNCT,
+	[TOKENV_BCB] = CC_PUNCT, [TOKENV_ECB] = CC_PUNCT, [TOKENV_BAR] = CC_PUNCT, [TOKENV_EAR] = CC_PUNCT,
+	[TOKENV_ARS] = CC_PUNCT,
+	[TOKENV_EQL] = CC_CMP, [TOKENV_GTT] = CC_CMP, [TOKENV_LST] = CC_CMP,
+};
+
+// Token for a CC_PUNCT or CC_CMP char on its own
+static const int singleTokens[256] = {
+	[TOKENV_ADD] = TOKEN_ADD, [TOKENV_SUB] = TOKEN_SUB, [TOKENV_MUL] = TOKEN_MUL, [TOKENV_DIV] = TOKEN_DIV,
+	[TOKENV_EXP] = TOKEN_EXP, [TOKENV_EDL] = TOKEN_EDL, [TOKENV_BPR] = TOKEN_BPR, [TOKENV_EPR] = TOKEN_EPR,
+	[TOKENV_BCB] = TOKEN_BCB, [TOKENV_ECB] = TOKEN_ECB, [TOKENV_BAR] = TOKEN_BAR, [TOKENV_EAR] = TOKEN_EAR,
+	[TOKENV_ARS] = TOKEN_ARS,
+	[TOKENV_EQL] = TOKEN_EQL, [TOKENV_GTT] = TOKEN_GTT, [TOKENV_LST] = TOKEN_LST,
+};
+
+// Token for a CC_CMP char followed by '='
+static const int equalsTokens[256] = {
+	[TOKENV_EQL] = TOKEN_DEQ, [TOKENV_GTT] = TOKEN_GTE, [TOKENV_LST] = TOKEN_LSE,
+};
+
+/**
+ * Skips a run of whitespace, 16 bytes at a time when SSE2 is available, and keeps the line count up to date
+ * @param lexer - the lexer, its line and lineStart are advanced past skipped newlines
+ * @param cur - first char to check
+ * @return pointer to the first non whitespace char, or the end of the source
+ */
+static const char* skipSpace(ES3Lexer* lexer, const char* cur) {
+	const char* end = lexer->end;
+
+	// Most runs are a single space or newline, don't pay for a vector load on those
+	if (cur == end || charClasses[(unsigned char) *cur] != CC_SPACE) return cur;
+	if (*cur == '\n') {
+		lexer->line++;
+		lexer->lineStart = cur + 1;
+	}
+	cur++;
+
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i ret = _mm_set1_epi8('\r');
+	const __m128i newline = _mm_set1_epi8('\n');
+
+	while (end - cur >= 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*) cur);
+		__m128i isNewline = _mm_cmpeq_epi8(chunk, newline);
+		__m128i isSpace = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, ret), isNewline)
+		);
+		unsigned int notSpace = ~_mm_movemask_epi8(isSpace) & 0xFFFF;
+		unsigned int newlines = _mm_movemask_epi8(isNewline);
+		int runLength = notSpace ? __builtin_ctz(notSpace) : 16;
+		newlines &= (1u << runLength) - 1;
+
+		if (newlines) {
+			lexer->line += __builtin_popcount(newlines);
+			lexer->lineStart = cur + (31 - __builtin_clz(newlines)) + 1;
+		}
+		if (notSpace) return cur + runLength;
+		cur += 16;
+	}
+#endif
+
+	while (cur < end && charClasses[(unsigned char) *cur] == CC_SPACE) {
+		if (*cur == '\n') {
+			lexer->line++;
+			lexer->lineStart = cur + 1;
+		}
+		cur++;
+	}
+	return cur;
+}
+
+/**
+ * Gets the keyword TOKEN_... enum of an identifier
+ * @param start - start of the identifier
+ * @param length - length of the identifier
+ * @return The keyword token, or TOKEN_VAR if it is not a keyword
+ */
+static int keywordToken(const char* start, int length) {
+	#define KEYWORD(text, token) if (length == sizeof(text) - 1 && !memcmp(start, text, length)) return token;
+	switch (length) {
+		case 2:
+			KEYWORD(TOKENV_CON, TOKEN_CON);
+			break;
+		case 3:
+			KEYWORD(TOKENV_DEF, TOKEN_DEF);
+			break;
+		case 4:
+			KEYWORD(TOKENV_TRU, TOKEN_TRU);
+			break;
+		case 5:
+			KEYWORD(TOKENV_LOP, TOKEN_LOP);
+			KEYWORD(TOKENV_FLS, TOKEN_FLS);
+			break;
+		case 6:
+			KEYWORD(TOKENV_RET, TOKEN_RET);
+			break;
+	}
+	#undef KEYWORD
+	return TOKEN_VAR;
+}
+
+/**
+ * Scans the next token
+ * @param lexer - the lexer to advance
+ * @return The token, type is a TOKEN_... enum
+ */
+static ES3Token lexerNext(ES3Lexer* lexer) {
+	const char* cur = lexer->cur;
+	const char* end = lexer->end;
+
+	for (;;) {
+		cur = skipSpace(lexer, cur);
+		if (cur == end || *cur != '#') break;
+		cur = memchr(cur, '\n', end - cur);
+		if (cur == NULL) cur = end;
+	}
+
+	ES3Token token = { .type = TOKEN_EOF, .start = cur, .length = 0, .line = lexer->line, .column = cur - lexer->lineStart + 1 };
+	if (cur == end) {
+		lexer->cur = cur;
+		return token;
+	}
+
+	unsigned char curChar = *cur;
+	const char* tokenEnd = cur + 1;
+
+	switch (charClasses[curChar]) {
+		case CC_PUNCT:
+			token.type = singleTokens[curChar];
+			break;
+
+		case CC_CMP:
+			if (tokenEnd < end && *tokenEnd == TOKENV_EQL) {
+				token.type = equalsTokens[curChar];
+				tokenEnd++;
+			} else {
+				token.type = singleTokens[curChar];
+			}
+			break;
+
+		case CC_QUOTE:
+			tokenEnd = memchr(tokenEnd, TOKENV_EST, end - tokenEnd);
+			if (tokenEnd == NULL) sourceError(lexer->source, cur, 202, "Parsing Error: unclosed string!");
+			tokenEnd++;
+			// Strings may span lines
+			for (const char* c = memchr(cur, '\n', tokenEnd - cur); c != NULL; c = memchr(c + 1, '\n', tokenEnd - c - 1)) {
+				lexer->line++;
+				lexer->lineStart = c + 1;
+			}
+			token.type = TOKEN_STR;
+			break;
+
+		case CC_DIGIT:
+			while (tokenEnd < end && charClasses[(unsigned char) *tokenEnd] == CC_DIGIT) tokenEnd++;
+			if (tokenEnd < end && *tokenEnd == '.') {
+				tokenEnd++;
+				if (tokenEnd == end || charClasses[(unsigned char) *tokenEnd] != CC_DIGIT) {
+					sourceError(lexer->source, tokenEnd, 206, "Parsing Error: unfinished digit");
+				}
+				while (tokenEnd < end && charClasses[(unsigned char) *tokenEnd] == CC_DIGIT) tokenEnd++;
+			}
+			token.type = TOKEN_NUM;
+			break;
+
+		case CC_ALPHA:
+			while (tokenEnd < end && (charClasses[(unsigned char) *tokenEnd] == CC_ALPHA || charClasses[(unsigned char) *tokenEnd] == CC_DIGIT)) tokenEnd++;
+			token.type = keywordToken(cur, tokenEnd - cur);
+			break;
+
+		default:
+			sourceError(lexer->source, cur, 201, "Parsing Error: unkown token found - \"%c\" / \"%i\"\n", curChar, curChar);
+	}
+
+	token.length = tokenEnd - cur;
+	lexer->cur = tokenEnd;
+	return token;
+}
+
+void lexerTokenize(ES3TokenStream* stream, const ES3Source* source, ES3Arena* arena) {
+	ES3Lexer lexer = {
+		.source = source,
+		.cur = source->text,
+		.end = source->text + source->length,
+		.line = 1,
+		.lineStart = source->text
+	};
+
+	// Rough guess of one token per four chars so most files never regrow
+	int capacity = source->length / 4 + 16;
+	stream->source = source;
+	stream->arena = arena;
+	stream->tokens = arenaAlloc(arena, sizeof(ES3Token) * capacity);
+	stream->count = 0;
+	stream->pos = 0;
+	stream->depth = 0;
+
+	for (;;) {
+		if (stream->count == capacity) {
+			stream->tokens = arenaGrow(arena, stream->tokens, sizeof(ES3Token) * capacity, sizeof(ES3Token) * capacity * 2);
+			capacity *= 2;
+		}
+
+		ES3Token token = lexerNext(&lexer);
+		stream->tokens[stream->count++] = token;
+		if (token.type == TOKEN_EOF) break;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "source.h"
+
+typedef struct ES3Token_ {
+    int type;
+
+    const char* start;
+    int length;
+
+    int line;
+    int column;
+} ES3Token;
+
+typedef struct ES3TokenStream_ {
+    const ES3Source* source;
+    ES3Arena* arena;
+
+    ES3Token* tokens;
+    int count;
+    int pos;
+
+    // Nesting of the grammer calls parsing the stream, indents their debug output and is limited so the parser
+    // doesn't run out of C stack
+    int depth;
+} ES3TokenStream;
+
+/**
+ * Lexes a whole source into a token array ending with a TOKEN_EOF token. Token text is a slice of the source text and is not NUL terminated
+ * @param stream - OUT the stream to fill in, positioned at the first token
+ * @param source - the mapped source code
+ * @param arena - arena the token array is allocated from, it's released with the arena
+ */
+void lexerTokenize(ES3TokenStream* stream, const ES3Source* source, ES3Arena* arena);
@@ -3,9 +3,28 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <setjmp.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 #include "esvutil.h"
 #include "enums.h"
+#include "lexer.h"
+#include "session.h"
+#include "ast.h"
+#include "infer.h"
+#include "fold.h"
+#include "codegen.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "cache.h"
+#include "pool.h"
+#include "watch.h"
+#include "report.h"
 
 #define DEBUGLEVEL 0
 
@@ -15,23 +34,29 @@
 #define __debugbreak()
 #endif // DEBUGLEVEL > 2
 
+// Deepest the grammer calls can nest and tallest the syntax tree can be. The parser and every pass recurse, these
+// keep them well inside the 1MB stack es3 gets on Windows. About 580 nested brackets or 2000 nested blocks
+#define MAX_GRAMMER_DEPTH 4096
+#define MAX_TREE_HEIGHT 4096
+
 /**
- * Gets and emits the next statement, expects file buffer to be pointing to before first token
- * @param sourceFilePtr - file buffer of the source code
- * @param outFilePtr - file buffer of the output
+ * Gets the next statement, expects the stream to be pointing to before first token
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the statement
- * @param an int representing whether the program is currently (1) defining functions (0) executing code
- * @return an int representin what the new funcDefMode state should be
+ * @param funcDefMode - an int representing whether the program is currently (1) defining functions (0) executing code
+ * @return The statement node, or NULL at the end of the file
  */
-static int grammerStatement(FILE* sourceFilePointer, FILE* outFilePtr, int currentToken, int funcDefMode);
+static ES3Node* grammerStatement(ES3TokenStream* stream, ES3Arena* arena, int currentToken, int funcDefMode);
 
 /**
- * Gets the next comparison, expects file buffer to be pointing to before first token
- * @param sourceFilePtr - file buffer of the source code
+ * Gets the next comparison, expects the stream to be pointing to before first token
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the comparison
- * @return the first TOKEN_... enum after the comparison
+ * @return The node of the comparison
  */
-static char* grammerComparison(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken);
+static ES3Node* grammerComparison(ES3TokenStream* stream, ES3Arena* arena, int currentToken);
 
 /**
  * Returns a string literal representation of a token
@@ -104,265 +129,95 @@ static char* getTokenNameFromValue(int token) {
 }
 
 /**
- * Gets the next token, comusuming the reqired chars from sourceFilePtr
- * @param sourceFilePtr - file buffer of the source code
- * @param OUT value - if present, sets this variable to the value of the token, (e.g. variable name, string value, number value, ect.,) otherwise returns NULL
+ * Gets the next token, advancing the stream unless it is at the end of file
+ * @param stream - tokens of the source code
+ * @param OUT value - if present, sets this variable to the token, whose start and length slice the token text (e.g. variable name, string value, number value, ect.,) out of the source
  * @return The TOKEN_... enum
  */
-static int __nextToken(FILE* sourceFilePtr, char** value) {
-	char curChar = getc(sourceFilePtr);
-	if (curChar == EOF) return TOKEN_EOF;
-	char nextChar = ungetc(getc(sourceFilePtr), sourceFilePtr);
-
-	while (curChar == ' ' || curChar == '\t' || curChar == '\r' || curChar == '\n') {
-		curChar = getc(sourceFilePtr);
-		nextChar = ungetc(getc(sourceFilePtr), sourceFilePtr);
-	}
-	if (curChar == '#') {
-		while (curChar != '\n' && curChar != EOF) { curChar = getc(sourceFilePtr); }
-		return __nextToken(sourceFilePtr, value);
-	}
-	if (DEBUGLEVEL > 4) printf("\x1b[38;5;241mCUR CHAR: %c, NEXT CHAR: %c\n\x1b[0m", curChar, nextChar);
-	if (curChar == EOF) return TOKEN_EOF;
-
-	if (curChar == TOKENV_EQL) {
-		if (nextChar == TOKENV_EQL) {
-			curChar = getc(sourceFilePtr);
-			return TOKEN_DEQ;
-		}
-		return TOKEN_EQL;
-	}
-	if (curChar == TOKENV_ADD) return TOKEN_ADD;
-	if (curChar == TOKENV_SUB) return TOKEN_SUB;
-	if (curChar == TOKENV_MUL) return TOKEN_MUL;
-	if (curChar == TOKENV_DIV) return TOKEN_DIV;
-	if (curChar == TOKENV_EXP) return TOKEN_EXP;
-	if (curChar == TOKENV_EDL) return TOKEN_EDL;
-	if (curChar == TOKENV_BPR) return TOKEN_BPR;
-	if (curChar == TOKENV_EPR) return TOKEN_EPR;
-	if (curChar == TOKENV_BCB) return TOKEN_BCB;
-	if (curChar == TOKENV_ECB) return TOKEN_ECB;
-	if (curChar == TOKENV_BAR) return TOKEN_BAR;
-	if (curChar == TOKENV_EAR) return TOKEN_EAR;
-	if (curChar == TOKENV_ARS) return TOKEN_ARS;
-
-	if (curChar == TOKENV_GTT) {
-		if (nextChar == TOKENV_EQL) {
-			curChar = getc(sourceFilePtr);
-			return TOKEN_GTE;
-		}
-		return TOKEN_GTT;
-	}
-	if (curChar == TOKENV_LST) {
-		if (nextChar == TOKENV_EQL) {
-			curChar = getc(sourceFilePtr);
-			return TOKEN_LSE;
-		}
-		return TOKEN_LST;
-	}
-
-	if (curChar == TOKENV_BST) {
-		int oldPos = ftell(sourceFilePtr);
-
-		do {
-			curChar = getc(sourceFilePtr);
-			if (curChar == EOF) {
-				genericError(sourceFilePtr, 202, "Parsing Error: unclosed string!");
-				return -1;
-			};
-		} while (curChar != TOKENV_EST);
-
-		int tokenTextSize = ftell(sourceFilePtr)-1 - oldPos;
-		fseek(sourceFilePtr, oldPos, SEEK_SET);
-		char* tokenText = (char*)smalloc((tokenTextSize+3) * sizeof(char));
-		tokenText[0] = '"';
-
-		for (int i = 0; i < tokenTextSize; i++) {
-			tokenText[i+1] = getc(sourceFilePtr);
-		}
-		fseek(sourceFilePtr, 1L, SEEK_CUR);
-		tokenText[tokenTextSize + 1] = '"';
-		tokenText[tokenTextSize + 2] = '\0';
-		if (value != NULL) *value = tokenText;
-
-		return TOKEN_STR;
-	}
-
-	if (isdigit(curChar)) {
-		int oldPos = ftell(sourceFilePtr) - 1;
-
-		do {
-			curChar = getc(sourceFilePtr);
-		} while (isdigit(curChar));
-		if (curChar == '.') {
-			curChar = getc(sourceFilePtr);
-			if (!isdigit(curChar)) {
-				genericError(sourceFilePtr, 206, "Parsing Error: unfinished digit");
-				return -1;
-			}
-			while (isdigit(curChar)) {
-				curChar = getc(sourceFilePtr);
-			}
-		}
-
-		int tokenTextSize = ftell(sourceFilePtr) - oldPos;
-
-		char* tokenText = (char*)smalloc(tokenTextSize * sizeof(char));
-
-		fseek(sourceFilePtr, oldPos, SEEK_SET);
-		for (int i = 0; i < tokenTextSize - 1; i++) {
-			tokenText[i] = getc(sourceFilePtr);
-		}
-		tokenText[tokenTextSize - 1] = '\0';
-
-		if (curChar == EOF) {
-			fseek(sourceFilePtr, 0L, SEEK_END);
-		}
-
-		if (value != NULL) *value = tokenText; else free(tokenText);
-
-		return TOKEN_NUM;
-	}
-
-	if (isalpha(curChar)) {
-		int oldPos = ftell(sourceFilePtr)-1;
-
-		do {
-			curChar = getc(sourceFilePtr);
-		} while (isalnum(curChar));
-
-		int tokenTextSize = ftell(sourceFilePtr)-oldPos;
-		
-		char* tokenText = (char*)smalloc(tokenTextSize*sizeof(char));
-		
-		fseek(sourceFilePtr, oldPos, SEEK_SET);
-		for (int i=0; i<tokenTextSize-1; i++) {
-			tokenText[i] = getc(sourceFilePtr);
-		}
-		tokenText[tokenTextSize-1] = '\0';
-
-		if (curChar == EOF) {
-			fseek(sourceFilePtr, 0L, SEEK_END);
-		}
-
-		if (!strcmp(tokenText, TOKENV_DEF)) { free(tokenText); return TOKEN_DEF; }
-		if (!strcmp(tokenText, TOKENV_CON)) { free(tokenText); return TOKEN_CON; }
-		if (!strcmp(tokenText, TOKENV_RET)) { free(tokenText); return TOKEN_RET; }
-		if (!strcmp(tokenText, TOKENV_LOP)) { free(tokenText); return TOKEN_LOP; }
-		if (!strcmp(tokenText, TOKENV_TRU)) { free(tokenText); return TOKEN_TRU; }
-		if (!strcmp(tokenText, TOKENV_FLS)) { free(tokenText); return TOKEN_FLS; }
-
-		if (value != NULL) *value = tokenText; else free(tokenText);
-		
-		return TOKEN_VAR;
-	}
-
-	genericError(sourceFilePtr, 201, "Parsing Error: unkown token found - \"%c\" / \"%i\"\n", curChar, curChar);
-	return -1;
+static int nextToken(ES3TokenStream* stream, ES3Token* value) {
+	ES3Token* token = &stream->tokens[stream->pos];
+	if (token->type != TOKEN_EOF) stream->pos++;
+	if (DEBUGLEVEL > 2) printf("\x1b[35mNEXT TOKEN CALL: %s\n\x1b[0m", getTokenNameFromValue(token->type));
+	if (DEBUGLEVEL > 2 && token->length > 0) printf("\x1b[31mNEXT TOKEN VALUE: %.*s\n\x1b[0m", token->length, token->start);
+
+	if (value != NULL) *value = *token;
+	return token->type;
 }
 
 /**
- * Wrapper for __nextToken() that prints debug messages
- * @param sourceFilePtr - file buffer of the source code
- * @param OUT value - if present, sets this variable to the value of the token, (e.g. variable name, string value, number value, ect.,) otherwise returns NULL
- * @return The TOKEN_... enum
- */
-static int nextToken(FILE* sourceFilePtr, char** value) {
-	char* tValue = NULL;
-	if (value == NULL) value = &tValue;
-	
-	int token = __nextToken(sourceFilePtr, value);
-	if (DEBUGLEVEL > 2) printf("\x1b[35mNEXT TOKEN CALL: %s\n\x1b[0m", getTokenNameFromValue(token));
-	if (DEBUGLEVEL > 2 && value != NULL && *value != NULL) printf("\x1b[31mNEXT TOKEN VALUE: %s\n\x1b[0m", *value);
-
-	return token;
-}
-
-/**
- * Wrapper for __nextToken() that prints debug messages but does not consume chars from the file buffer
- * @param sourceFilePtr - file buffer of the source code
- * @param OUT value - if present, sets this variable to the value of the token, (e.g. variable name, string value, number value, ect.,) otherwise returns NULL
+ * Looks ahead in the stream without consuming tokens
+ * @param stream - tokens of the source code
+ * @param OUT value - if present, sets this variable to the token, whose start and length slice the token text (e.g. variable name, string value, number value, ect.,) out of the source
  * @param count - number of tokens to peek 
  @return The TOKEN_... enum
  */
-static int peekToken(FILE* sourceFilePtr, char** value, int count) {
-	int pos = ftell(sourceFilePtr);
-
-	for (int i = 0; i < count - 1; i++) __nextToken(sourceFilePtr, NULL);
-
-	char* tValue = NULL;
-	if (value == NULL) value = &tValue;
+static int peekToken(ES3TokenStream* stream, ES3Token* value, int count) {
+	int index = stream->pos + count - 1;
+	if (index >= stream->count) index = stream->count - 1;
 
-	int token = __nextToken(sourceFilePtr, value);
-	if (DEBUGLEVEL > 2) printf("\x1b[35mNEXT PEEK TOKEN CALL: %s\n\x1b[0m", getTokenNameFromValue(token));
-	if (DEBUGLEVEL > 2 && value != NULL && *value != NULL) printf("\x1b[31mNEXT PEEK TOKEN VALUE: %s\n\x1b[0m", *value);
+	ES3Token* token = &stream->tokens[index];
+	if (DEBUGLEVEL > 2) printf("\x1b[35mNEXT PEEK TOKEN CALL: %s\n\x1b[0m", getTokenNameFromValue(token->type));
+	if (DEBUGLEVEL > 2 && token->length > 0) printf("\x1b[31mNEXT PEEK TOKEN VALUE: %.*s\n\x1b[0m", token->length, token->start);
 
-	fseek(sourceFilePtr, pos, SEEK_SET);
-	return token;
+	if (value != NULL) *value = *token;
+	return token->type;
 }
 
-static int grammerDepth = 0;
+/**
+ * Gets where in the source the most recently consumed token is, for error messages
+ * @param stream - tokens of the source code
+ * @return Pointer into the source text
+ */
+static const char* streamPos(ES3TokenStream* stream) {
+	return stream->tokens[stream->pos > 0 ? stream->pos - 1 : 0].start;
+}
 
 /**
  * Checks if token == check and errors if not. Bitwise or multiple tokens in check to check multiple values
  * @param token - the TOKEN_... enum to check
  * @param check - the TOKEN_... enum to check against
  */
-static void grammerCheck(FILE* sourceFilePtr, int token, int check) {
-	char* combinedTokenString = smalloc(sizeof(char));
-	combinedTokenString[0] = '\0';
-	int checkPassed = 0;
+static void grammerCheck(ES3TokenStream* stream, int token, int check) {
+	int checkPassed = (token & check) != 0;
+	if (checkPassed && DEBUGLEVEL <= 3) return;
+
+	ES3StrBuf combinedTokenString = strbufNewIn(stream->arena);
 
 	for (int i = 0; i < NUM_TOKENS; i++) {
 		if ((check >> i & 1) == 1) {
-			if ((token >> i & 1) == 1) {
-				checkPassed = 1;
-			}
-
-			int firstInstance = strlen(combinedTokenString) == 0;
-
-			const char* tokenString = getTokenNameFromValue(1 << i);
-			char* tempCts = srealloc(
-				combinedTokenString, 
-				sizeof(char) * (strlen(combinedTokenString) + strlen(tokenString) + (firstInstance ? 1 : 3))
-			);
-
-			combinedTokenString = tempCts;
-
-			if (!firstInstance) strcat(combinedTokenString, ", ");
-			strcat(combinedTokenString, tokenString);
+			if (combinedTokenString.length > 0) strbufAppend(&combinedTokenString, ", ");
+			strbufAppend(&combinedTokenString, getTokenNameFromValue(1 << i));
 		}
 	}
 
-	if (DEBUGLEVEL > 3) printf("\x1b[33mCHECKING GRAMMER: %s\n\x1b[0m", combinedTokenString);
+	if (DEBUGLEVEL > 3) printf("\x1b[33mCHECKING GRAMMER: %s\n\x1b[0m", strbufText(&combinedTokenString));
 
-	if (!checkPassed) genericError(sourceFilePtr, 401, "Syntax error: expected \"%s\", got \"%s\"\n", combinedTokenString, getTokenNameFromValue(token));
-	free(combinedTokenString);
+	if (!checkPassed) sourceError(stream->source, streamPos(stream), 401, "Syntax error: expected \"%s\", got \"%s\"\n", strbufText(&combinedTokenString), getTokenNameFromValue(token));
 	return;
 }
 
 /**
  * Wrapper for grammerCheck that first calls nextToken() and passes that to token
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
  * @param check - the TOKEN_... enum to check against
  * @return the TOKEN_... enum of the next token
  */
-static int grammerMatch(FILE* sourceFilePtr, int check) {
-	int token = nextToken(sourceFilePtr, NULL);
-	grammerCheck(sourceFilePtr, token, check);
+static int grammerMatch(ES3TokenStream* stream, int check) {
+	int token = nextToken(stream, NULL);
+	grammerCheck(stream, token, check);
 	return token;
 }
 
 /**
  * Wrapper for grammerCheck that first calls peekToken() and passes that to token
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
  * @param check - the TOKEN_... enum to check against
  * @param count - the number of tokens ahead to check
  * @return the TOKEN_... enum of the next token
  */
-static int grammerPeekMatch(FILE* sourceFilePtr, int check, int count) {
-	int token = peekToken(sourceFilePtr, NULL, 1);
-	grammerCheck(sourceFilePtr, token, check);
+static int grammerPeekMatch(ES3TokenStream* stream, int check, int count) {
+	int token = peekToken(stream, NULL, 1);
+	grammerCheck(stream, token, check);
 	return token;
 }
 
@@ -371,652 +226,1151 @@ static int grammerPeekMatch(FILE* sourceFilePtr, int check, int count) {
  * @param message - message in error
  * @param token - token in error
  */
-static void grammerError(FILE* sourceFilePtr, char* message, int token) {
-	genericError(sourceFilePtr, 201, "Syntax error: expected \"%s\", got \"%s\"\n", message, getTokenNameFromValue(token));
+static void grammerError(ES3TokenStream* stream, char* message, int token) {
+	sourceError(stream->source, streamPos(stream), 201, "Syntax error: expected \"%s\", got \"%s\"\n", message, getTokenNameFromValue(token));
+}
+
+/**
+ * Errors if the grammer calls are nested too deep, every recursion of the grammer goes through a primary or a statement
+ * @param stream - tokens of the source code
+ */
+static void grammerCheckDepth(ES3TokenStream* stream) {
+	if (stream->depth > MAX_GRAMMER_DEPTH) sourceError(stream->source, streamPos(stream), 904, "Syntax error: nesting too deep\n");
 }
 
 /**
  * Gets the next parenthasis
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the parenthasis
- * @return the first TOKEN_... enum after the parenthasis
+ * @return The node of the comparison inside the parenthasis
  */
-static char* grammerParenthasis(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER PARENTHASIS CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
-
-	char* outPar = smalloc(1);
-	outPar[0] = '\0';
-	outPar = sstrcat(outPar, "(");
+static ES3Node* grammerParenthasis(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER PARENTHASIS CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_PARENTHASIS);
 
-	grammerCheck(sourceFilePtr, currentToken, TOKEN_BPR);
+	grammerCheck(stream, currentToken, TOKEN_BPR);
 
-	char* inComp = grammerComparison(sourceFilePtr, outFilePtr, currentToken);
-	outPar = sstrcat(outPar, inComp);
-	free(inComp);
+	ES3Node* inComp = grammerComparison(stream, arena, currentToken);
 
-	grammerMatch(sourceFilePtr, TOKEN_EPR);
+	grammerMatch(stream, TOKEN_EPR);
 
-	outPar = sstrcat(outPar, ")");
-
-	grammerDepth--;
-	return outPar;
+	reportLeave(REPORT_PARENTHASIS);
+	stream->depth--;
+	return inComp;
 }
 
 /**
- * Gets the next array
- * @param sourceFilePtr - file buffer of the source code
+ * Gets the next array, array literal items, function call args and function definition params all use this syntax
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
+ * @param node - node to add each item to as a child
  * @param currentToken - the value of the first TOKEN_... enum in the array
- * @return the first TOKEN_... enum after the array
+ * @param paramDefLike - (1) items are param names (0) items are comparisons
  */
-static char* grammerArray(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken, int paramLike, int paramDefLike) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER ARRAY CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
-
-	char* primOut = smalloc(1);
-	primOut[0] = '\0';
-
-	if (paramLike) primOut = sstrcat(primOut, "("); else primOut = sstrcat(primOut, "(ES3Var) { .type = 4, .valArrCur = &(");
-
-	if (peekToken(sourceFilePtr, NULL, 1) != TOKEN_EAR && paramLike && paramDefLike) primOut = sstrcat(primOut, "ES3Var ");
-
-	grammerCheck(sourceFilePtr, currentToken, TOKEN_BAR);
-	
-	char* compIn;
-
-	if (paramDefLike) {
-		char* paramNameIn = NULL;
-		nextToken(sourceFilePtr, &paramNameIn);
-		if (paramNameIn == NULL) genericError(sourceFilePtr, 905, "Invalid function parameter!");
-		primOut = sstrcat(primOut, paramNameIn);
-		primOut = sstrcat(primOut, "__raw");
-		free(paramNameIn);
-	} else {
-		compIn = grammerComparison(sourceFilePtr, outFilePtr, currentToken);
-		primOut = sstrcat(primOut, compIn);
-		free(compIn);
+static void grammerArray(ES3TokenStream* stream, ES3Arena* arena, ES3Node* node, int currentToken, int paramDefLike) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER ARRAY CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_ARRAY);
+
+	grammerCheck(stream, currentToken, TOKEN_BAR);
+
+	if (peekToken(stream, NULL, 1) == TOKEN_EAR) {
+		nextToken(stream, NULL);
+		reportLeave(REPORT_ARRAY);
+		stream->depth--;
+		return;
 	}
 
-	int arrLen = 0;
-
-	while (nextToken(sourceFilePtr, NULL) != TOKEN_EAR) {
+	do {
 		if (paramDefLike) {
-			primOut = sstrcat(primOut, ", ");
-			if (paramLike) primOut = sstrcat(primOut, "ES3Var ");
-			char* paramNameIn = NULL;
-			nextToken(sourceFilePtr, &paramNameIn);
-			if (paramNameIn == NULL) genericError(sourceFilePtr, 905, "Invalid function parameter!");
-			primOut = sstrcat(primOut, paramNameIn);
-			primOut = sstrcat(primOut, "__raw");
-			free(paramNameIn);
-		} else if (paramLike) {
-			primOut = sstrcat(primOut, ", ");
-			compIn = grammerComparison(sourceFilePtr, outFilePtr, currentToken);
-			primOut = sstrcat(primOut, compIn);
-			free(compIn);
+			ES3Token paramNameIn;
+			nextToken(stream, &paramNameIn);
+			if (paramNameIn.type != TOKEN_VAR) sourceError(stream->source, streamPos(stream), 905, "Invalid function parameter!");
+			astPush(arena, node, astNew(arena, NODE_VAR, paramNameIn));
 		} else {
-			primOut = sstrcat(primOut, "), .valArrNext = &((ES3Var) { .type = 4, .valArrCur = &(");
-			compIn = grammerComparison(sourceFilePtr, outFilePtr, currentToken);
-			primOut = sstrcat(primOut, compIn);
-			free(compIn);
-			arrLen++;
-		}
-	}
-
-	if (paramLike) primOut = sstrcat(primOut, ")"); else {
-		for (int i=0; i<arrLen+1; i++) {
-			primOut = sstrcat(primOut, ") }");
+			astPush(arena, node, grammerComparison(stream, arena, currentToken));
 		}
-	};
+	} while (grammerMatch(stream, TOKEN_ARS | TOKEN_EAR) != TOKEN_EAR);
 
-	grammerDepth--;
-	return primOut;
+	reportLeave(REPORT_ARRAY);
+	stream->depth--;
 }
 
 /**
- * Gets the next code block
- * @param sourceFilePtr - file buffer of the source code
+ * Gets the next code block, leaves the stream pointing at the closing TOKEN_ECB
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the code block
- * @return the first TOKEN_... enum after the code block
+ * @return The block node, its children are the statements
  */
-static void grammerCodeBlock(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER CODE BLOCK CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+static ES3Node* grammerCodeBlock(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER CODE BLOCK CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_CODEBLOCK);
 	
-	fputs("{\n", outFilePtr);
-	grammerCheck(sourceFilePtr, currentToken, TOKEN_BCB);
-	do {
-		grammerStatement(sourceFilePtr, outFilePtr, 0, 0);
-	} while (peekToken(sourceFilePtr, NULL, 1) != TOKEN_ECB);
-	fputs("}\n", outFilePtr);
+	grammerCheck(stream, currentToken, TOKEN_BCB);
+	ES3Node* block = astNew(arena, NODE_BLOCK, stream->tokens[stream->pos - 1]);
 
-	grammerDepth--;
+	while (peekToken(stream, NULL, 1) != TOKEN_ECB) {
+		ES3Node* statement = grammerStatement(stream, arena, 0, 0);
+		if (statement == NULL) grammerCheck(stream, TOKEN_EOF, TOKEN_ECB);
+		astPush(arena, block, statement);
+	}
+
+	reportLeave(REPORT_CODEBLOCK);
+	stream->depth--;
+	return block;
 }
 
 /**
  * Gets the next function call
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the function call
- * @return the first TOKEN_... enum after the function call
+ * @return The call node, its token is the function name and its children are the args
  */
-static char* grammerFunc(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER FUNC CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
-
-	char* primOut = smalloc(1);
-	primOut[0] = '\0';
+static ES3Node* grammerFunc(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER FUNC CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_FUNC);
 
 	// | testFunc[1, 2, 3]
-	char* funcName = NULL;
+	ES3Token funcName;
 	// testFunc | [1, 2, 3]
-	currentToken = nextToken(sourceFilePtr, &funcName);
-	primOut = sstrcat(primOut, funcName);
-	primOut = sstrcat(primOut, "__raw");
-	
-	grammerCheck(sourceFilePtr, currentToken, TOKEN_VAR);
-	
-	char* arrIn = grammerArray(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL), 1, 0);
-	primOut = sstrcat(primOut, arrIn);
-	free(arrIn);
+	currentToken = nextToken(stream, &funcName);
+	grammerCheck(stream, currentToken, TOKEN_VAR);
 
-	grammerDepth--;
-	return primOut;
+	ES3Node* call = astNew(arena, NODE_CALL, funcName);
+	grammerArray(stream, arena, call, nextToken(stream, NULL), 0);
+
+	reportLeave(REPORT_FUNC);
+	stream->depth--;
+	return call;
 }
 
 /**
  * Gets the next primary
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the primary
- * @return the first TOKEN_... enum after the primary
+ * @return The node of the primary
  */
-static char* grammerPrimary(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER PRIMARY CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+static ES3Node* grammerPrimary(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER PRIMARY CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	grammerCheckDepth(stream);
+	reportEnter(REPORT_PRIMARY);
+
+	int nToken = peekToken(stream, NULL, 1);
+	grammerCheck(stream, nToken, TOKEN_NUM | TOKEN_VAR | TOKEN_BPR | TOKEN_STR | TOKEN_BAR | TOKEN_TRU | TOKEN_FLS);
+	int n2Token = peekToken(stream, NULL, 2);
 
-	char* potVarVal = NULL;
-	int nToken = peekToken(sourceFilePtr, &potVarVal, 1);
-	grammerCheck(sourceFilePtr, nToken, TOKEN_NUM | TOKEN_VAR | TOKEN_BPR | TOKEN_STR | TOKEN_BAR | TOKEN_TRU | TOKEN_FLS);
-	int n2Token = peekToken(sourceFilePtr, NULL, 2);
+	ES3Node* primOut;
 
 	if (nToken == TOKEN_BPR) {
-		currentToken = nextToken(sourceFilePtr, NULL);
-		return grammerParenthasis(sourceFilePtr, outFilePtr, currentToken);
+		currentToken = nextToken(stream, NULL);
+		primOut = grammerParenthasis(stream, arena, currentToken);
 	} else if (nToken == TOKEN_BAR) {
-		currentToken = nextToken(sourceFilePtr, NULL);
-		return grammerArray(sourceFilePtr, outFilePtr, currentToken, 0, 0);
+		ES3Token arrToken;
+		currentToken = nextToken(stream, &arrToken);
+		primOut = astNew(arena, NODE_ARRAY, arrToken);
+		grammerArray(stream, arena, primOut, currentToken, 0);
 	} else if (nToken == TOKEN_VAR && n2Token == TOKEN_BAR) {
-		return grammerFunc(sourceFilePtr, outFilePtr, currentToken);
+		primOut = grammerFunc(stream, arena, currentToken);
 	} else {
-		char* varVal = smalloc(1);
-		varVal[0] = '\0';
-
-		currentToken = nextToken(sourceFilePtr, &varVal);
-		if (varVal == NULL) genericError(sourceFilePtr, 901, "Failed to parse var value!");
+		ES3Token varToken;
+		currentToken = nextToken(stream, &varToken);
 
 		switch (currentToken) {
 			case TOKEN_NUM:
-				varVal = sstrpre(varVal, "(ES3Var) { .type = 1, .valNum = ");
-				varVal = sstrcat(varVal, " }");
+				primOut = astNew(arena, NODE_NUM, varToken);
+				primOut->num = astTokenNumber(varToken);
 				break;
 			case TOKEN_STR:
-				varVal = sstrpre(varVal, "(ES3Var) { .type = 2, .valString = ");
-				varVal = sstrcat(varVal, " }");
+				primOut = astNew(arena, NODE_STR, varToken);
 				break;
 			case TOKEN_VAR:
-				varVal = sstrcat(varVal, "__raw");
+				primOut = astNew(arena, NODE_VAR, varToken);
 				break;
 			case TOKEN_TRU:
-				varVal = sstrcat(varVal, "(ES3Var) { .type = 3, .valBool = 1 }");
+				primOut = astNew(arena, NODE_BOOL, varToken);
+				primOut->op = 1;
 				break;
 			case TOKEN_FLS:
-				varVal = sstrcat(varVal, "(ES3Var) { .type = 3, .valBool = 0 }");
+				primOut = astNew(arena, NODE_BOOL, varToken);
+				primOut->op = 0;
 				break;
 		
 			default:
-				genericError(sourceFilePtr, 902, "Failed to parse var type!");
-				break;
+				sourceError(stream->source, streamPos(stream), 902, "Failed to parse var type!");
+				return NULL;
 		}
-
-		return varVal;
-		grammerDepth--;
 	}
+
+	reportLeave(REPORT_PRIMARY);
+	stream->depth--;
+	return primOut;
 }
 
 /**
  * Gets the next unary
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the unary
- * @return the first TOKEN_... enum after the unary
+ * @return The node of the unary
  */
-static char* grammerUnary(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER UNARY CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+static ES3Node* grammerUnary(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER UNARY CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_UNARY);
 
-	char* outExpr = (char*) smalloc(1);
-	int isUnary = 0;
+	ES3Node* negate = NULL;
 
-	if (peekToken(sourceFilePtr, NULL, 1) == TOKEN_SUB) {
-		nextToken(sourceFilePtr, NULL);
-		outExpr = sstrpre(outExpr, "esvUnary(");
-		isUnary = 1;
+	ES3Token subToken;
+	if (peekToken(stream, &subToken, 1) == TOKEN_SUB) {
+		nextToken(stream, NULL);
+		negate = astNew(arena, NODE_NEG, subToken);
 	}
 
-	outExpr[0] = '\0';
-	char* inExp = grammerPrimary(sourceFilePtr, outFilePtr, currentToken);
-	outExpr = sstrcat(outExpr, inExp);
-	free(inExp);
-
-	if (isUnary) outExpr = sstrcat(outExpr, ")");
+	ES3Node* outExpr = grammerPrimary(stream, arena, currentToken);
 
 	// Arrays
-	while (peekToken(sourceFilePtr, NULL, 1) == TOKEN_BCB) {
-		grammerMatch(sourceFilePtr, TOKEN_BCB);
-		char* strindex = NULL;
-		grammerCheck(sourceFilePtr, nextToken(sourceFilePtr, &strindex), TOKEN_NUM);
-		long long index = strtol(strindex, NULL, 10);
-		outExpr = sstrpre(outExpr, "(*((&(");
-		outExpr = sstrcat(outExpr, "))->");
-
-		for (int i=0; i<index; i++) {
-			outExpr = sstrcat(outExpr, "valArrNext->");
-		}
+	ES3Token indexToken;
+	while (peekToken(stream, &indexToken, 1) == TOKEN_BCB) {
+		grammerMatch(stream, TOKEN_BCB);
+
+		ES3Node* index = astNew(arena, NODE_INDEX, indexToken);
+		index->left = outExpr;
+		index->right = grammerComparison(stream, arena, TOKEN_BCB);
+		outExpr = index;
 
-		outExpr = sstrcat(outExpr, "valArrCur))");
-		free(strindex);
-		grammerMatch(sourceFilePtr, TOKEN_ECB);
+		grammerMatch(stream, TOKEN_ECB);
 	}
 
-	grammerDepth--;
+	if (negate != NULL) {
+		negate->left = outExpr;
+		outExpr = negate;
+	}
+
+	reportLeave(REPORT_UNARY);
+	stream->depth--;
 	return outExpr;
 }
 
 /**
  * Gets the next expression
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the expression
- * @return A string with the transpiled source code for the expression
+ * @return The node of the exponentiation
  */
-static char* grammerExponentiation(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER EXPONENTIATION CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+static ES3Node* grammerExponentiation(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER EXPONENTIATION CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_EXPONENTIATION);
 
-	char* outExpr = (char*) smalloc(1);
-	outExpr[0] = '\0';
-	char* inExp = grammerUnary(sourceFilePtr, outFilePtr, currentToken);
-	outExpr = sstrcat(outExpr, inExp);
+	ES3Node* outExpr = grammerUnary(stream, arena, currentToken);
 
-	int pToken = peekToken(sourceFilePtr, NULL, 1);
+	ES3Token opToken;
+	int pToken = peekToken(stream, &opToken, 1);
 	while ((pToken & (TOKEN_EXP)) > 0) {
-		if (pToken == TOKEN_EXP) outExpr = sstrcat(outExpr, ", 1, ");
-
-		free(inExp);
-		inExp = grammerUnary(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL));
-
-		outExpr = sstrpre(outExpr, "esvExpo(");
-		outExpr = sstrcat(outExpr, inExp);
-		outExpr = sstrcat(outExpr, ")");
+		ES3Node* binary = astNew(arena, NODE_BINARY, opToken);
+		binary->op = pToken;
+		binary->left = outExpr;
+		binary->right = grammerUnary(stream, arena, nextToken(stream, NULL));
+		outExpr = binary;
 
-		pToken = peekToken(sourceFilePtr, NULL, 1);
+		pToken = peekToken(stream, &opToken, 1);
 	}
 
-	free(inExp);
-
-	grammerDepth--;
+	reportLeave(REPORT_EXPONENTIATION);
+	stream->depth--;
 	return outExpr;
 }
 
 /**
  * Gets the next term
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the term
- * @return the first TOKEN_... enum after the term
+ * @return The node of the term
  */
-static char* grammerTerm(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER TERM CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+static ES3Node* grammerTerm(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER TERM CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_TERM);
 
-	char* outExpr = (char*) smalloc(1);
-	outExpr[0] = '\0';
-	char* inExp = grammerExponentiation(sourceFilePtr, outFilePtr, currentToken);
-	outExpr = sstrcat(outExpr, inExp);
+	ES3Node* outExpr = grammerExponentiation(stream, arena, currentToken);
 
-	int pToken = peekToken(sourceFilePtr, NULL, 1);
+	ES3Token opToken;
+	int pToken = peekToken(stream, &opToken, 1);
 	while ((pToken & (TOKEN_MUL | TOKEN_DIV)) > 0) {
-		if (pToken == TOKEN_MUL) outExpr = sstrcat(outExpr, ", 1, "); else
-		if (pToken == TOKEN_DIV) outExpr = sstrcat(outExpr, ", 2, ");
-
-		free(inExp);
-		inExp = grammerExponentiation(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL));
-
-		outExpr = sstrpre(outExpr, "esvTerm(");
-		outExpr = sstrcat(outExpr, inExp);
-		outExpr = sstrcat(outExpr, ")");
+		ES3Node* binary = astNew(arena, NODE_BINARY, opToken);
+		binary->op = pToken;
+		binary->left = outExpr;
+		binary->right = grammerExponentiation(stream, arena, nextToken(stream, NULL));
+		outExpr = binary;
 		
-		pToken = peekToken(sourceFilePtr, NULL, 1);
+		pToken = peekToken(stream, &opToken, 1);
 	}
 
-	free(inExp);
-
-	grammerDepth--;
+	reportLeave(REPORT_TERM);
+	stream->depth--;
 	return outExpr;
 }
 
 /**
  * Gets the next expression
- * @param sourceFilePtr - file buffer of the source code
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
  * @param currentToken - the value of the first TOKEN_... enum in the expression
- * @return A string with the transpiled source code for the expression
+ * @return The node of the expression
  */
-static char* grammerExpression(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER EXPRESSION CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+static ES3Node* grammerExpression(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER EXPRESSION CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_EXPRESSION);
 
-	char* outExpr = (char*) smalloc(1);
-	outExpr[0] = '\0';
-	char* inExp = grammerTerm(sourceFilePtr, outFilePtr, currentToken);
-	outExpr = sstrcat(outExpr, inExp);
+	ES3Node* outExpr = grammerTerm(stream, arena, currentToken);
 
-	int pToken = peekToken(sourceFilePtr, NULL, 1);
+	ES3Token opToken;
+	int pToken = peekToken(stream, &opToken, 1);
 	while ((pToken & (TOKEN_ADD | TOKEN_SUB)) > 0) {
-		if (pToken == TOKEN_ADD) outExpr = sstrcat(outExpr, ", 1, "); else
-		if (pToken == TOKEN_SUB) outExpr = sstrcat(outExpr, ", 2, ");
-
-		free(inExp);
-		inExp = grammerTerm(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL));
+		ES3Node* binary = astNew(arena, NODE_BINARY, opToken);
+		binary->op = pToken;
+		binary->left = outExpr;
+		binary->right = grammerTerm(stream, arena, nextToken(stream, NULL));
+		outExpr = binary;
 
-		outExpr = sstrpre(outExpr, "esvExpr(");
-		outExpr = sstrcat(outExpr, inExp);
-		outExpr = sstrcat(outExpr, ")");
-
-		pToken = peekToken(sourceFilePtr, NULL, 1);
+		pToken = peekToken(stream, &opToken, 1);
 	}
 
-	free(inExp);
-
-	grammerDepth--;
+	reportLeave(REPORT_EXPRESSION);
+	stream->depth--;
 	return outExpr;
 }
 
-static char* grammerComparison(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER COMPARISON CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+static ES3Node* grammerComparison(ES3TokenStream* stream, ES3Arena* arena, int currentToken) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER COMPARISON CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+	stream->depth++;
+	reportEnter(REPORT_COMPARISON);
 
-	char* outExpr = (char*) smalloc(1);
-	outExpr[0] = '\0';
-	char* inExp = grammerExpression(sourceFilePtr, outFilePtr, currentToken);
-	outExpr = sstrcat(outExpr, inExp);
+	ES3Node* outExpr = grammerExpression(stream, arena, currentToken);
 
-	int pToken = peekToken(sourceFilePtr, NULL, 1);
+	ES3Token opToken;
+	int pToken = peekToken(stream, &opToken, 1);
 	while ((pToken & (TOKEN_DEQ | TOKEN_GTT | TOKEN_GTE | TOKEN_LST | TOKEN_LSE)) > 0) {
-		if (pToken == TOKEN_DEQ) outExpr = sstrcat(outExpr, ", 1, "); else
-		if (pToken == TOKEN_GTT) outExpr = sstrcat(outExpr, ", 2, "); else
-		if (pToken == TOKEN_GTE) outExpr = sstrcat(outExpr, ", 3, "); else
-		if (pToken == TOKEN_LST) outExpr = sstrcat(outExpr, ", 4, "); else
-		if (pToken == TOKEN_LSE) outExpr = sstrcat(outExpr, ", 5, ");
-
-		free(inExp);
-		inExp = grammerExpression(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL));
-		
-		outExpr = sstrpre(outExpr, "esvComp(");
-		outExpr = sstrcat(outExpr, inExp);
-		outExpr = sstrcat(outExpr, ")");
+		ES3Node* binary = astNew(arena, NODE_BINARY, opToken);
+		binary->op = pToken;
+		binary->left = outExpr;
+		binary->right = grammerExpression(stream, arena, nextToken(stream, NULL));
+		outExpr = binary;
 
-		pToken = peekToken(sourceFilePtr, NULL, 1);
+		pToken = peekToken(stream, &opToken, 1);
 	}
 
-	free(inExp);
-
-	grammerDepth--;
+	reportLeave(REPORT_COMPARISON);
+	stream->depth--;
 	return outExpr;
 }
 
-static int grammerStatement(FILE* sourceFilePtr, FILE* outFilePtr, int currentToken, int funcDefMode) {
-	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER STATEMENT CALL: %s\n\x1b[0m", str_repeat("| ", grammerDepth), getTokenNameFromValue(currentToken));
-	grammerDepth++;
+/**
+ * Gets the if or while statement after its keyword
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
+ * @param node - the NODE_IF or NODE_WHILE node to fill in
+ */
+static void grammerConditional(ES3TokenStream* stream, ES3Arena* arena, ES3Node* node) {
+	// if | (a > b) { ... };
+	node->left = grammerParenthasis(stream, arena, nextToken(stream, NULL));
+	int currentToken = nextToken(stream, NULL);
+	// if (a > b) | { ... };
+	node->right = grammerCodeBlock(stream, arena, currentToken);
+	// if (a > b) { ... | };
+	grammerMatch(stream, TOKEN_ECB);
+	grammerMatch(stream, TOKEN_EDL);
+}
+
+static ES3Node* grammerStatement(ES3TokenStream* stream, ES3Arena* arena, int currentToken, int funcDefMode) {
+	if (DEBUGLEVEL > 1) printf("\x1b[32m%sGRAMMER STATEMENT CALL: %s\n\x1b[0m", arenaRepeat(arena, "| ", stream->depth), getTokenNameFromValue(currentToken));
+
+	ES3Token firstToken;
+	currentToken = peekToken(stream, &firstToken, 1);
 
-	char* iVarVal = NULL;
-	currentToken = peekToken(sourceFilePtr, &iVarVal, 1);
+	if (currentToken == TOKEN_EOF) return NULL;
 
-	if (currentToken == TOKEN_EOF) return 2;
+	grammerCheck(stream, currentToken, TOKEN_DEF | TOKEN_VAR | TOKEN_CON | TOKEN_RET | TOKEN_LOP);
 
-	grammerCheck(sourceFilePtr, currentToken, TOKEN_DEF | TOKEN_VAR | TOKEN_CON | TOKEN_RET | TOKEN_LOP);
+	stream->depth++;
+	grammerCheckDepth(stream);
+	reportEnter(REPORT_STATEMENT);
+	ES3Node* statement = NULL;
 
 	// Define var / function
 	if (currentToken == TOKEN_DEF) {
-		nextToken(sourceFilePtr, NULL);
+		nextToken(stream, NULL);
 
-		char* potVarName = NULL;
-		int varToken = nextToken(sourceFilePtr, &potVarName);
-		if (potVarName == NULL) genericError(sourceFilePtr, 901, "Failed to parse function/var name");
+		ES3Token potVarName;
+		int varToken = nextToken(stream, &potVarName);
 
-		grammerCheck(sourceFilePtr, varToken, TOKEN_VAR);
-		currentToken = grammerMatch(sourceFilePtr, TOKEN_EQL | TOKEN_BAR);
+		grammerCheck(stream, varToken, TOKEN_VAR);
+		currentToken = grammerMatch(stream, TOKEN_EQL | TOKEN_BAR);
 		
 		// Def function
 		if (currentToken == TOKEN_BAR) {
 			if (DEBUGLEVEL > 0) printf("\x1b[1;36mDEFINE FUNCTION\x1b[0m\n");
 
-			if (!funcDefMode) genericError(sourceFilePtr, 903, "Function defined not at top of file!");
-			fputs("static ES3Var ", outFilePtr);
-			fputs(potVarName, outFilePtr);
-			fputs("__raw", outFilePtr);
+			if (!funcDefMode) sourceError(stream->source, streamPos(stream), 903, "Function defined not at top of file!");
 
-			free(potVarName);
+			statement = astNew(arena, NODE_FUNC, potVarName);
+			grammerArray(stream, arena, statement, currentToken, 1);
+			grammerMatch(stream, TOKEN_EQL);
+			statement->left = grammerCodeBlock(stream, arena, nextToken(stream, NULL));
 
-			char* inArr = grammerArray(sourceFilePtr, outFilePtr, currentToken, 1, 1);
-			fputs(inArr, outFilePtr);
-			free(inArr);
-			grammerMatch(sourceFilePtr, TOKEN_EQL);
-			grammerCodeBlock(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL));
-
-			nextToken(sourceFilePtr, NULL);
-			grammerMatch(sourceFilePtr, TOKEN_EDL);
-
-			grammerDepth--;
-			return 1;
+			nextToken(stream, NULL);
+			grammerMatch(stream, TOKEN_EDL);
 		}
 		// Def var
 		else {
 			if (DEBUGLEVEL > 0) printf("\x1b[1;36mDEFINE VAR\x1b[0m\n");
-			
-			fputs("ES3Var ", outFilePtr);
-			fputs(potVarName, outFilePtr);
-			fputs("__raw = ", outFilePtr);
-
-			char* inComp = grammerComparison(sourceFilePtr, outFilePtr, currentToken);
-			fputs(inComp, outFilePtr);
-			free(inComp);
 
-			fputs(";\n", outFilePtr);
+			statement = astNew(arena, NODE_LET, potVarName);
+			statement->left = grammerComparison(stream, arena, currentToken);
 
-			free(potVarName);
-
-			grammerMatch(sourceFilePtr, TOKEN_EDL);
+			grammerMatch(stream, TOKEN_EDL);
 		}
-
-		grammerDepth--;
-		return 0;
 	}
 	
 	// Call function / Redefine var
-	if (currentToken == TOKEN_VAR) {
+	else if (currentToken == TOKEN_VAR) {
 		// | a -> = <- 12;
 		// | a -> [ <- 1, 2, 3];
-		int pToken = peekToken(sourceFilePtr, NULL, 2);
+		int pToken = peekToken(stream, NULL, 2);
 
-		grammerCheck(sourceFilePtr, pToken, TOKEN_EQL | TOKEN_BAR | TOKEN_BCB);
+		grammerCheck(stream, pToken, TOKEN_EQL | TOKEN_BAR | TOKEN_BCB);
 
 		// Redefine var
 		if (pToken == TOKEN_EQL || pToken == TOKEN_BCB) {
 			if (DEBUGLEVEL > 0) printf("\x1b[1;36mREDEFINE VAR\x1b[0m\n");
-			fputs(grammerUnary(sourceFilePtr, outFilePtr, 0), outFilePtr);
-			grammerMatch(sourceFilePtr, TOKEN_EQL); // a = | 12;
-			fputs(" = ", outFilePtr);
-			char* inComp = grammerComparison(sourceFilePtr, outFilePtr, TOKEN_EQL);
-			fputs(inComp, outFilePtr);
-			fputs(";\n", outFilePtr);
-			grammerMatch(sourceFilePtr, TOKEN_EDL);
+			statement = astNew(arena, NODE_ASSIGN, firstToken);
+			statement->left = grammerUnary(stream, arena, 0);
+			grammerMatch(stream, TOKEN_EQL); // a = | 12;
+			statement->right = grammerComparison(stream, arena, TOKEN_EQL);
+			grammerMatch(stream, TOKEN_EDL);
 		}
 		// Call function
 		else { 
 			if (DEBUGLEVEL > 0) printf("\x1b[1;36mCALL FUNCTION\x1b[0m\n");
-			char* funcIn = grammerFunc(sourceFilePtr, outFilePtr, currentToken);
-			fputs(funcIn, outFilePtr);
-			free(funcIn);
-			grammerMatch(sourceFilePtr, TOKEN_EDL);
-			fputs(";\n", outFilePtr);
+			statement = astNew(arena, NODE_CALLSTMT, firstToken);
+			statement->left = grammerFunc(stream, arena, currentToken);
+			grammerMatch(stream, TOKEN_EDL);
 		}
-
-		grammerDepth--;
-		return 0;
 	}
 
 	// If statement
-	if (currentToken == TOKEN_CON) {
+	else if (currentToken == TOKEN_CON) {
 		if (DEBUGLEVEL > 0) printf("\x1b[1;36mIF STATEMENT\x1b[0m\n");
 
-		fputs("if (esvTruthy", outFilePtr);
-
 		// | if (a > b) { ... };
-		nextToken(sourceFilePtr, NULL);
-		// if | (a > b) { ... };
-		char* inPar = grammerParenthasis(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL));
-		fputs(inPar, outFilePtr);
-		free(inPar);
-		fputs(") ", outFilePtr);
-		currentToken = nextToken(sourceFilePtr, NULL);
-		// if (a > b) | { ... };
-		grammerCodeBlock(sourceFilePtr, outFilePtr, currentToken);
-		// if (a > b) { ... | };
-		grammerMatch(sourceFilePtr, TOKEN_ECB);
-		grammerMatch(sourceFilePtr, TOKEN_EDL);
-
-		grammerDepth--;
-		return 0;
+		nextToken(stream, NULL);
+		statement = astNew(arena, NODE_IF, firstToken);
+		grammerConditional(stream, arena, statement);
 	}
 
 	// While statement
-	if (currentToken == TOKEN_LOP) {
+	else if (currentToken == TOKEN_LOP) {
 		if (DEBUGLEVEL > 0) printf("\x1b[1;36mLOOP STATEMENT\x1b[0m\n");
 
-		fputs("while (esvTruthy", outFilePtr);
-
-		// | if (a > b) { ... };
-		nextToken(sourceFilePtr, NULL);
-		// if | (a > b) { ... };
-		char* inPar = grammerParenthasis(sourceFilePtr, outFilePtr, nextToken(sourceFilePtr, NULL));
-		fputs(inPar, outFilePtr);
-		free(inPar);
-		fputs(") ", outFilePtr);
-		currentToken = nextToken(sourceFilePtr, NULL);
-		// if (a > b) | { ... };
-		grammerCodeBlock(sourceFilePtr, outFilePtr, currentToken);
-		// if (a > b) { ... | };
-		grammerMatch(sourceFilePtr, TOKEN_ECB);
-		grammerMatch(sourceFilePtr, TOKEN_EDL);
-
-		grammerDepth--;
-		return 0;
+		// | while (a > b) { ... };
+		nextToken(stream, NULL);
+		statement = astNew(arena, NODE_WHILE, firstToken);
+		grammerConditional(stream, arena, statement);
 	}
 
 	// Return statement
-	if (currentToken == TOKEN_RET) {
+	else if (currentToken == TOKEN_RET) {
 		if (DEBUGLEVEL > 0) printf("\x1b[1;36mRETURN\x1b[0m\n");
 
-		nextToken(sourceFilePtr, NULL);
-
-		fputs("return ", outFilePtr);
-
-		char* inComp = grammerComparison(sourceFilePtr, outFilePtr, currentToken);
-		fputs(inComp, outFilePtr);
-		free(inComp);
-		grammerMatch(sourceFilePtr, TOKEN_EDL);
+		nextToken(stream, NULL);
 
-		fputs(";\n", outFilePtr);
-
-		grammerDepth--;
-		return 0;
+		statement = astNew(arena, NODE_RETURN, firstToken);
+		statement->left = grammerComparison(stream, arena, currentToken);
+		grammerMatch(stream, TOKEN_EDL);
 	}
+
+	reportLeave(REPORT_STATEMENT);
+	stream->depth--;
+	return statement;
 }
 
 /**
  * Begins parsing the program
- * @param sourceFilePtr - file buffer of the source code
- * @return whether the program had any executable code (main function)
+ * @param stream - tokens of the source code
+ * @param arena - arena the syntax tree is allocated from
+ * @return The program node, its children are the function definitions followed by the statements of the main function
  */
-static int grammerProgram(FILE* sourceFilePtr, FILE* outFilePtr) {
+static ES3Node* grammerProgram(ES3TokenStream* stream, ES3Arena* arena) {
+	ES3Node* program = astNew(arena, NODE_PROGRAM, stream->tokens[0]);
+
 	int funcDefMode = 1;
-	while (!feof(sourceFilePtr)) {
-		int oldSourcePos = ftell(sourceFilePtr);
-		int oldOutPos = ftell(outFilePtr);
-
-		int curFuncMode = grammerStatement(sourceFilePtr, outFilePtr, 0, funcDefMode);
-		if (curFuncMode == 2) return funcDefMode;
-
-		if (curFuncMode == 0) {
-			if (funcDefMode) {
-				fseek(sourceFilePtr, oldSourcePos, SEEK_SET);
-				fseek(outFilePtr, oldOutPos, SEEK_SET);
-				fputs("int main() {\n", outFilePtr);
-			}
-			funcDefMode = 0;
-		}
+	for (;;) {
+		ES3Node* statement = grammerStatement(stream, arena, 0, funcDefMode);
+		if (statement == NULL) break;
+
+		if (statement->type != NODE_FUNC) funcDefMode = 0;
+		astPush(arena, program, statement);
 	}
-	return funcDefMode;
-}
 
-int main(int argc, char** argv) {
-	if (argc < 2) genericError(NULL, 100, "Too few arguments! Usage: es3 fileIn.es3 [fileOut]");
-	if (argc > 3) genericError(NULL, 100, "Too many arguments! Usage: es3 fileIn.es3 [fileOut]");
+	// Long chains of operators don't nest the grammer calls but every pass after this recurses down them
+	ES3Node* tooDeep = astTooDeep(program, MAX_TREE_HEIGHT, arena);
+	if (tooDeep != NULL) sourceError(stream->source, tooDeep->token.start, 904, "Syntax error: nesting too deep\n");
+	return program;
+}
 
-	FILE* sourceFilePtr;
-	FILE* outFilePtr;
+/**
+ * How programs are built, the same for every file of a batch
+ *  - flags: everything after the file names in the gcc command
+ *  - compileFlags, linkFlags: the parts of flags compiling and linking need, flags has the runtime sources between
+ *    them when there is no library
+ *  - library: the runtime library linked in, part of the cache key
+ *  - hasLibrary: 1 if the library exists, otherwise the runtime sources are compiled with the program
+ *  - emitOnly: 1 to only write the C and print the gcc command that would build it
+ */
+typedef struct ES3Build_ {
+    const char* flags;
+    const char* compileFlags;
+    const char* linkFlags;
+    const char* library;
+    int hasLibrary;
+    int emitOnly;
+    int useCache;
+    ES3Cache cache;
+} ES3Build;
 
-	char* outFileName = argc == 3 ? argv[2] : "out";
-	char* outTransName = smalloc(sizeof(char) * (3 * strlen(outFileName)));
-	char* outCompName = smalloc(sizeof(char) * (5 * strlen(outFileName)));
-	sprintf(outTransName, "%s.c", outFileName);
-	sprintf(outCompName, "%s.exe", outFileName);
+/**
+ * Seconds building one file took in each step, and how it went
+ *  - code: 0 on success, otherwise the error code
+ */
+typedef struct ES3BuildResult_ {
+    double transpile;
+    double gcc;
+    int cached;
+    int code;
+} ES3BuildResult;
 
-	// Open source code file
-	sourceFilePtr = fopen(argv[1], "r");
-	// Open out code file
-	outFilePtr = fopen(outTransName, "w");
+/**
+ * Transpiles a source file to C and compiles it with gcc, or copies the program out of the cache
+ * @param build - how to build it
+ * @param inName - path of the source file
+ * @param outName - path of the output without an extension, outName.c and outName.exe are written
+ * @param batch - (1) part of a batch, errors in the source are returned and nothing else is printed (0) errors exit
+ * @param OUT result - timings and the error code
+ */
+static void buildFile(const ES3Build* build, const char* inName, const char* outName, int batch, ES3BuildResult* result) {
+	result->transpile = 0;
+	result->gcc = 0;
+	result->cached = 0;
+	result->code = 0;
+	double start = poolSeconds();
+
+	// Errors in the source jump back here, the session has everything the file allocated
+	ES3Session session;
+	jmp_buf trap;
+	int reportDepthBefore = reportDepth();
+	if (batch) {
+		int code = setjmp(trap);
+		if (code != 0) {
+			sourceSetTrap(NULL);
+			reportUnwind(reportDepthBefore);
+			sessionClose(&session);
+			result->code = code;
+			return;
+		}
+		sourceSetTrap(&trap);
+	}
 
-	if (sourceFilePtr == NULL || outFilePtr == NULL) {
-		printf("File can't be opened");
-		exit(101);
+	// Open source code file, everything allocated while compiling it lives in the session
+	int sourceFailed = sessionOpen(&session, inName);
+	ES3Arena* arena = &session.arena;
+	if (sourceFailed) {
+		if (batch) sourceSetTrap(NULL);
+		sessionClose(&session);
+		printf(batch ? "%s: File can't be opened\r\n" : "File can't be opened", inName);
+		result->code = 101;
+		return;
 	}
 
-	fputs("#include <stdio.h>\n#include \"esvutil.h\"\n#include \"std.c\"\n\n", outFilePtr);
+	ES3StrBuf outTransBuf = strbufNewIn(arena);
+	ES3StrBuf outCompBuf = strbufNewIn(arena);
+	strbufAppend(&outTransBuf, outName);
+	strbufAppend(&outTransBuf, ".c");
+	strbufAppend(&outCompBuf, outName);
+	strbufAppend(&outCompBuf, ".exe");
+	const char* outTransName = strbufText(&outTransBuf);
+	const char* outCompName = strbufText(&outCompBuf);
+
+	// A program built before from the same source, es3, gcc, runtime and flags is copied out of the cache
+	char key[65];
+	if (build->useCache) {
+		reportEnter(REPORT_CACHE);
+		ES3Hash hash;
+		hashInit(&hash);
+		hashString(&hash, ES3_VERSION " " __DATE__ " " __TIME__);
+		hashString(&hash, build->cache.compiler);
+		hashUpdate(&hash, session.source.text, session.source.length);
+		hashFile(&hash, "esvutil.c");
+		hashFile(&hash, "esvutil.h");
+		hashFile(&hash, "std.c");
+		hashFile(&hash, "std.h");
+		hashFile(&hash, build->library);
+		hashString(&hash, build->flags);
+		hashFinish(&hash, key);
+
+		int fetched = cacheFetch(&build->cache, key, outCompName);
+		reportLeave(REPORT_CACHE);
+		if (fetched) {
+			if (batch) sourceSetTrap(NULL);
+			if (!batch) {
+				char* actualpath = _fullpath(NULL, outCompName, 260);
+				printf("%s\r\n", actualpath);
+				free(actualpath);
+			}
 
-	// Read file
-	if (!grammerProgram(sourceFilePtr, outFilePtr)) {
-		fputs("return 0;\n}", outFilePtr);
-	} else {
-		fputs("int main() { }", outFilePtr);
+			sessionClose(&session);
+			result->transpile = poolSeconds() - start;
+			result->cached = 1;
+			return;
+		}
 	}
 
-	fclose(sourceFilePtr);
+	// Lex and parse, only on a cache miss
+	sessionLex(&session);
+	reportEnter(REPORT_PARSE);
+	ES3Node* program = grammerProgram(&session.stream, arena);
+	reportLeave(REPORT_PARSE);
+
+	// Optimize
+	reportEnter(REPORT_INFER);
+	inferProgram(program, arena);
+	reportLeave(REPORT_INFER);
+	reportEnter(REPORT_FOLD);
+	foldProgram(program);
+	reportLeave(REPORT_FOLD);
+	if (batch) sourceSetTrap(NULL);
+
+	// Emit C
+	reportEnter(REPORT_CODEGEN);
+	ES3StrBuf outCode = strbufNewIn(arena);
+	codegenProgram(program, &outCode, arena);
+	reportLeave(REPORT_CODEGEN);
+
+	// Open out code file
+	reportEnter(REPORT_OUTPUT);
+	FILE* outFilePtr = fopen(outTransName, "w");
+	if (outFilePtr == NULL) {
+		reportLeave(REPORT_OUTPUT);
+		sessionClose(&session);
+		printf(batch ? "%s: File can't be opened\r\n" : "File can't be opened", outTransName);
+		result->code = 101;
+		return;
+	}
+	strbufWrite(&outCode, outFilePtr);
 	fclose(outFilePtr);
+	reportLeave(REPORT_OUTPUT);
+	result->transpile = poolSeconds() - start;
+	start = poolSeconds();
 
 	char* actualpath = _fullpath(NULL, outTransName, 260);
-	char* command = (char*) smalloc(sizeof(char) * (9 + strlen(actualpath) + strlen(outCompName)));
+	ES3StrBuf command = strbufNewIn(arena);
+	strbufAppend(&command, "gcc ");
+	strbufAppend(&command, actualpath);
+	strbufAppend(&command, " -o ");
+	strbufAppend(&command, outCompName);
+	strbufAppend(&command, build->flags);
+
+	if (!batch) printf("%s\r\n", strbufText(&command));
+	if (build->emitOnly) {
+		free(actualpath);
+		sessionClose(&session);
+		return;
+	}
 
-	sprintf(command, "gcc %s -o %s esvutil.c", actualpath, outCompName);
-	printf("%s\r\n", command);
-	system(command);
+	reportEnter(REPORT_GCC);
+	int status = system(strbufText(&command));
+	reportLeave(REPORT_GCC);
+	if (build->useCache && status == 0) {
+		reportEnter(REPORT_CACHE);
+		cacheStore(&build->cache, key, outCompName);
+		reportLeave(REPORT_CACHE);
+	}
+	// gcc prints its own errors
+	if (status != 0) result->code = 102;
+	result->gcc = poolSeconds() - start;
 
 	free(actualpath);
 
-	actualpath = _fullpath(NULL, outCompName, 260);
-	printf("%s\r\n", actualpath);
-	// if (DEBUGLEVEL == 0) system(actualpath);
+	if (!batch) {
+		actualpath = _fullpath(NULL, outCompName, 260);
+		printf("%s\r\n", actualpath);
+		// if (DEBUGLEVEL == 0) system(actualpath);
 
-	free(command);
-	free(actualpath);
+		free(actualpath);
+	}
 
 	if (DEBUGLEVEL == 0) unlink(outTransName);
 
-	return 0;
-}
\ No newline at end of file
+	sessionClose(&session);
+}
+
+/**
+ * Files of a batch and what came of each of them
+ */
+typedef struct ES3Batch_ {
+    const ES3Build* build;
+    const char** files;
+    ES3BuildResult* results;
+} ES3Batch;
+
+/**
+ * Builds one file of a batch, its output is named after it without the .es3
+ * @param context - the batch
+ * @param index - which file
+ */
+static void batchJob(void* context, int index) {
+	ES3Batch* batch = context;
+	const char* inName = batch->files[index];
+	ES3BuildResult* result = &batch->results[index];
+
+	size_t length = strlen(inName);
+	if (length > 4 && strcmp(inName + length - 4, ".es3") == 0) length -= 4;
+	char* outName = smalloc(length + 1);
+	memcpy(outName, inName, length);
+	outName[length] = '\0';
+
+	buildFile(batch->build, inName, outName, 1, result);
+	free(outName);
+
+	if (result->code != 0) {
+		printf("%9s %9s  %s failed (%i)\r\n", "", "", inName, result->code);
+	} else if (result->cached) {
+		printf("%9s %9s  %s\r\n", "cached", "", inName);
+	} else {
+		printf("%7.1fms %7.1fms  %s\r\n", result->transpile * 1000, result->gcc * 1000, inName);
+	}
+}
+
+/**
+ * A translation unit of a watched program and the object file it compiles to
+ *  - source: the C source of the unit, NULL for a runtime source file that is compiled as it is
+ *  - path: where the C source is written, or the runtime source file
+ *  - object: named by the hash of everything that goes into it, so an unchanged unit is never compiled again
+ */
+typedef struct ES3Unit_ {
+    const ES3StrBuf* source;
+    const char* path;
+    const char* object;
+    const char* compileFlags;
+    int status;
+} ES3Unit;
+
+/**
+ * Object files the last build of a watched program linked, the ones the next build doesn't use are removed
+ */
+typedef struct ES3UnitObjects_ {
+    char** paths;
+    int count;
+} ES3UnitObjects;
+
+/**
+ * Compiles one unit of a watched program to its object file
+ * @param context - the units that need compiling
+ * @param index - which unit
+ */
+static void unitJob(void* context, int index) {
+	ES3Unit* unit = &((ES3Unit*) context)[index];
+
+	if (unit->source != NULL) {
+		FILE* file = fopen(unit->path, "w");
+		if (file == NULL) {
+			printf("File can't be opened\r\n");
+			unit->status = 101;
+			return;
+		}
+		strbufWrite(unit->source, file);
+		fclose(file);
+	}
+
+	ES3StrBuf command = strbufNew();
+	strbufAppend(&command, "gcc -c ");
+	strbufAppend(&command, unit->path);
+	strbufAppend(&command, " -o ");
+	strbufAppend(&command, unit->object);
+	strbufAppend(&command, unit->compileFlags);
+	unit->status = system(strbufText(&command));
+	strbufFree(&command);
+
+	if (unit->source != NULL && DEBUGLEVEL == 0) unlink(unit->path);
+}
+
+/**
+ * Builds a watched program, only compiling the units that changed since they were last compiled, then runs it
+ * @param build - how to build it
+ * @param inName - path of the source file
+ * @param outName - path of the executable without an extension
+ * @param unitDir - directory the object files of the units are kept in
+ * @param jobs - most units compiled at once
+ * @param objects - the object files of the last build, updated to the ones of this build
+ * @return 0 on success, otherwise an error code
+ */
+static int watchBuild(const ES3Build* build, const char* inName, const char* outName, const char* unitDir, int jobs, ES3UnitObjects* objects) {
+	double start = poolSeconds();
+
+	// Errors in the source jump back here, the session has everything the build allocated
+	ES3Session session;
+	jmp_buf trap;
+	int code = setjmp(trap);
+	if (code != 0) {
+		sourceSetTrap(NULL);
+		sessionClose(&session);
+		return code;
+	}
+	sourceSetTrap(&trap);
+
+	if (sessionOpen(&session, inName)) {
+		sourceSetTrap(NULL);
+		sessionClose(&session);
+		printf("File can't be opened\r\n");
+		return 101;
+	}
+	ES3Arena* arena = &session.arena;
+
+	sessionLex(&session);
+	ES3Node* program = grammerProgram(&session.stream, arena);
+	inferProgram(program, arena);
+	foldProgram(program);
+	sourceSetTrap(NULL);
+
+	ES3StrBuf* sources;
+	int count = codegenUnits(program, &sources, arena);
+	// Without the runtime library the runtime sources are units too, they only ever get compiled once
+	int total = build->hasLibrary ? count : count + 2;
+
+	ES3Unit* units = arenaAlloc(arena, sizeof(ES3Unit) * total);
+	ES3Unit* pending = arenaAlloc(arena, sizeof(ES3Unit) * total);
+	int pendingCount = 0;
+	for (int i = 0; i < total; i++) {
+		ES3Unit* unit = &units[i];
+		ES3Hash hash;
+		hashInit(&hash);
+		hashString(&hash, ES3_VERSION " " __DATE__ " " __TIME__);
+		hashString(&hash, build->compileFlags);
+		if (i < count) {
+			unit->source = &sources[i];
+			hashString(&hash, strbufText(&sources[i]));
+		} else {
+			unit->source = NULL;
+			unit->path = i == count ? "esvutil.c" : "std.c";
+			hashFile(&hash, unit->path);
+		}
+		hashFile(&hash, "esvutil.h");
+		hashFile(&hash, "std.h");
+		char key[65];
+		hashFinish(&hash, key);
+
+		ES3StrBuf object = strbufNewIn(arena);
+		strbufAppend(&object, unitDir);
+		strbufAppend(&object, "/");
+		strbufAppend(&object, key);
+		if (unit->source != NULL) {
+			ES3StrBuf path = strbufNewIn(arena);
+			strbufAppend(&path, strbufText(&object));
+			strbufAppend(&path, ".c");
+			unit->path = strbufText(&path);
+		}
+		strbufAppend(&object, ".o");
+		unit->object = strbufText(&object);
+		unit->compileFlags = build->compileFlags;
+		unit->status = 0;
+
+		FILE* existing = fopen(unit->object, "rb");
+		if (existing != NULL) {
+			fclose(existing);
+		} else {
+			pending[pendingCount++] = *unit;
+		}
+	}
+
+	poolRun(jobs, pendingCount, unitJob, pending);
+	for (int i = 0; i < pendingCount; i++) {
+		// gcc prints its own errors, and leaves no object file behind
+		if (pending[i].status != 0) code = 102;
+	}
+
+	ES3StrBuf outCompBuf = strbufNewIn(arena);
+	strbufAppend(&outCompBuf, outName);
+	strbufAppend(&outCompBuf, ".exe");
+	const char* outCompName = strbufText(&outCompBuf);
+
+	if (code == 0) {
+		ES3StrBuf command = strbufNewIn(arena);
+		strbufAppend(&command, "gcc");
+		for (int i = 0; i < total; i++) {
+			strbufAppend(&command, " ");
+			strbufAppend(&command, units[i].object);
+		}
+		strbufAppend(&command, " -o ");
+		strbufAppend(&command, outCompName);
+		strbufAppend(&command, build->compileFlags);
+		strbufAppend(&command, build->linkFlags);
+		if (system(strbufText(&command)) != 0) code = 102;
+	}
+
+	// Objects of units that changed are never used again
+	for (int i = 0; i < objects->count; i++) {
+		int used = 0;
+		for (int j = 0; j < total && !used; j++) used = strcmp(objects->paths[i], units[j].object) == 0;
+		if (!used) remove(objects->paths[i]);
+		free(objects->paths[i]);
+	}
+	objects->paths = srealloc(objects->paths, sizeof(char*) * total);
+	objects->count = total;
+	for (int i = 0; i < total; i++) {
+		size_t length = strlen(units[i].object) + 1;
+		objects->paths[i] = memcpy(smalloc(length), units[i].object, length);
+	}
+
+	if (code == 0) {
+		printf("Built %s in %.1fms, compiled %i of %i units\r\n", inName, (poolSeconds() - start) * 1000, pendingCount, total);
+		fflush(stdout);
+
+		char* actualpath = _fullpath(NULL, outCompName, 260);
+		system(actualpath);
+		free(actualpath);
+	}
+
+	sessionClose(&session);
+	return code;
+}
+
+int main(int argc, char** argv) {
+	// Options can go anywhere, everything else is a file name
+	const char** files = smalloc(sizeof(const char*) * (argc + 1));
+	files[1] = "out";
+	int fileCount = 0;
+	int nanBox = 0;
+	int run = 0;
+	int disasm = 0;
+	int jit = 1;
+	int useCache = 1;
+	int lto = 0;
+	int jobs = 0;
+	int watch = 0;
+	int emitOnly = 0;
+	int timeReport = REPORT_OFF;
+	const char* optimize = NULL;
+	const char* arch = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--nanbox") == 0) {
+			nanBox = 1;
+		} else if (strcmp(argv[i], "--run") == 0) {
+			run = 1;
+		} else if (strcmp(argv[i], "--disasm") == 0) {
+			disasm = 1;
+		} else if (strcmp(argv[i], "--nojit") == 0) {
+			jit = 0;
+		} else if (strcmp(argv[i], "--nocache") == 0) {
+			useCache = 0;
+		} else if (strcmp(argv[i], "--lto") == 0) {
+			lto = 1;
+		} else if (strcmp(argv[i], "--watch") == 0) {
+			watch = 1;
+		} else if (strcmp(argv[i], "--emit-c") == 0) {
+			emitOnly = 1;
+		} else if (strcmp(argv[i], "--time-report") == 0) {
+			timeReport = REPORT_TABLE;
+		} else if (strcmp(argv[i], "--time-report=json") == 0) {
+			timeReport = REPORT_JSON;
+		} else if (strncmp(argv[i], "-O", 2) == 0) {
+			optimize = argv[i];
+		} else if (strncmp(argv[i], "-march=", 7) == 0) {
+			arch = argv[i];
+		} else if (strncmp(argv[i], "-j", 2) == 0) {
+			// Both -j 8 and -j8
+			const char* count = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+			jobs = atoi(count);
+			if (jobs < 1) genericError(100, "-j needs a number of jobs of at least 1! Usage: es3 -j N [options] fileIn.es3...");
+		} else {
+			files[fileCount++] = argv[i];
+		}
+	}
+	if ((jobs == 0 || watch) && fileCount > 2) genericError(100, "Too many arguments! Usage: es3 [--nanbox] [--run] [--disasm] [--nojit] [--nocache] [--lto] [--watch] [--emit-c] [--time-report[=json]] [-O<level>] [-march=<cpu>] [-j N] fileIn.es3 [fileOut]");
+	if (fileCount < 1) genericError(100, "Too few arguments! Usage: es3 [--nanbox] [--run] [--disasm] [--nojit] [--nocache] [--lto] [--watch] [--emit-c] [--time-report[=json]] [-O<level>] [-march=<cpu>] [-j N] fileIn.es3 [fileOut]");
+	if ((jobs > 0 || watch) && (run || disasm)) genericError(100, "--run and --disasm can't be used with -j or --watch");
+	if (watch && timeReport != REPORT_OFF) genericError(100, "--time-report can't be used with --watch");
+
+	if (timeReport != REPORT_OFF) reportStart();
+	// Phases are timed on one thread, so the files of a batch are built one at a time
+	if (timeReport != REPORT_OFF && jobs > 1) jobs = 1;
+
+	if (run || disasm) {
+		// Open source code file, everything allocated while compiling it lives in the session
+		ES3Session session;
+		if (sessionOpen(&session, files[0])) {
+			printf("File can't be opened");
+			exit(101);
+		}
+		ES3Arena* arena = &session.arena;
+
+		// No C compiler involved, the program runs on the bytecode VM against the runtime linked into es3
+		sessionLex(&session);
+		reportEnter(REPORT_PARSE);
+		ES3Node* program = grammerProgram(&session.stream, arena);
+		reportLeave(REPORT_PARSE);
+		reportEnter(REPORT_INFER);
+		inferProgram(program, arena);
+		reportLeave(REPORT_INFER);
+		reportEnter(REPORT_FOLD);
+		foldProgram(program);
+		reportLeave(REPORT_FOLD);
+		reportEnter(REPORT_BYTECODE);
+		ES3Bytecode* bytecode = bytecodeProgram(program, &session.source, arena);
+		reportLeave(REPORT_BYTECODE);
+
+		if (disasm) bytecodeDisasm(bytecode, stdout);
+		if (run) {
+			reportEnter(REPORT_RUN);
+			vmRun(bytecode, jit);
+			reportLeave(REPORT_RUN);
+		}
+
+		if (timeReport != REPORT_OFF) {
+			// Everything the program printed comes first
+			esvFlush();
+			fflush(stdout);
+			reportPrint(stderr, timeReport);
+		}
+		sessionClose(&session);
+		free(files);
+		return 0;
+	}
+
+	ES3Arena arena;
+	arenaInit(&arena, 4096);
+
+	// Everything after the file names in the gcc command
+	ES3StrBuf flags = strbufNewIn(&arena);
+	// Link time optimization is pointless without optimizing
+	if (lto && optimize == NULL) optimize = "-O2";
+	if (optimize != NULL) {
+		strbufAppend(&flags, " ");
+		strbufAppend(&flags, optimize);
+	}
+	if (arch != NULL) {
+		strbufAppend(&flags, " ");
+		strbufAppend(&flags, arch);
+	}
+	// The runtime has to be built with the same var representation as the program
+	if (nanBox) strbufAppend(&flags, " -DES3_NANBOX");
+	// Operators on numbers and bools are inlined, across the program and runtime with -flto
+	if (lto) strbufAppend(&flags, " -flto -DES3_INLINE");
+
+	// The runtime library built by the Makefile is linked in, without it the runtime is compiled along with the program
+	ES3StrBuf libraryName = strbufNewIn(&arena);
+	strbufAppend(&libraryName, "es3rt");
+	if (nanBox) strbufAppend(&libraryName, "_nanbox");
+	if (lto) strbufAppend(&libraryName, "_lto");
+	ES3StrBuf libraryBuf = strbufNewIn(&arena);
+	strbufAppend(&libraryBuf, "lib");
+	strbufAppend(&libraryBuf, strbufText(&libraryName));
+	strbufAppend(&libraryBuf, ".a");
+
+	ES3Build build;
+	strbufAppend(&flags, " -I.");
+	build.compileFlags = strbufText(&flags);
+
+	ES3StrBuf linkFlags = strbufNewIn(&arena);
+	build.library = strbufText(&libraryBuf);
+	FILE* libraryFile = fopen(build.library, "rb");
+	build.hasLibrary = libraryFile != NULL;
+	if (build.hasLibrary) {
+		fclose(libraryFile);
+		strbufAppend(&linkFlags, " -L. -l");
+		strbufAppend(&linkFlags, strbufText(&libraryName));
+	}
+	strbufAppend(&linkFlags, " -lm");
+	build.linkFlags = strbufText(&linkFlags);
+
+	flags = strbufNewIn(&arena);
+	strbufAppend(&flags, build.compileFlags);
+	if (!build.hasLibrary) strbufAppend(&flags, " esvutil.c std.c");
+	strbufAppend(&flags, build.linkFlags);
+	build.flags = strbufText(&flags);
+	build.emitOnly = emitOnly;
+	// The cache only has executables
+	build.useCache = useCache && !emitOnly && cacheOpen(&build.cache) == 0;
+
+	if (watch) {
+		// The object files of the units are kept next to the executable
+		ES3StrBuf unitDir = strbufNewIn(&arena);
+		strbufAppend(&unitDir, files[1]);
+		strbufAppend(&unitDir, ".units");
+#ifdef _WIN32
+		_mkdir(strbufText(&unitDir));
+#else
+		mkdir(strbufText(&unitDir), 0755);
+#endif
+
+		// Runs until it is stopped, -j is how many units are compiled at once
+		ES3Watch watcher;
+		watchOpen(&watcher, files[0]);
+		ES3UnitObjects objects = { NULL, 0 };
+		for (;;) {
+			watchBuild(&build, files[0], files[1], strbufText(&unitDir), jobs > 0 ? jobs : 1, &objects);
+			printf("Waiting for %s to change\r\n", files[0]);
+			fflush(stdout);
+			watchWait(&watcher);
+		}
+	}
+
+	int code = 0;
+	if (jobs == 0) {
+		ES3BuildResult result;
+		buildFile(&build, files[0], files[1], 0, &result);
+		// Errors in gcc are left for it to report
+		if (result.code != 0 && result.code != 102) code = result.code;
+	} else {
+		// Each file is transpiled and then compiled by the same job, so at most jobs gcc processes run at once
+		ES3Batch batch = { &build, files, smalloc(sizeof(ES3BuildResult) * fileCount) };
+		printf("%9s %9s  %s\r\n", "transpile", "gcc", "file");
+		double start = poolSeconds();
+		poolRun(jobs, fileCount, batchJob, &batch);
+		double total = poolSeconds() - start;
+
+		int built = 0;
+		int cached = 0;
+		double transpile = 0;
+		double gcc = 0;
+		for (int i = 0; i < fileCount; i++) {
+			if (batch.results[i].code == 0) built++;
+			cached += batch.results[i].cached;
+			transpile += batch.results[i].transpile;
+			gcc += batch.results[i].gcc;
+		}
+		printf("Built %i of %i files (%i from the cache) in %.2fs with %i jobs, %.2fs transpiling and %.2fs in gcc\r\n",
+			built, fileCount, cached, total, jobs, transpile, gcc);
+
+		if (built < fileCount) code = 1;
+		free(batch.results);
+	}
+
+	if (timeReport != REPORT_OFF) {
+		fflush(stdout);
+		reportPrint(stderr, timeReport);
+	}
+
+	arenaFree(&arena);
+	free(files);
+	return code;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "pool.h"
+#include "esvutil.h"
+
+/**
+ * State shared by the threads of one poolRun
+ *  - next: index of the next job nobody has taken yet
+ */
+typedef struct ES3Pool_ {
+    ES3PoolJob job;
+    void* context;
+    int count;
+    atomic_int next;
+} ES3Pool;
+
+/**
+ * Takes jobs until there are none left
+ * @param pool - the pool
+ */
+static void poolWork(ES3Pool* pool) {
+	for (;;) {
+		int index = atomic_fetch_add(&pool->next, 1);
+		if (index >= pool->count) return;
+		pool->job(pool->context, index);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI poolThread(LPVOID pool) {
+	poolWork(pool);
+	return 0;
+}
+#else
+static void* poolThread(void* pool) {
+	poolWork(pool);
+	return NULL;
+}
+#endif
+
+void poolRun(int threads, int count, ES3PoolJob job, void* context) {
+	ES3Pool pool;
+	pool.job = job;
+	pool.context = context;
+	pool.count = count;
+	atomic_init(&pool.next, 0);
+
+	if (threads > count) threads = count;
+	// The calling thread works too, so threads - 1 more are started
+	int started = 0;
+#ifdef _WIN32
+	HANDLE* handles = smalloc(sizeof(HANDLE) * (threads > 1 ? threads : 1));
+	for (int i = 1; i < threads; i++) {
+		handles[started] = CreateThread(NULL, 0, poolThread, &pool, 0, NULL);
+		if (handles[started] != NULL) started++;
+	}
+	poolWork(&pool);
+	for (int i = 0; i < started; i++) {
+		WaitForSingleObject(handles[i], INFINITE);
+		CloseHandle(handles[i]);
+	}
+#else
+	pthread_t* handles = smalloc(sizeof(pthread_t) * (threads > 1 ? threads : 1));
+	for (int i = 1; i < threads; i++) {
+		if (pthread_create(&handles[started], NULL, poolThread, &pool) == 0) started++;
+	}
+	poolWork(&pool);
+	for (int i = 0; i < started; i++) pthread_join(handles[i], NULL);
+#endif
+	free(handles);
+}
+
+double poolSeconds(void) {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+#endif
+}
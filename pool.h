@@ -0,0 +1,24 @@
+#pragma once
+
+/**
+ * A job run by poolRun
+ * @param context - the context passed to poolRun
+ * @param index - which job it is, from 0
+ */
+typedef void (*ES3PoolJob)(void* context, int index);
+
+/**
+ * Runs count jobs on a pool of threads and waits for all of them. Jobs are handed out in order as threads
+ * become free, so a slow job never holds up the ones after it
+ * @param threads - most jobs running at once, 1 or less runs them all on the calling thread
+ * @param count - number of jobs
+ * @param job - the job, called once for each index
+ * @param context - passed to every job
+ */
+void poolRun(int threads, int count, ES3PoolJob job, void* context);
+
+/**
+ * Wall clock time for timing jobs, the same across threads
+ * @return Seconds since an arbitrary point
+ */
+double poolSeconds(void);
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "report.h"
+#include "esvutil.h"
+#include "pool.h"
+
+/**
+ * What a phase cost, time and the allocations made on the thread
+ */
+typedef struct ES3ReportCost_ {
+    double seconds;
+    ES3AllocStats allocs;
+} ES3ReportCost;
+
+/**
+ * A phase that was entered and not left yet
+ *  - start: the cost so far when it was entered
+ *  - nested: the cost of the phases nested in it, taken out of its self cost
+ */
+typedef struct ES3ReportFrame_ {
+    int phase;
+    ES3ReportCost start;
+    ES3ReportCost nested;
+} ES3ReportFrame;
+
+static const char* phaseNames[NUM_REPORT_PHASES] = {
+	"read", "lex", "parse",
+	"grammerStatement", "grammerCodeBlock", "grammerFunc", "grammerParenthasis", "grammerArray", "grammerComparison",
+	"grammerExpression", "grammerTerm", "grammerExponentiation", "grammerUnary", "grammerPrimary",
+	"infer", "fold", "codegen", "bytecode", "cache", "output", "gcc", "run",
+};
+
+// Grammer rules are printed indented under parse
+#define IS_GRAMMER_RULE(phase) ((phase) >= REPORT_STATEMENT && (phase) <= REPORT_PRIMARY)
+
+static int enabled = 0;
+static double started;
+
+static ES3ReportFrame* frames = NULL;
+static int frameCount = 0;
+static int frameCapacity = 0;
+
+// Self cost leaves out nested phases, total cost includes them but only counts the outermost call of recursive ones
+static ES3ReportCost selfCost[NUM_REPORT_PHASES];
+static double totalSeconds[NUM_REPORT_PHASES];
+static long long calls[NUM_REPORT_PHASES];
+static int active[NUM_REPORT_PHASES];
+
+/**
+ * Gets the cost so far
+ * @param OUT cost - seconds since reportStart and the allocations of the thread
+ */
+static void costNow(ES3ReportCost* cost) {
+	cost->seconds = poolSeconds() - started;
+#ifdef ES3_ALLOC_STATS
+	cost->allocs = allocStats;
+#else
+	cost->allocs = (ES3AllocStats) { 0 };
+#endif
+}
+
+/**
+ * Adds to a cost the difference of two others
+ * @param cost - the cost to add to
+ * @param end - the larger cost
+ * @param start - the smaller cost
+ */
+static void costAddSpan(ES3ReportCost* cost, const ES3ReportCost* end, const ES3ReportCost* start) {
+	cost->seconds += end->seconds - start->seconds;
+	cost->allocs.mallocs += end->allocs.mallocs - start->allocs.mallocs;
+	cost->allocs.mallocBytes += end->allocs.mallocBytes - start->allocs.mallocBytes;
+	cost->allocs.arenaAllocs += end->allocs.arenaAllocs - start->allocs.arenaAllocs;
+	cost->allocs.arenaBytes += end->allocs.arenaBytes - start->allocs.arenaBytes;
+}
+
+void reportStart(void) {
+	enabled = 1;
+	started = poolSeconds();
+}
+
+void reportEnter(int phase) {
+	if (!enabled) return;
+
+	if (frameCount == frameCapacity) {
+		frameCapacity = frameCapacity ? frameCapacity * 2 : 64;
+		frames = srealloc(frames, sizeof(ES3ReportFrame) * frameCapacity);
+	}
+	ES3ReportFrame* frame = &frames[frameCount++];
+	frame->phase = phase;
+	frame->nested = (ES3ReportCost) { 0 };
+	calls[phase]++;
+	active[phase]++;
+	costNow(&frame->start);
+}
+
+void reportLeave(int phase) {
+	if (!enabled) return;
+
+	ES3ReportCost now;
+	costNow(&now);
+	ES3ReportFrame* frame = &frames[--frameCount];
+
+	// Everything since it was entered, less what the nested phases already took
+	ES3ReportCost span = { 0 };
+	costAddSpan(&span, &now, &frame->start);
+	costAddSpan(&selfCost[phase], &span, &frame->nested);
+	if (frameCount > 0) costAddSpan(&frames[frameCount - 1].nested, &now, &frame->start);
+
+	if (--active[phase] == 0) totalSeconds[phase] += span.seconds;
+}
+
+int reportDepth(void) {
+	return frameCount;
+}
+
+void reportUnwind(int depth) {
+	while (frameCount > depth) reportLeave(frames[frameCount - 1].phase);
+}
+
+void reportPrint(FILE* file, int format) {
+	double wall = poolSeconds() - started;
+	ES3ReportCost now;
+	costNow(&now);
+	ES3AllocStats allocs = now.allocs;
+
+	if (format == REPORT_JSON) {
+		fprintf(file, "{\n  \"wall_ms\": %.3f,\n", wall * 1000);
+		fprintf(file, "  \"mallocs\": %zu, \"malloc_bytes\": %zu, \"arena_allocs\": %zu, \"arena_bytes\": %zu,\n",
+			allocs.mallocs, allocs.mallocBytes, allocs.arenaAllocs, allocs.arenaBytes);
+		fprintf(file, "  \"phases\": [");
+		int first = 1;
+		for (int i = 0; i < NUM_REPORT_PHASES; i++) {
+			if (calls[i] == 0) continue;
+			const ES3ReportCost* self = &selfCost[i];
+			fprintf(file, "%s\n    {\"name\": \"%s\", \"calls\": %lld, \"total_ms\": %.3f, \"self_ms\": %.3f, ", first ? "" : ",",
+				phaseNames[i], calls[i], totalSeconds[i] * 1000, self->seconds * 1000);
+			fprintf(file, "\"mallocs\": %zu, \"malloc_bytes\": %zu, \"arena_allocs\": %zu, \"arena_bytes\": %zu}",
+				self->allocs.mallocs, self->allocs.mallocBytes, self->allocs.arenaAllocs, self->allocs.arenaBytes);
+			first = 0;
+		}
+		fprintf(file, "\n  ]\n}\n");
+		return;
+	}
+
+	// Allocations are the ones made by the phase itself, like self time
+	fprintf(file, "%-24s %10s %10s %10s %6s %9s %10s %9s %10s\n",
+		"phase", "calls", "total ms", "self ms", "self%", "mallocs", "malloc KiB", "arena", "arena KiB");
+	for (int i = 0; i < NUM_REPORT_PHASES; i++) {
+		if (calls[i] == 0) continue;
+		const ES3ReportCost* self = &selfCost[i];
+		fprintf(file, "%s%-*s %10lld %10.3f %10.3f %5.1f%% %9zu %10.1f %9zu %10.1f\n",
+			IS_GRAMMER_RULE(i) ? "  " : "", IS_GRAMMER_RULE(i) ? 22 : 24, phaseNames[i], calls[i],
+			totalSeconds[i] * 1000, self->seconds * 1000, wall > 0 ? self->seconds / wall * 100 : 0,
+			self->allocs.mallocs, self->allocs.mallocBytes / 1024.0, self->allocs.arenaAllocs, self->allocs.arenaBytes / 1024.0);
+	}
+	fprintf(file, "%.3fms in all, %zu mallocs of %.1f KiB and %zu arena allocations of %.1f KiB\n",
+		wall * 1000, allocs.mallocs, allocs.mallocBytes / 1024.0, allocs.arenaAllocs, allocs.arenaBytes / 1024.0);
+}
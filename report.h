@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdio.h>
+
+// What --time-report times, rows of the report are in this order
+#define REPORT_READ 0 // Opening and mapping the source file
+#define REPORT_LEX 1 // lexerTokenize
+#define REPORT_PARSE 2 // grammerProgram, the grammer rules below are part of it
+#define REPORT_STATEMENT 3
+#define REPORT_CODEBLOCK 4
+#define REPORT_FUNC 5
+#define REPORT_PARENTHASIS 6
+#define REPORT_ARRAY 7
+#define REPORT_COMPARISON 8
+#define REPORT_EXPRESSION 9
+#define REPORT_TERM 10
+#define REPORT_EXPONENTIATION 11
+#define REPORT_UNARY 12
+#define REPORT_PRIMARY 13
+#define REPORT_INFER 14 // inferProgram
+#define REPORT_FOLD 15 // foldProgram
+#define REPORT_CODEGEN 16 // codegenProgram
+#define REPORT_BYTECODE 17 // bytecodeProgram
+#define REPORT_CACHE 18 // Hashing everything that goes into the program and copying it in or out of the cache
+#define REPORT_OUTPUT 19 // Writing the C file
+#define REPORT_GCC 20 // The gcc process
+#define REPORT_RUN 21 // Running the program on the VM
+
+#define NUM_REPORT_PHASES 22
+
+#define REPORT_OFF 0
+#define REPORT_TABLE 1
+#define REPORT_JSON 2
+
+/**
+ * Starts timing phases and counting allocations, until then reportEnter and reportLeave do nothing
+ * Phases are kept per process, so they must all be entered on the thread that called this
+ */
+void reportStart(void);
+
+/**
+ * Starts a phase, phases entered before it is left are nested in it and their time is not part of its self time
+ * @param phase - a REPORT_... enum
+ */
+void reportEnter(int phase);
+
+/**
+ * Ends the phase entered last
+ * @param phase - the REPORT_... enum it was entered with
+ */
+void reportLeave(int phase);
+
+/**
+ * Gets how many phases are entered, for reportUnwind
+ * @return Number of phases entered and not left yet
+ */
+int reportDepth(void);
+
+/**
+ * Leaves phases an error jumped out of
+ * @param depth - reportDepth before the phases were entered
+ */
+void reportUnwind(int depth);
+
+/**
+ * Prints the time, number of calls and allocations of every phase that was entered
+ * @param file - where to print it
+ * @param format - REPORT_TABLE or REPORT_JSON
+ */
+void reportPrint(FILE* file, int format);
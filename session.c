@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "session.h"
+#include "report.h"
+
+// Most programs fit in a single block
+#define SESSION_BLOCK_SIZE (64 * 1024)
+
+int sessionOpen(ES3Session* session, const char* path) {
+	arenaInit(&session->arena, SESSION_BLOCK_SIZE);
+	reportEnter(REPORT_READ);
+	int failed = sourceOpen(&session->source, path, &session->arena);
+	reportLeave(REPORT_READ);
+	return failed ? 1 : 0;
+}
+
+void sessionLex(ES3Session* session) {
+	reportEnter(REPORT_LEX);
+	lexerTokenize(&session->stream, &session->source, &session->arena);
+	reportLeave(REPORT_LEX);
+}
+
+void sessionClose(ES3Session* session) {
+	sourceClose(&session->source);
+	arenaFree(&session->arena);
+}
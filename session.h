@@ -0,0 +1,35 @@
+#pragma once
+
+#include "esvutil.h"
+#include "source.h"
+#include "lexer.h"
+
+/**
+ * Everything the transpiler allocates for one source file. The source, its tokens, the syntax tree and
+ * all scratch memory of the passes come from the arena, so the whole compilation is released at once
+ */
+typedef struct ES3Session_ {
+    ES3Arena arena;
+    ES3Source source;
+    ES3TokenStream stream;
+} ES3Session;
+
+/**
+ * Starts a session by mapping a source file, its tokens are made by sessionLex
+ * @param session - OUT the session to fill in
+ * @param path - path of the source file
+ * @return 0 on success, nonzero if the file can't be opened or mapped
+ */
+int sessionOpen(ES3Session* session, const char* path);
+
+/**
+ * Lexes the source of a session into its token stream, left out when a cached build is used
+ * @param session - session started with sessionOpen
+ */
+void sessionLex(ES3Session* session);
+
+/**
+ * Unmaps the source and frees every allocation made from the arena of a session
+ * @param session - session started with sessionOpen
+ */
+void sessionClose(ES3Session* session);
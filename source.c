@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "source.h"
+#include "esvutil.h"
+
+/**
+ * Builds the table of offsets where each line of the source starts
+ * @param source - a source with text and length filled in
+ * @param arena - arena the table is allocated from
+ */
+static void buildLineStarts(ES3Source* source, ES3Arena* arena) {
+	int capacity = 64;
+	source->lineStarts = arenaAlloc(arena, sizeof(size_t) * capacity);
+	source->lineStarts[0] = 0;
+	source->lineCount = 1;
+
+	const char* end = source->text + source->length;
+	for (const char* cur = memchr(source->text, '\n', source->length); cur != NULL; cur = memchr(cur, '\n', end - cur)) {
+		cur++;
+		if (source->lineCount == capacity) {
+			source->lineStarts = arenaGrow(arena, source->lineStarts, sizeof(size_t) * capacity, sizeof(size_t) * capacity * 2);
+			capacity *= 2;
+		}
+		source->lineStarts[source->lineCount++] = cur - source->text;
+	}
+}
+
+int sourceOpen(ES3Source* source, const char* path, ES3Arena* arena) {
+	source->text = "";
+	source->length = 0;
+	source->path = path;
+	source->lineStarts = NULL;
+	source->lineCount = 0;
+	source->mapping = NULL;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return 1;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) { CloseHandle(file); return 1; }
+	// Mapping an empty file fails, the empty text above is already correct
+	if (size.QuadPart == 0) { CloseHandle(file); buildLineStarts(source, arena); return 0; }
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) return 1;
+
+	const char* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) { CloseHandle(mapping); return 1; }
+
+	source->text = view;
+	source->length = (size_t) size.QuadPart;
+	source->mapping = mapping;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return 1;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) { close(fd); return 1; }
+	// Mapping an empty file fails, the empty text above is already correct
+	if (st.st_size == 0) { close(fd); buildLineStarts(source, arena); return 0; }
+
+	void* view = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) return 1;
+	madvise(view, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+	source->text = view;
+	source->length = (size_t) st.st_size;
+	source->mapping = view;
+#endif
+
+	buildLineStarts(source, arena);
+	return 0;
+}
+
+void sourceClose(ES3Source* source) {
+	// The line start table belongs to the arena
+	source->lineStarts = NULL;
+	source->lineCount = 0;
+
+	if (source->mapping == NULL) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(source->text);
+	CloseHandle(source->mapping);
+#else
+	munmap(source->mapping, source->length);
+#endif
+
+	source->mapping = NULL;
+	source->text = "";
+	source->length = 0;
+}
+
+void sourceLocate(const ES3Source* source, const char* at, int* line, int* column) {
+	size_t offset = at < source->text ? 0 : (size_t) (at - source->text);
+	if (offset > source->length) offset = source->length;
+
+	// Last line that starts at or before offset
+	int low = 0;
+	int high = source->lineCount - 1;
+	while (low < high) {
+		int mid = low + (high - low + 1) / 2;
+		if (source->lineStarts[mid] <= offset) low = mid; else high = mid - 1;
+	}
+
+	*line = low + 1;
+	*column = (int) (offset - source->lineStarts[low]) + 1;
+}
+
+// Where sourceError jumps to on this thread, NULL to exit
+static _Thread_local jmp_buf* errorTrap = NULL;
+
+void sourceSetTrap(jmp_buf* trap) {
+	errorTrap = trap;
+}
+
+void sourceError(const ES3Source* source, const char* at, int code, const char* const message, ...) {
+	va_list args;
+	va_start(args, message);
+
+	int line, column;
+	sourceLocate(source, at, &line, &column);
+
+	// Printed in one go so errors of files built at the same time don't run into each other, which also need the file named
+	char text[1024];
+	int length = 0;
+	if (errorTrap != NULL) length = snprintf(text, sizeof(text), "%.512s: ", source->path);
+	length += snprintf(text + length, sizeof(text) - length, "Error on line %i, column %i: ", line, column);
+	vsnprintf(text + length, sizeof(text) - length, message, args);
+	printf("%s", text);
+
+	va_end(args);
+
+	if (errorTrap != NULL) longjmp(*errorTrap, code);
+	exit(code);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <setjmp.h>
+
+#include "esvutil.h"
+
+typedef struct ES3Source_ {
+    const char* text;
+    size_t length;
+    const char* path;
+
+    size_t* lineStarts;
+    int lineCount;
+
+    void* mapping;
+} ES3Source;
+
+/**
+ * Maps a source file into memory so it can be lexed without going through stdio
+ * @param source - OUT the source to fill in
+ * @param path - path of the file to map
+ * @param arena - arena the line start table is allocated from
+ * @return 0 on success, nonzero if the file can't be opened or mapped
+ */
+int sourceOpen(ES3Source* source, const char* path, ES3Arena* arena);
+
+/**
+ * Unmaps a source file opened with sourceOpen
+ * @param source - the source to release
+ */
+void sourceClose(ES3Source* source);
+
+/**
+ * Finds the line and column of a position in the source using the line start table
+ * @param source - the source the position points into
+ * @param at - pointer into source->text
+ * @param OUT line - 1 based line number
+ * @param OUT column - 1 based column number
+ */
+void sourceLocate(const ES3Source* source, const char* at, int* line, int* column);
+
+/**
+ * Errors with message and error code, prefixed with the line and column of a position in the source
+ * @param source - the source the position points into
+ * @param at - pointer into source->text where the error happened
+ * @param code - error code
+ * @param message - message in error
+ */
+void sourceError(const ES3Source* source, const char* at, int code, const char* const message, ...);
+
+/**
+ * Makes sourceError longjmp to trap with its error code instead of exiting, only on the calling thread
+ * Lets a batch carry on past a file with an error, everything the file allocated is in its session
+ * @param trap - where sourceError jumps to, NULL to exit again
+ */
+void sourceSetTrap(jmp_buf* trap);
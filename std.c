@@ -1,48 +1,41 @@
 #include <stdlib.h>
 #include <math.h>
 
-#include "esvutil.h"
-
-#define PI__raw (ES3Var) { .type = 1, .valNum = 3.14159265358979323846 }
-#define E__raw (ES3Var) { .type = 1, .valNum = 2.71828182845904523536 }
-#define RAD__raw (ES3Var) { .type = 1, .valNum = 0.01745329238474369049072265625 }
-#define DEG__raw (ES3Var) { .type = 1, .valNum = 57.295780181884765625 }
+#include "std.h"
 
 ES3Var sqrt__raw(ES3Var a) {
-    if (a.type != 1) return (ES3Var) { .type = 0 };
-    return (ES3Var) { .type = 1, .valNum = sqrt(a.valNum) };
+    if (ES3_TYPE(a) != 1) return ES3_NULL;
+    return ES3_NUM(sqrt(ES3_AS_NUM(a)));
 }
 
 ES3Var sin__raw(ES3Var a) {
-    if (a.type != 1) return (ES3Var) { .type = 0 };
-    return (ES3Var) { .type = 1, .valNum = sin(a.valNum) };
+    if (ES3_TYPE(a) != 1) return ES3_NULL;
+    return ES3_NUM(sin(ES3_AS_NUM(a)));
 }
 
 ES3Var cos__raw(ES3Var a) {
-    if (a.type != 1) return (ES3Var) { .type = 0 };
-    return (ES3Var) { .type = 1, .valNum = cos(a.valNum) };
+    if (ES3_TYPE(a) != 1) return ES3_NULL;
+    return ES3_NUM(cos(ES3_AS_NUM(a)));
 }
 
 ES3Var tan__raw(ES3Var a) {
-    if (a.type != 1) return (ES3Var) { .type = 0 };
-    return (ES3Var) { .type = 1, .valNum = tan(a.valNum) };
+    if (ES3_TYPE(a) != 1) return ES3_NULL;
+    return ES3_NUM(tan(ES3_AS_NUM(a)));
 }
 
 ES3Var log__raw(ES3Var a, ES3Var b) {
-    if (a.type != 1) return (ES3Var) { .type = 0 };
-    if (b.type != 1) return (ES3Var) { .type = 0 };
-    return (ES3Var) { .type = 1, .valNum = log(a.valNum)/log(b.valNum) };
+    if (ES3_TYPE(a) != 1) return ES3_NULL;
+    if (ES3_TYPE(b) != 1) return ES3_NULL;
+    return ES3_NUM(log(ES3_AS_NUM(a))/log(ES3_AS_NUM(b)));
 }
 
 void print__raw(ES3Var a) {
-    char* out = esvToString(a);
-    printf(out);
-    if (a.type == 1 || a.type == 2 || a.type == 4) free(out);
+    esvWriteVar(a);
 }
 
 void println__raw(ES3Var a) {
-    print__raw(a);
-    printf("\n");
+    esvWriteVar(a);
+    esvWriteLine();
 }
 
 ES3Var input__raw(ES3Var a) {
@@ -52,11 +45,13 @@ ES3Var input__raw(ES3Var a) {
     char *pStr = smalloc(len_max);
     current_size = len_max;
 
-    puts(esvToString(a));
+    esvWriteVar(a);
+    esvWrite("\n", 1);
+    esvFlush();
 
     int c = 0;
     unsigned int i =0;
-    while (( c = getchar() ) != '\n') {
+    while (( c = getchar() ) != '\n' && c != EOF) {
         pStr[i++]=(char)c;
 
         if (i == current_size) {
@@ -65,7 +60,8 @@ ES3Var input__raw(ES3Var a) {
         }
     }
 
-    pStr[i] = '\0';
+    ES3String* str = esvStrIntern(pStr, i);
+    free(pStr);
 
-    return (ES3Var) { .type = 2, .valString = pStr };
+    return ES3_STR(str);
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+// Generated code calls pow for ^ on unboxed numbers
+#include <math.h>
+
+#include "esvutil.h"
+
+// Std constants, generated code uses them like vars
+#define PI__raw ES3_NUM(3.14159265358979323846)
+#define E__raw ES3_NUM(2.71828182845904523536)
+#define RAD__raw ES3_NUM(0.01745329238474369049072265625)
+#define DEG__raw ES3_NUM(57.295780181884765625)
+
+/**
+ * Square root of a number, Null if a isn't a number
+ * @param a - the number
+ * @return The square root
+ */
+ES3Var sqrt__raw(ES3Var a);
+
+/**
+ * Sine of a number in radians, Null if a isn't a number
+ * @param a - the number
+ * @return The sine
+ */
+ES3Var sin__raw(ES3Var a);
+
+/**
+ * Cosine of a number in radians, Null if a isn't a number
+ * @param a - the number
+ * @return The cosine
+ */
+ES3Var cos__raw(ES3Var a);
+
+/**
+ * Tangent of a number in radians, Null if a isn't a number
+ * @param a - the number
+ * @return The tangent
+ */
+ES3Var tan__raw(ES3Var a);
+
+
+/**
+ * Log of a number in any base
+ * @param a - the number
+ * @param b - the base
+ * @return log(a) / log(b), Null if either isn't a number
+ */
+ES3Var log__raw(ES3Var a, ES3Var b);
+
+/**
+ * Writes a var to standard output, strings are quoted
+ * @param a - the var
+ */
+void print__raw(ES3Var a);
+
+/**
+ * Writes a var and a newline to standard output
+ * @param a - the var
+ */
+void println__raw(ES3Var a);
+
+/**
+ * Writes a prompt and reads a line from standard input
+ * @param a - the prompt
+ * @return The line without its newline
+ */
+ES3Var input__raw(ES3Var a);
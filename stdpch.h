@@ -0,0 +1,3 @@
+// Generated programs include this first so gcc can use the precompiled stdpch.h.gch/ the Makefile builds.
+// It has no #pragma once: gcc warns about that in the main file, and std.h already has one
+#include "std.h"
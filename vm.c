@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "vm.h"
+#include "jit.h"
+// The std functions are called directly, like the generated code does
+#include "std.h"
+
+/**
+ * The frame of a running function
+ *  - func: the function
+ *  - pc: instruction to continue at in the caller when it returns
+ *  - base: index of its first register in the value stack
+ *  - dest: register of the caller the result goes in
+ */
+typedef struct ES3Frame_ {
+    const ES3Function* func;
+    const ES3Instr* pc;
+    int base;
+    int dest;
+} ES3Frame;
+
+typedef struct ES3StdFunction_ {
+    const char* name;
+    int params;
+} ES3StdFunction;
+
+// Indexes are the b operand of OP_STD
+static const ES3StdFunction stdFunctions[] = {
+	{ "print", 1 },
+	{ "println", 1 },
+	{ "input", 1 },
+	{ "sqrt", 1 },
+	{ "sin", 1 },
+	{ "cos", 1 },
+	{ "tan", 1 },
+	{ "log", 2 },
+};
+
+int vmFindStd(ES3Token name, int* params) {
+	for (int i = 0; i < (int) (sizeof(stdFunctions) / sizeof(stdFunctions[0])); i++) {
+		if (!astTokenIs(name, stdFunctions[i].name)) continue;
+		*params = stdFunctions[i].params;
+		return i;
+	}
+	return -1;
+}
+
+const char* vmStdName(int index) {
+	return stdFunctions[index].name;
+}
+
+int vmFindConstant(ES3Token name, ES3Var* value) {
+	if (astTokenIs(name, "PI")) *value = PI__raw;
+	else if (astTokenIs(name, "E")) *value = E__raw;
+	else if (astTokenIs(name, "RAD")) *value = RAD__raw;
+	else if (astTokenIs(name, "DEG")) *value = DEG__raw;
+	else return 0;
+	return 1;
+}
+
+/**
+ * Calls a std function
+ * @param index - index of the function in stdFunctions
+ * @param args - the args
+ * @return What it returns, Null for the ones that don't return anything
+ */
+static ES3Var callStd(int index, const ES3Var* args) {
+	switch (index) {
+		case 0: print__raw(args[0]); return ES3_NULL;
+		case 1: println__raw(args[0]); return ES3_NULL;
+		case 2: return input__raw(args[0]);
+		case 3: return sqrt__raw(args[0]);
+		case 4: return sin__raw(args[0]);
+		case 5: return cos__raw(args[0]);
+		case 6: return tan__raw(args[0]);
+		default: return log__raw(args[0], args[1]);
+	}
+}
+
+/**
+ * Sets the registers of a function a call doesn't set to Null, a let that reads itself before it is set reads Null
+ * instead of what the last function to use the registers left there
+ * @param func - the function being called
+ * @param regs - its registers
+ */
+static void vmClearRegisters(const ES3Function* func, ES3Var* regs) {
+	for (int i = func->params; i < func->constBase; i++) regs[i] = ES3_NULL;
+	for (int i = func->constBase + func->constCount; i < func->regCount; i++) regs[i] = ES3_NULL;
+}
+
+/**
+ * Checks if args are all numbers, so a function can be called as machine code
+ * @param args - the args
+ * @param count - number of args
+ * @return 1 if they are, otherwise 0
+ */
+static int vmNumbers(const ES3Var* args, int count) {
+	for (int i = 0; i < count; i++) {
+		if (ES3_TYPE(args[i]) != 1) return 0;
+	}
+	return 1;
+}
+
+/*
+ * With GCC and Clang every handler jumps straight to the next one through a table of label addresses, so each
+ * opcode gets its own indirect branch to predict. Other compilers get a switch in a loop
+ */
+#ifdef __GNUC__
+// Labels are named after the opcode number, so the handler macros below can pass opcodes through
+#define VM_LABEL(op) VM_LABEL_(op)
+#define VM_LABEL_(op) L_##op
+#define VM_CASE(op) VM_LABEL(op):
+#define VM_ENTRY(op) [op] = &&VM_LABEL(op)
+#define VM_NEXT() goto *labels[(instr = pc++)->op]
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+#endif
+
+// Handlers of the generic operators, numbers skip the call into the runtime
+#define VM_ARITH(op, runtime, sym) VM_CASE(op) { \
+		ES3Var x = regs[instr->b]; \
+		ES3Var y = regs[instr->c]; \
+		if (ES3_TYPE(x) == 1 && ES3_TYPE(y) == 1) regs[instr->a] = ES3_NUM(ES3_AS_NUM(x) sym ES3_AS_NUM(y)); \
+		else regs[instr->a] = runtime; \
+		VM_NEXT(); \
+	}
+#define VM_COMP(op, sym, runtimeOp) VM_CASE(op) { \
+		ES3Var x = regs[instr->b]; \
+		ES3Var y = regs[instr->c]; \
+		if (ES3_TYPE(x) == 1 && ES3_TYPE(y) == 1) regs[instr->a] = ES3_BOOL(ES3_AS_NUM(x) sym ES3_AS_NUM(y)); \
+		else regs[instr->a] = esvComp(x, runtimeOp, y); \
+		VM_NEXT(); \
+	}
+
+// Handlers of the typed operators and branches, the compiler proved both operands are numbers
+#define VM_ARITHN(op, sym) VM_CASE(op) \
+		regs[instr->a] = ES3_NUM(ES3_AS_NUM(regs[instr->b]) sym ES3_AS_NUM(regs[instr->c])); \
+		VM_NEXT();
+#define VM_COMPN(op, sym) VM_CASE(op) \
+		regs[instr->a] = ES3_BOOL(ES3_AS_NUM(regs[instr->b]) sym ES3_AS_NUM(regs[instr->c])); \
+		VM_NEXT();
+#define VM_JUMPN(op, sym) VM_CASE(op) \
+		if (!(ES3_AS_NUM(regs[instr->b]) sym ES3_AS_NUM(regs[instr->c]))) pc = code + instr->target; \
+		VM_NEXT();
+
+void vmRun(const ES3Bytecode* bytecode, int useJit) {
+#ifdef __GNUC__
+	static const void* const labels[OP_COUNT] = {
+		VM_ENTRY(OP_MOVE), VM_ENTRY(OP_ADD), VM_ENTRY(OP_SUB), VM_ENTRY(OP_MUL),
+		VM_ENTRY(OP_DIV), VM_ENTRY(OP_POW), VM_ENTRY(OP_EQ), VM_ENTRY(OP_GT),
+		VM_ENTRY(OP_GE), VM_ENTRY(OP_LT), VM_ENTRY(OP_LE), VM_ENTRY(OP_NEG),
+		VM_ENTRY(OP_ADDN), VM_ENTRY(OP_SUBN), VM_ENTRY(OP_MULN), VM_ENTRY(OP_DIVN),
+		VM_ENTRY(OP_POWN), VM_ENTRY(OP_EQN), VM_ENTRY(OP_GTN), VM_ENTRY(OP_GEN),
+		VM_ENTRY(OP_LTN), VM_ENTRY(OP_LEN), VM_ENTRY(OP_NEGN), VM_ENTRY(OP_JMP),
+		VM_ENTRY(OP_JMPF), VM_ENTRY(OP_JNEQN), VM_ENTRY(OP_JNGTN), VM_ENTRY(OP_JNGEN),
+		VM_ENTRY(OP_JNLTN), VM_ENTRY(OP_JNLEN), VM_ENTRY(OP_ARRAY), VM_ENTRY(OP_INDEX),
+		VM_ENTRY(OP_SETITEM), VM_ENTRY(OP_CALL), VM_ENTRY(OP_STD), VM_ENTRY(OP_RETAIN),
+		VM_ENTRY(OP_RELEASE), VM_ENTRY(OP_SET), VM_ENTRY(OP_COLLECT), VM_ENTRY(OP_ENTER),
+		VM_ENTRY(OP_LEAVE), VM_ENTRY(OP_RESULT), VM_ENTRY(OP_RETURN), VM_ENTRY(OP_HALT),
+	};
+#endif
+
+	// Registers of every running function, a callee's window starts at the args of the call
+	const ES3Function* entry = &bytecode->functions[bytecode->main];
+	int stackCapacity = 1024;
+	while (entry->regCount > stackCapacity) stackCapacity *= 2;
+	ES3Var* stack = smalloc(sizeof(ES3Var) * stackCapacity);
+	int frameCapacity = 64;
+	ES3Frame* frames = smalloc(sizeof(ES3Frame) * frameCapacity);
+	int frameCount = 0;
+
+	vmClearRegisters(entry, stack);
+	memcpy(stack + entry->constBase, entry->consts, sizeof(ES3Var) * entry->constCount);
+
+	ES3Frame* frame = &frames[0];
+	frame->func = entry;
+	frame->base = 0;
+
+	ES3Var* regs = stack;
+	const ES3Instr* code = entry->code;
+	const ES3Instr* pc = code;
+	const ES3Instr* instr;
+	ES3Var result = ES3_NULL;
+	ES3Jit* jit = useJit ? jitNew(bytecode) : NULL;
+	// Frame of a call that ran out of C stack as machine code, nothing it calls is run as machine code. 0 if there is none
+	int vmOnly = 0;
+
+#ifdef __GNUC__
+	VM_NEXT();
+#else
+	for (;;) {
+		instr = pc++;
+		switch (instr->op) {
+#endif
+
+	VM_CASE(OP_MOVE)
+		regs[instr->a] = regs[instr->b];
+		VM_NEXT();
+
+	VM_ARITH(OP_ADD, esvExpr(x, 1, y), +)
+	VM_ARITH(OP_SUB, esvExpr(x, 2, y), -)
+	VM_ARITH(OP_MUL, esvTerm(x, 1, y), *)
+	VM_ARITH(OP_DIV, esvTerm(x, 2, y), /)
+
+	VM_CASE(OP_POW)
+		regs[instr->a] = esvExpo(regs[instr->b], 1, regs[instr->c]);
+		VM_NEXT();
+
+	VM_COMP(OP_EQ, ==, 1)
+	VM_COMP(OP_GT, >, 2)
+	VM_COMP(OP_GE, >=, 3)
+	VM_COMP(OP_LT, <, 4)
+	VM_COMP(OP_LE, <=, 5)
+
+	VM_CASE(OP_NEG)
+		regs[instr->a] = esvUnary(regs[instr->b]);
+		VM_NEXT();
+
+	VM_ARITHN(OP_ADDN, +)
+	VM_ARITHN(OP_SUBN, -)
+	VM_ARITHN(OP_MULN, *)
+	VM_ARITHN(OP_DIVN, /)
+
+	VM_CASE(OP_POWN)
+		regs[instr->a] = ES3_NUM(pow(ES3_AS_NUM(regs[instr->b]), ES3_AS_NUM(regs[instr->c])));
+		VM_NEXT();
+
+	VM_COMPN(OP_EQN, ==)
+	VM_COMPN(OP_GTN, >)
+	VM_COMPN(OP_GEN, >=)
+	VM_COMPN(OP_LTN, <)
+	VM_COMPN(OP_LEN, <=)
+
+	VM_CASE(OP_NEGN)
+		regs[instr->a] = ES3_NUM(-ES3_AS_NUM(regs[instr->b]));
+		VM_NEXT();
+
+	VM_CASE(OP_JMP)
+		pc = code + instr->target;
+		VM_NEXT();
+
+	VM_CASE(OP_JMPF)
+		if (!esvTruthy(regs[instr->a])) pc = code + instr->target;
+		VM_NEXT();
+
+	VM_JUMPN(OP_JNEQN, ==)
+	VM_JUMPN(OP_JNGTN, >)
+	VM_JUMPN(OP_JNGEN, >=)
+	VM_JUMPN(OP_JNLTN, <)
+	VM_JUMPN(OP_JNLEN, <=)
+
+	VM_CASE(OP_ARRAY)
+		regs[instr->a] = esvArrayNew(instr->c, &regs[instr->b]);
+		VM_NEXT();
+
+	VM_CASE(OP_INDEX)
+		regs[instr->a] = *esvIndexVar(regs[instr->b], regs[instr->c]);
+		VM_NEXT();
+
+	VM_CASE(OP_SETITEM) {
+		ES3Var array = regs[instr->a];
+		esvAssignItem(array, esvIndexVar(array, regs[instr->b]), regs[instr->c]);
+		esvCollect();
+		VM_NEXT();
+	}
+
+	VM_CASE(OP_CALL) {
+		const ES3Function* callee = &bytecode->functions[instr->b];
+		// Hot functions that have only been called with numbers run as machine code
+		if (jit != NULL && vmOnly == 0 && jit->calls[instr->b] >= 0) {
+			if (vmNumbers(&regs[instr->c], callee->params)) {
+				ES3JitEntry native = jitEntry(jit, instr->b);
+				if (native != NULL) {
+					double args[JIT_MAX_PARAMS];
+					for (int i = 0; i < callee->params; i++) {
+						args[i] = ES3_AS_NUM(regs[instr->c + i]);
+					}
+					double value = native(args);
+					if (jit->stack == 0) {
+						regs[instr->a] = ES3_NUM(value);
+						VM_NEXT();
+					}
+					// Too deep for the C stack, compiled functions only compute so the call can start over here
+					jit->stack = 0;
+					vmOnly = frameCount + 1;
+				}
+			} else if (jit->entries[instr->b] == NULL) {
+				// Its arg types aren't stable, it stays in the VM
+				jit->calls[instr->b] = -1;
+			}
+		}
+
+		int base = frame->base + instr->c;
+		if (base + callee->regCount > stackCapacity) {
+			while (base + callee->regCount > stackCapacity) stackCapacity *= 2;
+			stack = srealloc(stack, sizeof(ES3Var) * stackCapacity);
+		}
+		if (frameCount + 1 == frameCapacity) {
+			frameCapacity *= 2;
+			frames = srealloc(frames, sizeof(ES3Frame) * frameCapacity);
+		}
+
+		frame = &frames[++frameCount];
+		frame->func = callee;
+		frame->pc = pc;
+		frame->base = base;
+		frame->dest = instr->a;
+
+		regs = stack + base;
+		vmClearRegisters(callee, regs);
+		memcpy(regs + callee->constBase, callee->consts, sizeof(ES3Var) * callee->constCount);
+		code = callee->code;
+		pc = code;
+		esvEnter();
+		VM_NEXT();
+	}
+
+	VM_CASE(OP_STD)
+		regs[instr->a] = callStd(instr->b, &regs[instr->c]);
+		VM_NEXT();
+
+	VM_CASE(OP_RETAIN)
+		esvRetain(regs[instr->a]);
+		VM_NEXT();
+
+	VM_CASE(OP_RELEASE)
+		esvRelease(regs[instr->a]);
+		VM_NEXT();
+
+	VM_CASE(OP_SET)
+		esvAssign(&regs[instr->a], esvPromote(regs[instr->b], esvDepth - instr->c));
+		esvCollect();
+		VM_NEXT();
+
+	VM_CASE(OP_COLLECT)
+		esvCollect();
+		VM_NEXT();
+
+	VM_CASE(OP_ENTER)
+		esvEnter();
+		VM_NEXT();
+
+	VM_CASE(OP_LEAVE)
+		esvLeave();
+		VM_NEXT();
+
+	VM_CASE(OP_RESULT)
+		// Kept alive while the vars are released
+		result = esvRetain(esvPromote(regs[instr->a], esvDepth - instr->b - 1));
+		for (int i = 0; i <= instr->b; i++) {
+			esvLeave();
+		}
+		VM_NEXT();
+
+	VM_CASE(OP_RETURN) {
+		// Handed to the caller as a temporary
+		esvRelease(result);
+		if (frameCount == vmOnly) vmOnly = 0;
+		pc = frame->pc;
+		int dest = frame->dest;
+		frame = &frames[--frameCount];
+		regs = stack + frame->base;
+		code = frame->func->code;
+		regs[dest] = result;
+		VM_NEXT();
+	}
+
+	VM_CASE(OP_HALT)
+		esvFlush();
+		jitFree(jit);
+		free(stack);
+		free(frames);
+		return;
+
+#ifndef __GNUC__
+		}
+	}
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "bytecode.h"
+
+/**
+ * Runs a program lowered by bytecodeProgram, output is flushed before it returns
+ * @param bytecode - the bytecode
+ * @param useJit - (1) hot functions that only compute with numbers are compiled to machine code (0) everything runs in the VM
+ */
+void vmRun(const ES3Bytecode* bytecode, int useJit);
+
+/**
+ * Finds a std function by name
+ * @param name - the name token
+ * @param OUT params - number of args it takes
+ * @return Its index for OP_STD, -1 if there is no std function with that name
+ */
+int vmFindStd(ES3Token name, int* params);
+
+/**
+ * Gets the name of a std function, for bytecodeDisasm
+ * @param index - index vmFindStd returned
+ * @return The name, does not need to be freed
+ */
+const char* vmStdName(int index);
+
+/**
+ * Finds a std constant by name
+ * @param name - the name token
+ * @param OUT value - its value
+ * @return 1 if there is a std constant with that name, otherwise 0
+ */
+int vmFindConstant(ES3Token name, ES3Var* value);
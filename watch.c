@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "watch.h"
+#include "esvutil.h"
+
+/**
+ * Gets when a file was last modified
+ * @param path - path of the file
+ * @return The time in the finest unit the platform has, -1 if the file doesn't exist right now
+ */
+static long long watchModified(const char* path) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return -1;
+	return ((long long) data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat info;
+	if (stat(path, &info) != 0) return -1;
+#ifdef __linux__
+	return (long long) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#else
+	return (long long) info.st_mtime;
+#endif
+#endif
+}
+
+/**
+ * Sleeps the calling thread
+ * @param ms - milliseconds to sleep for
+ */
+static void watchSleep(int ms) {
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec duration = { ms / 1000, (long) (ms % 1000) * 1000000 };
+	nanosleep(&duration, NULL);
+#endif
+}
+
+void watchOpen(ES3Watch* watch, const char* path) {
+	watch->path = path;
+	watch->modified = watchModified(path);
+	watch->fd = -1;
+
+	const char* slash = strrchr(path, '/');
+#ifdef _WIN32
+	const char* backslash = strrchr(path, '\\');
+	if (backslash != NULL && (slash == NULL || backslash > slash)) slash = backslash;
+#endif
+	watch->name = slash != NULL ? slash + 1 : path;
+
+#ifdef __linux__
+	size_t length = slash != NULL ? (size_t) (slash - path) : 1;
+	char* dir = smalloc(length + 1);
+	memcpy(dir, slash != NULL ? path : ".", length);
+	dir[length] = '\0';
+	// "/name" is in the root directory
+	if (slash == path) strcpy(dir, "/");
+
+	watch->fd = inotify_init1(IN_CLOEXEC);
+	if (watch->fd >= 0 && inotify_add_watch(watch->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+		close(watch->fd);
+		watch->fd = -1;
+	}
+	free(dir);
+#endif
+}
+
+#ifdef __linux__
+/**
+ * Reads the events waiting on an inotify watch
+ * @param watch - the watch
+ * @param timeout - most milliseconds to wait for an event, -1 to wait for as long as it takes
+ * @return 1 if any of them were about the file, 0 if none were or none came in time
+ */
+static int watchEvents(ES3Watch* watch, int timeout) {
+	struct pollfd ready = { watch->fd, POLLIN, 0 };
+	if (poll(&ready, 1, timeout) <= 0) return 0;
+
+	// Big enough for at least one event with the longest name
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length = read(watch->fd, buffer, sizeof(buffer));
+
+	int changed = 0;
+	for (ssize_t at = 0; at < length; ) {
+		const struct inotify_event* event = (const struct inotify_event*) (buffer + at);
+		if (event->len > 0 && strcmp(event->name, watch->name) == 0) changed = 1;
+		at += sizeof(struct inotify_event) + event->len;
+	}
+	return changed;
+}
+#endif
+
+void watchWait(ES3Watch* watch) {
+#ifdef __linux__
+	if (watch->fd >= 0) {
+		while (!watchEvents(watch, -1)) { }
+		// Whatever else the save does comes within the settle time
+		while (watchEvents(watch, WATCH_SETTLE_MS)) { }
+		watch->modified = watchModified(watch->path);
+		return;
+	}
+#endif
+
+	for (;;) {
+		watchSleep(WATCH_POLL_MS);
+		long long modified = watchModified(watch->path);
+		if (modified == watch->modified || modified < 0) continue;
+
+		do {
+			watch->modified = modified;
+			watchSleep(WATCH_SETTLE_MS);
+			modified = watchModified(watch->path);
+		} while (modified != watch->modified && modified >= 0);
+		return;
+	}
+}
+
+void watchClose(ES3Watch* watch) {
+#ifdef __linux__
+	if (watch->fd >= 0) close(watch->fd);
+#endif
+	watch->fd = -1;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// How often a file is checked when there is no way to be told it changed
+#define WATCH_POLL_MS 100
+// How long a file has to stay unchanged after a change before it is built, editors often write in several steps
+#define WATCH_SETTLE_MS 20
+
+/**
+ * Waits for changes to a file, through inotify on Linux and by polling its modification time elsewhere
+ * The directory is watched rather than the file so editors that save by renaming a new file over it are seen
+ */
+typedef struct ES3Watch_ {
+    const char* path;
+    long long modified;
+
+    int fd;
+    const char* name;
+} ES3Watch;
+
+/**
+ * Starts watching a file
+ * @param watch - OUT the watch
+ * @param path - path of the file, must outlive the watch
+ */
+void watchOpen(ES3Watch* watch, const char* path);
+
+/**
+ * Blocks until the file changes and has settled
+ * @param watch - the watch
+ */
+void watchWait(ES3Watch* watch);
+
+/**
+ * Stops watching a file
+ * @param watch - the watch
+ */
+void watchClose(ES3Watch* watch);